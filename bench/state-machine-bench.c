@@ -0,0 +1,684 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Benchmark of state machine implementations and locking primitives.
+ *
+ * Usage: state-machine-bench [EVENTS [THREADS]]
+ *
+ * EVENTS is number of events sent in each single-threaded measurement and
+ * by each thread in multi-threaded ones, THREADS is maximal number of threads
+ * used by multi-threaded measurements.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "state-machine.h"
+#include "state-machine-lock.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_EVENTS      (UINT64_C(1) << 21)
+#define DEFAULT_THREADS     64
+
+/* Events are taken from a precomputed random sequence so that neither
+ * generating them nor branch prediction distort results.
+ */
+#define EVENT_SEQUENCE      (1 << 16)
+
+typedef struct
+{
+    const char *name;
+    uint32_t max_state;
+    uint32_t max_event;
+} Table_size;
+
+static const Table_size table_sizes[] =
+{
+    {"small", 16, 16},
+
+    /* Over 24 MB of State_machine_transition entries, which doesn't fit in
+     * to caches of a common CPU.
+     */
+    {"large", 4096, 256}
+};
+
+#define TABLE_SIZES     (sizeof(table_sizes) / sizeof(table_sizes[0]))
+
+enum
+{
+    MODE_TABLE = 0,
+    MODE_COMPACT_TABLE,
+    MODE_SPARSE_TABLE,
+    MODE_COMPILED_TABLE,
+    MODE_FUNCTION,
+    MODE_OUTPUT_FUNCTION,
+
+    /* Same as MODE_TABLE and MODE_FUNCTION, but events are sent using
+     * variant of state_machine_event() returned by
+     * state_machine_event_handler().
+     */
+    MODE_TABLE_SPECIALIZED,
+    MODE_FUNCTION_SPECIALIZED,
+    MAX_MODE
+};
+
+static const char *mode_names[] =
+{
+    "table", "compact", "sparse", "compiled", "function", "output",
+    "table-sp", "func-sp"
+};
+
+enum
+{
+    LOCKING_NONE = 0,
+    LOCKING_MUTEX,
+    LOCKING_SPINLOCK,
+
+    /* Locking primitives of state-machine-lock.h. */
+    LOCKING_TICKET,
+    LOCKING_ADAPTIVE,
+    LOCKING_PTHREAD,
+    LOCKING_LOCK_FREE,
+    MAX_LOCKING
+};
+
+static const char *locking_names[] =
+    {"none", "mutex", "spinlock", "ticket", "adaptive", "pthread",
+        "lock-free"};
+
+/* Locking primitives get only pointer to state machine, therefore it has to
+ * be the first member of structure that holds the lock. Built-in locks are
+ * part of State_machine_locked.
+ */
+typedef struct
+{
+    State_machine_locked locked;
+    pthread_mutex_t mutex;
+    atomic_flag spinlock;
+    int locking;
+
+    /* Data of callbacks in multi-threaded measurements, it has its own cache
+     * line so that machines that aren't shared don't share it either.
+     */
+    _Alignas(64) atomic_uint_fast64_t data;
+} Bench_machine;
+
+typedef struct
+{
+    State_machine_transition *table;
+    State_machine_compact_transition *compact;
+    State_machine_compact_callback callbacks[3];
+    uint32_t *sparse_rows;
+    State_machine_transition *sparse;
+    On_undefined_state_transition on_undefined_transition;
+    uint32_t *event_class;
+    uint32_t *row;
+    State_machine_transition *compiled;
+    uint32_t class_count;
+} Bench_tables;
+
+static uint32_t event_sequence[EVENT_SEQUENCE];
+
+/* Every table, including the one used by transition function, are the same,
+ * but callbacks are changed when measuring them.
+ */
+static Bench_tables *current_tables;
+static uint32_t current_max_event;
+
+/* {{{ Callbacks and transition function ********************************** */
+
+static void on_enter(uint32_t cause, uint32_t current_state,
+    uint32_t previous_state, void *event_data, void *data)
+{
+    (void)event_data;
+
+    *(atomic_uint_fast64_t *)data += cause + current_state + previous_state;
+}
+
+static void on_undefined(uint32_t cause, uint32_t current_state,
+    void *event_data, void *data)
+{
+    (void)event_data;
+
+    *(atomic_uint_fast64_t *)data += cause + current_state;
+}
+
+static uint32_t transition_function(uint32_t current_state, uint32_t event,
+    void *data, State_machine_transition **transition)
+{
+    (void)data;
+
+    *transition =
+        &current_tables->table[(size_t)current_state * current_max_event + event];
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+static uint32_t output_function(uint32_t current_state, uint32_t event,
+    void *data, State_machine_transition *transition)
+{
+    (void)data;
+
+    *transition =
+        current_tables->table[(size_t)current_state * current_max_event + event];
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+/* }}} Callbacks and transition function ********************************** */
+
+/* {{{ Locking primitives ************************************************* */
+
+static bool mutex_try_take(State_machine *sm)
+{
+    return pthread_mutex_trylock(&((Bench_machine *)sm)->mutex) == 0;
+}
+
+static void mutex_take(State_machine *sm)
+{
+    pthread_mutex_lock(&((Bench_machine *)sm)->mutex);
+}
+
+static void mutex_give(State_machine *sm)
+{
+    pthread_mutex_unlock(&((Bench_machine *)sm)->mutex);
+}
+
+static bool spinlock_try_take(State_machine *sm)
+{
+    return !atomic_flag_test_and_set_explicit(&((Bench_machine *)sm)->spinlock,
+        memory_order_acquire);
+}
+
+static void spinlock_take(State_machine *sm)
+{
+    while (atomic_flag_test_and_set_explicit(&((Bench_machine *)sm)->spinlock,
+        memory_order_acquire))
+    {
+        /* Busy waiting. */
+    }
+}
+
+static void spinlock_give(State_machine *sm)
+{
+    atomic_flag_clear_explicit(&((Bench_machine *)sm)->spinlock,
+        memory_order_release);
+}
+
+static bool is_builtin_locking(const int locking)
+{
+    return locking == LOCKING_TICKET || locking == LOCKING_ADAPTIVE
+        || locking == LOCKING_PTHREAD;
+}
+
+static uint32_t builtin_lock_kind(const int locking)
+{
+    return locking == LOCKING_TICKET ? STATE_MACHINE_TICKET_LOCK
+        : locking == LOCKING_ADAPTIVE ? STATE_MACHINE_ADAPTIVE_LOCK
+        : STATE_MACHINE_MUTEX_LOCK;
+}
+
+/* }}} Locking primitives ************************************************* */
+
+static void *xmalloc(const size_t size)
+{
+    void *p = malloc(size);
+
+    if (p == NULL)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return p;
+}
+
+static uint64_t xorshift(uint64_t *const x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 7;
+    *x ^= *x << 17;
+
+    return *x;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+/* Random table in which every tenth transition is undefined.
+ */
+static void tables_create(Bench_tables *const t, const Table_size *const size)
+{
+    const size_t cells = (size_t)size->max_state * size->max_event;
+    uint64_t x = UINT64_C(88172645463325252);
+
+    memset(t, 0, sizeof(Bench_tables));
+    t->table = xmalloc(cells * sizeof(State_machine_transition));
+    for (size_t i = 0; i < cells; i++)
+    {
+        const uint32_t s = (uint32_t)(i / size->max_event);
+        const uint32_t e = (uint32_t)(i % size->max_event);
+        const uint64_t r = xorshift(&x);
+        State_machine_transition defined = STATE_MACHINE_TRANSITION(s, e,
+            (uint32_t)(r % size->max_state), NULL);
+        State_machine_transition undefined =
+            STATE_MACHINE_NO_TRANSITION(s, e, NULL);
+
+        t->table[i] = (r >> 32) % 10 == 0 ? undefined : defined;
+    }
+
+    t->compact = xmalloc(cells * sizeof(State_machine_compact_transition));
+    t->sparse_rows = xmalloc((size->max_state + 1) * sizeof(uint32_t));
+    t->event_class = xmalloc(size->max_event * sizeof(uint32_t));
+    t->row = xmalloc(size->max_state * sizeof(uint32_t));
+}
+
+static void tables_destroy(Bench_tables *const t)
+{
+    free(t->table);
+    free(t->compact);
+    free(t->sparse_rows);
+    free(t->sparse);
+    free(t->event_class);
+    free(t->row);
+    free(t->compiled);
+}
+
+/* Set callbacks in the transition table and derive all the other
+ * representations from it.
+ */
+static void tables_set_callbacks(Bench_tables *const t,
+    const Table_size *const size, const bool callbacks)
+{
+    const size_t cells = (size_t)size->max_state * size->max_event;
+    State_machine_compile_statistics statistics;
+    size_t count;
+
+    for (size_t i = 0; i < cells; i++)
+    {
+        State_machine_transition *const tr = &t->table[i];
+
+        if (tr->is_transition)
+        {
+            tr->result.transition.on_enter = callbacks ? on_enter : NULL;
+        }
+        else
+        {
+            tr->result.no_transition.on_undefined_transition =
+                callbacks ? on_undefined : NULL;
+        }
+    }
+    t->on_undefined_transition = callbacks ? on_undefined : NULL;
+
+    (void)state_machine_compact_table(t->table, size->max_state,
+        size->max_event, t->compact, t->callbacks, 3, NULL);
+
+    free(t->sparse);
+    (void)state_machine_sparse_table(t->table, size->max_state,
+        size->max_event, t->on_undefined_transition, NULL, NULL, 0, &count);
+    t->sparse = xmalloc(count * sizeof(State_machine_transition));
+    (void)state_machine_sparse_table(t->table, size->max_state,
+        size->max_event, t->on_undefined_transition, t->sparse_rows,
+        t->sparse, count, &count);
+
+    free(t->compiled);
+    (void)state_machine_compile_table(t->table, size->max_state,
+        size->max_event, t->event_class, t->row, NULL, 0, &statistics);
+    count = (size_t)statistics.row_count * statistics.class_count;
+    t->compiled = xmalloc(count * sizeof(State_machine_transition));
+    (void)state_machine_compile_table(t->table, size->max_state,
+        size->max_event, t->event_class, t->row, t->compiled, count,
+        &statistics);
+    t->class_count = statistics.class_count;
+}
+
+static bool machine_init(Bench_machine *const m, Bench_tables *const t,
+    const Table_size *const size, const int mode, const int locking,
+    void *const data)
+{
+    State_machine_locking no_locking = STATE_MACHINE_NO_LOCKING;
+    State_machine_locking mutex =
+        {.try_take = mutex_try_take, .take = mutex_take, .give = mutex_give};
+    State_machine_locking spinlock = {.try_take = spinlock_try_take,
+        .take = spinlock_take, .give = spinlock_give};
+    State_machine_locking lock = locking == LOCKING_MUTEX ? mutex
+        : locking == LOCKING_SPINLOCK ? spinlock : no_locking;
+
+    pthread_mutex_init(&m->mutex, NULL);
+    atomic_flag_clear(&m->spinlock);
+    m->locking = locking;
+    if (is_builtin_locking(locking)
+        && is_sm_failure(state_machine_init_lock(&m->locked,
+            builtin_lock_kind(locking), &lock)))
+    {
+        fprintf(stderr, "Unable to initialize lock.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    switch (mode)
+    {
+        case MODE_TABLE:
+        case MODE_TABLE_SPECIALIZED:
+            state_machine_init_table(&m->locked.state_machine, size->max_state,
+                size->max_event, 0, lock, t->table, data);
+            break;
+
+        case MODE_COMPACT_TABLE:
+            state_machine_init_compact_table(&m->locked.state_machine, size->max_state,
+                size->max_event, 0, lock, t->compact, t->callbacks, data);
+            break;
+
+        case MODE_SPARSE_TABLE:
+            state_machine_init_sparse_table(&m->locked.state_machine, size->max_state,
+                size->max_event, 0, lock, t->sparse_rows, t->sparse,
+                t->on_undefined_transition, data);
+            break;
+
+        case MODE_COMPILED_TABLE:
+            state_machine_init_compiled_table(&m->locked.state_machine, size->max_state,
+                size->max_event, 0, lock, t->event_class, t->row,
+                t->compiled, t->class_count, data);
+            break;
+
+        case MODE_FUNCTION:
+        case MODE_FUNCTION_SPECIALIZED:
+            state_machine_init_function(&m->locked.state_machine, size->max_state,
+                size->max_event, 0, lock, transition_function, NULL, data);
+            break;
+
+        default:
+            state_machine_init_output_function(&m->locked.state_machine, size->max_state,
+                size->max_event, 0, lock, output_function, data);
+            break;
+    }
+
+    if (locking == LOCKING_LOCK_FREE)
+    {
+        /* There are no specialized variants for lock-free operation.
+         */
+        return mode != MODE_TABLE_SPECIALIZED
+            && is_sm_success(state_machine_set_lock_free(&m->locked.state_machine));
+    }
+
+    return true;
+}
+
+static void machine_destroy(Bench_machine *const m)
+{
+    if (is_builtin_locking(m->locking))
+    {
+        state_machine_destroy_lock(&m->locked,
+            builtin_lock_kind(m->locking));
+    }
+    pthread_mutex_destroy(&m->mutex);
+}
+
+static void send_events(State_machine *const sm,
+    State_machine_event_handler handler, const uint64_t events,
+    const uint32_t offset)
+{
+    const uint32_t max_event = sm->max_event;
+
+    for (uint64_t i = 0; i < events; i++)
+    {
+        const uint32_t event =
+            event_sequence[(i + offset) % EVENT_SEQUENCE] % max_event;
+
+        if_sm_failure (handler(sm, event, NULL, 0))
+        {
+            fprintf(stderr, "State machine failed to handle event.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void print_header(void)
+{
+    printf("%-9s %-10s %-9s %-6s %7s %8s %10s %14s\n", "mode", "locking",
+        "callbacks", "table", "threads", "machines", "ns/event", "events/sec");
+}
+
+static void print_result(const int mode, const int locking,
+    const bool callbacks, const Table_size *const size,
+    const unsigned threads, const unsigned machines, const uint64_t events,
+    const uint64_t elapsed)
+{
+    const double ns = (double)elapsed / (double)events;
+
+    printf("%-9s %-10s %-9s %-6s %7u %8u %10.2f %14.0f\n", mode_names[mode],
+        locking_names[locking], callbacks ? "yes" : "no", size->name, threads,
+        machines, ns, 1e9 / ns);
+    fflush(stdout);
+}
+
+/* {{{ Multi-threaded measurements **************************************** */
+
+typedef struct
+{
+    State_machine *sm;
+    uint64_t events;
+    uint32_t offset;
+    pthread_barrier_t *barrier;
+    uint64_t start;
+    uint64_t end;
+} Bench_thread;
+
+/* Each thread measures itself, when threads outnumber processors some of them
+ * may be done before others even start.
+ */
+static void *bench_thread(void *arg)
+{
+    Bench_thread *const t = arg;
+
+    pthread_barrier_wait(t->barrier);
+    t->start = now_ns();
+    send_events(t->sm, state_machine_event, t->events, t->offset);
+    t->end = now_ns();
+
+    return NULL;
+}
+
+static void bench_threads(Bench_tables *const t, const Table_size *const size,
+    const int locking, const unsigned threads, const bool shared,
+    const uint64_t events)
+{
+    const unsigned machines = shared ? 1 : threads;
+    Bench_machine *const m = aligned_alloc(_Alignof(Bench_machine),
+        machines * sizeof(Bench_machine));
+    Bench_thread *const arg = xmalloc(threads * sizeof(Bench_thread));
+    pthread_t *const thread = xmalloc(threads * sizeof(pthread_t));
+    pthread_barrier_t barrier;
+    uint64_t start = UINT64_MAX;
+    uint64_t end = 0;
+
+    if (m == NULL)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_barrier_init(&barrier, NULL, threads);
+
+    for (unsigned i = 0; i < machines; i++)
+    {
+        m[i].data = 0;
+        (void)machine_init(&m[i], t, size, MODE_TABLE, locking, &m[i].data);
+    }
+
+    for (unsigned i = 0; i < threads; i++)
+    {
+        arg[i].sm = &m[shared ? 0 : i].locked.state_machine;
+        arg[i].events = events;
+        arg[i].offset = i * 7919;
+        arg[i].barrier = &barrier;
+        if (pthread_create(&thread[i], NULL, bench_thread, &arg[i]) != 0)
+        {
+            fprintf(stderr, "Unable to create thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (unsigned i = 0; i < threads; i++)
+    {
+        pthread_join(thread[i], NULL);
+        if (arg[i].start < start)
+        {
+            start = arg[i].start;
+        }
+        if (arg[i].end > end)
+        {
+            end = arg[i].end;
+        }
+    }
+    print_result(MODE_TABLE, locking, true, size, threads, machines,
+        events * threads, end - start);
+
+    for (unsigned i = 0; i < machines; i++)
+    {
+        machine_destroy(&m[i]);
+    }
+    pthread_barrier_destroy(&barrier);
+    free(thread);
+    free(arg);
+    free(m);
+}
+
+/* }}} Multi-threaded measurements **************************************** */
+
+int main(int argc, char *argv[])
+{
+    uint64_t events = DEFAULT_EVENTS;
+    unsigned max_threads = DEFAULT_THREADS;
+    uint64_t x = UINT64_C(2463534242);
+
+    if (argc > 1)
+    {
+        events = strtoull(argv[1], NULL, 10);
+    }
+    if (argc > 2)
+    {
+        max_threads = (unsigned)strtoul(argv[2], NULL, 10);
+    }
+    if (events == 0 || max_threads == 0)
+    {
+        fprintf(stderr, "Usage: %s [EVENTS [THREADS]]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < EVENT_SEQUENCE; i++)
+    {
+        event_sequence[i] = (uint32_t)xorshift(&x);
+    }
+
+    print_header();
+
+    for (size_t s = 0; s < TABLE_SIZES; s++)
+    {
+        const Table_size *const size = &table_sizes[s];
+        Bench_tables tables;
+
+        tables_create(&tables, size);
+        current_tables = &tables;
+        current_max_event = size->max_event;
+
+        for (int cb = 0; cb < 2; cb++)
+        {
+            tables_set_callbacks(&tables, size, cb);
+
+            for (int mode = 0; mode < MAX_MODE; mode++)
+            {
+                for (int locking = 0; locking < MAX_LOCKING; locking++)
+                {
+                    atomic_uint_fast64_t data = 0;
+                    State_machine_event_handler handler = state_machine_event;
+                    Bench_machine m;
+                    uint64_t start;
+
+                    if (!machine_init(&m, &tables, size, mode, locking,
+                        &data))
+                    {
+                        /* Lock-free mode isn't available for transition
+                         * functions.
+                         */
+                        machine_destroy(&m);
+                        continue;
+                    }
+                    if (mode == MODE_TABLE_SPECIALIZED
+                        || mode == MODE_FUNCTION_SPECIALIZED)
+                    {
+                        handler = state_machine_event_handler(&m.locked.state_machine);
+                    }
+
+                    /* Warm up caches and fault in table pages, otherwise
+                     * the first measurement would pay for it.
+                     */
+                    send_events(&m.locked.state_machine, handler,
+                        events < EVENT_SEQUENCE ? events : EVENT_SEQUENCE, 0);
+
+                    start = now_ns();
+                    send_events(&m.locked.state_machine, handler, events, 0);
+                    print_result(mode, locking, cb, size, 1, 1, events,
+                        now_ns() - start);
+                    machine_destroy(&m);
+                }
+            }
+        }
+
+        if (s == 0)
+        {
+            for (unsigned threads = 1; threads <= max_threads; threads *= 2)
+            {
+                for (int locking = LOCKING_MUTEX; locking < MAX_LOCKING;
+                    locking++)
+                {
+                    bench_threads(&tables, size, locking, threads, true,
+                        events);
+                    bench_threads(&tables, size, locking, threads, false,
+                        events);
+                }
+            }
+        }
+
+        tables_destroy(&tables);
+    }
+
+    exit(EXIT_SUCCESS);
+}
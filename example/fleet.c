@@ -0,0 +1,139 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-fleet.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Every connection goes through the same simple life cycle, therefore all of
+ * them share one transition table and only their states are stored
+ * separately.
+ */
+
+enum
+{
+    STATE_IDLE = 0,
+    STATE_CONNECTED,
+    STATE_CLOSED,
+    MAX_STATE
+} State;
+
+static const char *state_names[] =
+    {"STATE_IDLE", "STATE_CONNECTED", "STATE_CLOSED", "unknown"};
+
+enum
+{
+    EVENT_CONNECT = 0,
+    EVENT_CLOSE,
+    MAX_EVENT
+} Event;
+
+#define MAX_CONNECTION  4
+
+#define x_to_str(arr, maxidx, x)    (x < maxidx ? arr[x] : arr[maxidx])
+#define state_to_str(s)             x_to_str(state_names, MAX_STATE, s)
+
+void on_enter(uint32_t cause, uint32_t current_state, uint32_t previous_state,
+    void *event_data, void *data)
+{
+    printf("connection %s: %s -> %s\n", (const char *)data,
+        state_to_str(previous_state), state_to_str(current_state));
+}
+
+static State_machine_transition transition_table[MAX_STATE][MAX_EVENT] =
+{
+    /* 0: STATE_IDLE */
+    {
+        STATE_MACHINE_TRANSITION(STATE_IDLE, EVENT_CONNECT, STATE_CONNECTED,
+            on_enter),
+        STATE_MACHINE_NO_TRANSITION(STATE_IDLE, EVENT_CLOSE, NULL)
+    },
+
+    /* 1: STATE_CONNECTED */
+    {
+        STATE_MACHINE_NO_TRANSITION(STATE_CONNECTED, EVENT_CONNECT, NULL),
+        STATE_MACHINE_TRANSITION(STATE_CONNECTED, EVENT_CLOSE, STATE_CLOSED,
+            on_enter)
+    },
+
+    /* 2: STATE_CLOSED */
+    {
+        STATE_MACHINE_NO_TRANSITION(STATE_CLOSED, EVENT_CONNECT, NULL),
+        STATE_MACHINE_NO_TRANSITION(STATE_CLOSED, EVENT_CLOSE, NULL)
+    }
+};
+
+int main()
+{
+    State_machine_fleet fleet;
+    State_machine_fleet_locking locking = STATE_MACHINE_FLEET_NO_LOCKING;
+    uint32_t states[MAX_CONNECTION];
+    void *data[MAX_CONNECTION] = {"#0", "#1", "#2", "#3"};
+
+    state_machine_fleet_init_table(&fleet, MAX_STATE, MAX_EVENT, STATE_IDLE,
+        MAX_CONNECTION, locking, &transition_table[0][0], states, data);
+
+    for (uint32_t i = 0; i < MAX_CONNECTION; i++)
+    {
+        if_sm_failure (state_machine_fleet_event(&fleet, i, EVENT_CONNECT,
+            NULL, 0))
+        {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Close every other connection.
+     */
+    for (uint32_t i = 0; i < MAX_CONNECTION; i += 2)
+    {
+        if_sm_failure (state_machine_fleet_event(&fleet, i, EVENT_CLOSE, NULL,
+            0))
+        {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (uint32_t i = 0; i < MAX_CONNECTION; i++)
+    {
+        uint32_t state;
+
+        if_sm_failure (state_machine_fleet_current_state(&fleet, i, &state, 0))
+        {
+            exit(EXIT_FAILURE);
+        }
+
+        printf("connection %s is in %s\n", (const char *)data[i],
+            state_to_str(state));
+    }
+
+    exit(EXIT_SUCCESS);
+}
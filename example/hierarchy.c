@@ -0,0 +1,157 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-hierarchy.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+enum
+{
+    DISCONNECTED = 0,
+    CONNECTED,
+    AUTH,
+    READY,
+    DRAINING,
+    MAX_STATE
+} State;
+
+static const char *state_names[] =
+    {"DISCONNECTED", "CONNECTED", "AUTH", "READY", "DRAINING", "unknown"};
+
+enum
+{
+    EVENT_CONNECT = 0,
+    EVENT_AUTHENTICATED,
+    EVENT_DRAIN,
+    EVENT_RESET,
+    EVENT_DISCONNECT,
+    MAX_EVENT
+} Event;
+
+static const char *event_names[] =
+    {"EVENT_CONNECT", "EVENT_AUTHENTICATED", "EVENT_DRAIN", "EVENT_RESET",
+        "EVENT_DISCONNECT", "unknown"};
+
+#define x_to_str(arr, maxidx, x)    (x < maxidx ? arr[x] : arr[maxidx])
+#define state_to_str(s)             x_to_str(state_names, MAX_STATE, s)
+#define event_to_str(e)             x_to_str(event_names, MAX_EVENT, e)
+
+void on_entry(uint32_t cause, uint32_t current_state, uint32_t previous_state,
+    void *event_data, void *data)
+{
+    printf("  entry %s\n", state_to_str(current_state));
+}
+
+void on_exit(uint32_t cause, uint32_t current_state, uint32_t previous_state,
+    void *event_data, void *data)
+{
+    printf("  exit %s\n", state_to_str(current_state));
+}
+
+void on_undefined(uint32_t cause, uint32_t current_state, void *event_data,
+    void *data)
+{
+    printf("  %s is not handled in %s\n", event_to_str(cause),
+        state_to_str(current_state));
+}
+
+/* CONNECTED is entered through AUTH and all its substates handle EVENT_RESET
+ * and EVENT_DISCONNECT in the same way.
+ */
+static const State_machine_hierarchy_state states[MAX_STATE] =
+{
+    [DISCONNECTED] =
+        {STATE_MACHINE_HIERARCHY_NONE, STATE_MACHINE_HIERARCHY_NONE,
+            on_entry, on_exit},
+    [CONNECTED] = {STATE_MACHINE_HIERARCHY_NONE, AUTH, on_entry, on_exit},
+    [AUTH] = {CONNECTED, STATE_MACHINE_HIERARCHY_NONE, on_entry, on_exit},
+    [READY] = {CONNECTED, STATE_MACHINE_HIERARCHY_NONE, on_entry, on_exit},
+    [DRAINING] = {CONNECTED, STATE_MACHINE_HIERARCHY_NONE, on_entry, on_exit}
+};
+
+static const State_machine_hierarchy_transition transitions[] =
+{
+    {DISCONNECTED, EVENT_CONNECT, CONNECTED, NULL},
+    {AUTH, EVENT_AUTHENTICATED, READY, NULL},
+    {READY, EVENT_DRAIN, DRAINING, NULL},
+    {CONNECTED, EVENT_RESET, CONNECTED, NULL},
+    {CONNECTED, EVENT_DISCONNECT, DISCONNECTED, NULL}
+};
+
+static const uint32_t events[] =
+{
+    EVENT_CONNECT, EVENT_AUTHENTICATED, EVENT_CONNECT, EVENT_RESET,
+    EVENT_AUTHENTICATED, EVENT_DRAIN, EVENT_DISCONNECT
+};
+
+int main()
+{
+    static State_machine_transition table[MAX_STATE * MAX_EVENT];
+    static uint32_t chains[MAX_STATE * MAX_EVENT];
+    static State_machine_hierarchy_action actions[128];
+    State_machine_hierarchy hierarchy;
+    State_machine sm;
+    State_machine_locking locking = STATE_MACHINE_NO_LOCKING;
+    size_t action_count;
+
+    if_sm_failure (state_machine_flatten_hierarchy(&hierarchy,
+        MAX_STATE, MAX_EVENT, states,
+        transitions, sizeof(transitions) / sizeof(transitions[0]),
+        on_undefined, table, chains,
+        actions, sizeof(actions) / sizeof(actions[0]), &action_count))
+    {
+        exit(EXIT_FAILURE);
+    }
+    state_machine_init_hierarchy(&sm, &hierarchy, DISCONNECTED, locking,
+        NULL);
+
+    for (size_t i = 0; i < sizeof(events) / sizeof(events[0]); i++)
+    {
+        uint32_t state;
+
+        printf("%s\n", event_to_str(events[i]));
+
+        if_sm_failure (state_machine_event(&sm, events[i], NULL, 0))
+        {
+            exit(EXIT_FAILURE);
+        }
+
+        if_sm_failure (state_machine_current_state(&sm, &state, 0))
+        {
+            exit(EXIT_FAILURE);
+        }
+
+        printf("Now state machine is in %s\n\n", state_to_str(state));
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,142 @@
+/* Generated by state-machine-gen from example/simple.sm, do not edit.
+ */
+
+#ifndef SIMPLE_STATE_MACHINE_GENERATED_H
+#define SIMPLE_STATE_MACHINE_GENERATED_H
+
+#include "state-machine.h"
+
+enum
+{
+    STATE_0 = 0,
+    STATE_1,
+    STATE_2,
+    SIMPLE_MAX_STATE
+};
+
+enum
+{
+    EVENT_INC = 0,
+    EVENT_DEC,
+    SIMPLE_MAX_EVENT
+};
+
+static const State_machine_transition
+    simple_transition_table[SIMPLE_MAX_STATE][SIMPLE_MAX_EVENT] =
+{
+    {
+        STATE_MACHINE_TRANSITION(STATE_0, EVENT_INC, STATE_1, on_enter),
+        STATE_MACHINE_NO_TRANSITION(STATE_0, EVENT_DEC, on_undefined)
+    },
+    {
+        STATE_MACHINE_TRANSITION(STATE_1, EVENT_INC, STATE_2, on_enter),
+        STATE_MACHINE_TRANSITION(STATE_1, EVENT_DEC, STATE_0, on_enter)
+    },
+    {
+        STATE_MACHINE_NO_TRANSITION(STATE_2, EVENT_INC, on_undefined),
+        STATE_MACHINE_TRANSITION(STATE_2, EVENT_DEC, STATE_1, on_enter)
+    }
+};
+
+/* Initialize state machine so that both simple_event() and generic
+ * functions of the library can be used with it.
+ */
+static inline void simple_init(State_machine *const sm,
+    const uint32_t init_state,
+    State_machine_locking locking,
+    void *const data)
+{
+    state_machine_init_table(sm, SIMPLE_MAX_STATE, SIMPLE_MAX_EVENT, init_state,
+        locking, (State_machine_transition *)simple_transition_table, data);
+}
+
+/* Same as state_machine_event(), but for state machine initialized
+ * using simple_init() that wasn't switched to lock-free operation.
+ */
+static inline uint32_t simple_event(State_machine *const sm,
+    const uint32_t event,
+    void *const event_data,
+    const uint32_t flags)
+{
+    uint32_t current_state;
+    uint32_t previous_state = SIMPLE_MAX_STATE;
+    unsigned action = 0;
+    void *data;
+
+    if (sm->lock.take != NULL)
+    {
+        if (flags & STATE_MACHINE_NONBLOCK)
+        {
+            if (!sm->lock.try_take(sm))
+            {
+                return STATE_MACHINE_WOULD_BLOCK;
+            }
+        }
+        else
+        {
+            sm->lock.take(sm);
+        }
+    }
+
+    current_state = sm->current_state;
+    data = sm->data;
+
+    switch (current_state * SIMPLE_MAX_EVENT + event)
+    {
+        case STATE_0 * SIMPLE_MAX_EVENT + EVENT_INC:
+        case STATE_2 * SIMPLE_MAX_EVENT + EVENT_DEC:
+            previous_state = current_state;
+            current_state = STATE_1;
+            action = 3;
+            break;
+
+        case STATE_0 * SIMPLE_MAX_EVENT + EVENT_DEC:
+        case STATE_2 * SIMPLE_MAX_EVENT + EVENT_INC:
+            action = 2;
+            break;
+
+        case STATE_1 * SIMPLE_MAX_EVENT + EVENT_INC:
+            previous_state = current_state;
+            current_state = STATE_2;
+            action = 3;
+            break;
+
+        case STATE_1 * SIMPLE_MAX_EVENT + EVENT_DEC:
+            previous_state = current_state;
+            current_state = STATE_0;
+            action = 3;
+            break;
+
+        default:
+            break;
+    }
+    sm->current_state = current_state;
+
+    if (sm->lock.take != NULL)
+    {
+        sm->lock.give(sm);
+    }
+
+    /* Not every state machine has actions that use all of these. */
+    (void)previous_state;
+    (void)event_data;
+    (void)data;
+
+    switch (action)
+    {
+        case 2:
+            on_undefined(event, current_state, event_data, data);
+            break;
+
+        case 3:
+            on_enter(event, current_state, previous_state, event_data, data);
+            break;
+
+        default:
+            break;
+    }
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+#endif /* SIMPLE_STATE_MACHINE_GENERATED_H */
@@ -0,0 +1,139 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-private.h"
+#include "state-machine-deferred.h"
+
+void state_machine_init_deferred(State_machine_deferred *const deferred,
+    State_machine_deferred_callback *const callbacks,
+    const size_t size,
+    State_machine_deferred_notify notify,
+    void *const context)
+{
+    ASSERT_NOT_NULL(deferred);
+    ASSERT_NOT_NULL(callbacks);
+    assert(size > 0 && (size & (size - 1)) == 0);
+
+    deferred->callbacks = callbacks;
+    deferred->size = size;
+    deferred->written = 0;
+    deferred->dispatched = 0;
+    deferred->notify = notify;
+    deferred->context = context;
+}
+
+uint32_t state_machine_attach_deferred(State_machine *const sm,
+    State_machine_deferred *const deferred)
+{
+    ASSERT_NOT_NULL(sm);
+
+#ifndef __STDC_NO_ATOMICS__
+    /* Lock-free state machine has no critical section that would keep
+     * callbacks in order.
+     */
+    if (SM_IS_LOCK_FREE(sm))
+    {
+        return STATE_MACHINE_NOT_SUPPORTED;
+    }
+    assert(SM_DEFERRED(sm) == NULL
+        || SM_DEFERRED(sm)->written == SM_DEFERRED(sm)->dispatched);
+
+    SM_DEFERRED(sm) = deferred;
+
+    return STATE_MACHINE_SUCCESS;
+#else
+    (void)deferred;
+
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t state_machine_dispatch_pending(State_machine *const sm,
+    const size_t max_callbacks,
+    size_t *const dispatched)
+{
+    uint32_t ret = STATE_MACHINE_SUCCESS;
+    size_t done = 0;
+
+    ASSERT_NOT_NULL(sm);
+    ASSERT_NOT_NULL(SM_DEFERRED(sm));
+
+#ifndef __STDC_NO_ATOMICS__
+    State_machine_deferred *const deferred = SM_DEFERRED(sm);
+    const uint64_t written = atomic_load_explicit(
+        (_Atomic uint64_t *)&deferred->written, memory_order_acquire);
+    uint64_t position = atomic_load_explicit(
+        (_Atomic uint64_t *)&deferred->dispatched, memory_order_relaxed);
+
+    for (; position < written && done < max_callbacks; position++, done++)
+    {
+        /* Callback is copied so that its slot can be reused while it is
+         * running.
+         */
+        const State_machine_deferred_callback callback =
+            deferred->callbacks[position & (deferred->size - 1)];
+
+        atomic_store_explicit((_Atomic uint64_t *)&deferred->dispatched,
+            position + 1, memory_order_release);
+
+#ifdef STATE_MACHINE_STATISTICS
+        const uint64_t start = SM_STATISTICS(sm) == NULL
+            ? 0 : state_machine_statistics_now();
+#endif
+        if (callback.on_enter != NULL)
+        {
+            callback.on_enter(callback.cause, callback.current_state,
+                callback.previous_state, callback.event_data, callback.data);
+        }
+        else
+        {
+            callback.on_undefined_transition(callback.cause,
+                callback.current_state, callback.event_data, callback.data);
+        }
+#ifdef STATE_MACHINE_STATISTICS
+        if (SM_STATISTICS(sm) != NULL)
+        {
+            statistics_duration(SM_STATISTICS(sm)->callback_duration, start);
+        }
+#endif
+    }
+#else
+    ret = STATE_MACHINE_NOT_SUPPORTED;
+#endif
+
+    if (dispatched != NULL)
+    {
+        *dispatched = done;
+    }
+
+    return ret;
+}
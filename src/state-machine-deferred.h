@@ -0,0 +1,187 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_DEFERRED_H_76282511031175855947647272491698631281
+#define STATE_MACHINE_DEFERRED_H_76282511031175855947647272491698631281
+
+#include "state-machine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Deferred callbacks. When a buffer of deferred callbacks is attached to a
+ * state machine, then state_machine_event() only records callbacks of each
+ * step, while still in critical section, and they are invoked later, in the
+ * same order, by state_machine_dispatch_pending(). Events may be sent by
+ * multiple threads of execution, but only one of them may dispatch callbacks
+ * at a time.
+ */
+
+/** Callback of one step of state machine together with its arguments.
+ */
+typedef struct
+{
+    /** Callback of defined transition, otherwise NULL.
+     */
+    On_state_enter on_enter;
+
+    /** Callback of undefined transition, otherwise NULL.
+     */
+    On_undefined_state_transition on_undefined_transition;
+
+    uint32_t cause;
+    uint32_t current_state;
+    uint32_t previous_state;
+    void *event_data;
+    void *data;
+} State_machine_deferred_callback;
+
+/** Function called after <tt>state_machine_event()</tt>, or
+ * <tt>state_machine_event_batch()</tt>, recorded at least one callback and
+ * left critical section. It may, for example, wake up a thread that calls
+ * <tt>state_machine_dispatch_pending()</tt>.
+ */
+typedef void (*State_machine_deferred_notify)(struct State_machine_s *,
+    void *context);
+
+typedef struct State_machine_deferred_s
+{
+    /** Ring buffer of <tt>size</tt> callbacks.
+     */
+    State_machine_deferred_callback *callbacks;
+
+    /** Number of callbacks, it is a power of two.
+     */
+    size_t size;
+
+    /** Number of callbacks recorded so far, accessed only using atomic
+     * operations.
+     */
+    uint64_t written;
+
+    /** Number of callbacks dispatched so far, accessed only using atomic
+     * operations.
+     */
+    uint64_t dispatched;
+
+    /** It may be NULL.
+     */
+    State_machine_deferred_notify notify;
+
+    /** Passed to <tt>notify</tt>.
+     */
+    void *context;
+} State_machine_deferred;
+
+/** Initialize buffer of deferred callbacks.
+ *
+ * @param[in] deferred
+ *   Storage allocated by caller.
+ *
+ * @param[in] callbacks
+ *   Array of <tt>size</tt> callbacks allocated by caller. It has to stay
+ *   valid for as long as buffer is used.
+ *
+ * @param[in] size
+ *   Number of callbacks, it has to be a power of two.
+ *
+ * @param[in] notify
+ *   Function called when callbacks were recorded. It may be NULL.
+ *
+ * @param[in] context
+ *   Passed to <tt>notify</tt>.
+ */
+void state_machine_init_deferred(State_machine_deferred *const deferred,
+    State_machine_deferred_callback *const callbacks,
+    const size_t size,
+    State_machine_deferred_notify notify,
+    void *const context);
+
+/** Attach buffer of deferred callbacks to a state machine.
+ *
+ * This has to be done before state machine is shared with other threads of
+ * execution. While buffer is attached, <tt>event_data</tt> passed to
+ * <tt>state_machine_event()</tt> has to stay valid until its callback is
+ * dispatched. Events are refused with <tt>STATE_MACHINE_NO_SPACE</tt>,
+ * without any effect, while the buffer is full. Cleanup of transition
+ * function is still called by <tt>state_machine_event()</tt>, before the
+ * callback is dispatched, therefore <tt>event_data</tt> has to outlive it.
+ * Specialized variants, such as <tt>state_machine_event_table_lock()</tt>,
+ * don't support deferred callbacks and
+ * <tt>state_machine_event_handler()</tt> doesn't select them.
+ *
+ * @param[in] state_machine
+ *   Initialized state machine that isn't lock-free.
+ *
+ * @param[in] deferred
+ *   Buffer initialized using <tt>state_machine_init_deferred()</tt>, or NULL
+ *   to detach buffer that is currently attached. There must not be any
+ *   callbacks left in the buffer that is being detached.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If state
+ *   machine is lock-free, or compiler doesn't support C11 atomic operations,
+ *   then it returns <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_attach_deferred(State_machine *const state_machine,
+    State_machine_deferred *const deferred);
+
+/** Invoke callbacks recorded in buffer of deferred callbacks.
+ *
+ * Callbacks are invoked in order in which their steps were made. Callback
+ * recorded in parallel may be left in the buffer for the next call.
+ *
+ * @param[in] state_machine
+ *   State machine with buffer attached using
+ *   <tt>state_machine_attach_deferred()</tt>.
+ *
+ * @param[in] max_callbacks
+ *   Upper bound on number of callbacks invoked by this call.
+ *
+ * @param[out] dispatched
+ *   Number of callbacks invoked by this call is stored here. It may be NULL.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If compiler
+ *   doesn't support C11 atomic operations, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_dispatch_pending(State_machine *const state_machine,
+    const size_t max_callbacks,
+    size_t *const dispatched);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_DEFERRED_H_76282511031175855947647272491698631281 */
@@ -0,0 +1,482 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Memory mapping and file descriptors are POSIX interfaces. */
+#define _POSIX_C_SOURCE 200809L
+
+#include "state-machine-private.h"
+#include "state-machine-file.h"
+#include <errno.h>
+#include <string.h>     /* memcmp(), memset(), strcpy() */
+#include <unistd.h>
+
+#ifdef _POSIX_VERSION
+#include <sys/uio.h>    /* readv(), writev() */
+#endif
+#ifdef _POSIX_MAPPED_FILES
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/* Transition table starts at this offset, which keeps it aligned to a cache
+ * line.
+ */
+#define TABLE_OFFSET    64
+
+#ifdef _POSIX_MAPPED_FILES
+static bool write_all(const int fd, const void *const buffer, size_t size)
+{
+    const char *p = buffer;
+
+    while (size > 0)
+    {
+        const ssize_t n = write(fd, p, size);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+
+    return true;
+}
+#endif
+
+uint32_t state_machine_write_table(const char *const path,
+    const State_machine_compact_transition *const table,
+    const uint32_t max_state,
+    const uint32_t max_event)
+{
+    ASSERT_NOT_NULL(path);
+    ASSERT_NOT_NULL(table);
+    assert(max_state > 0 && max_state <= STATE_MACHINE_COMPACT_MAX_STATE);
+    assert(max_event > 0);
+
+#ifdef _POSIX_MAPPED_FILES
+    const size_t cells = (size_t)max_state * max_event;
+    char header_block[TABLE_OFFSET];
+    State_machine_file_header header;
+    uint32_t callback_count = 0;
+    int saved_errno;
+    int fd;
+
+    for (size_t i = 0; i < cells; i++)
+    {
+        if (COMPACT_CALLBACK(table[i]) >= callback_count)
+        {
+            callback_count = COMPACT_CALLBACK(table[i]) + 1;
+        }
+    }
+
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, STATE_MACHINE_FILE_MAGIC);
+    header.version = STATE_MACHINE_FILE_VERSION;
+    header.byte_order = STATE_MACHINE_FILE_BYTE_ORDER;
+    header.max_state = max_state;
+    header.max_event = max_event;
+    header.callback_count = callback_count;
+    header.table_offset = TABLE_OFFSET;
+
+    memset(header_block, 0, sizeof(header_block));
+    memcpy(header_block, &header, sizeof(header));
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        return STATE_MACHINE_SYSTEM_ERROR;
+    }
+
+    if (write_all(fd, header_block, sizeof(header_block))
+        && write_all(fd, table, cells * sizeof(State_machine_compact_transition)))
+    {
+        if (close(fd) == 0)
+        {
+            return STATE_MACHINE_SUCCESS;
+        }
+
+        return STATE_MACHINE_SYSTEM_ERROR;
+    }
+
+    saved_errno = errno;
+    (void)close(fd);
+    errno = saved_errno;
+
+    return STATE_MACHINE_SYSTEM_ERROR;
+#else
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t state_machine_map_table(const char *const path,
+    State_machine_mapped_table *const mapped)
+{
+    ASSERT_NOT_NULL(path);
+    ASSERT_NOT_NULL(mapped);
+
+#ifdef _POSIX_MAPPED_FILES
+    State_machine_file_header header;
+    struct stat st;
+    void *base;
+    int saved_errno;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+    {
+        return STATE_MACHINE_SYSTEM_ERROR;
+    }
+    if (fstat(fd, &st) != 0)
+    {
+        saved_errno = errno;
+        (void)close(fd);
+        errno = saved_errno;
+
+        return STATE_MACHINE_SYSTEM_ERROR;
+    }
+    if ((uint64_t)st.st_size < sizeof(State_machine_file_header)
+        || (uint64_t)st.st_size > SIZE_MAX)
+    {
+        (void)close(fd);
+
+        return STATE_MACHINE_INVALID;
+    }
+
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    saved_errno = errno;
+
+    /* Mapping stays valid after file descriptor is closed. */
+    (void)close(fd);
+    if (base == MAP_FAILED)
+    {
+        errno = saved_errno;
+
+        return STATE_MACHINE_SYSTEM_ERROR;
+    }
+
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, STATE_MACHINE_FILE_MAGIC,
+            sizeof(STATE_MACHINE_FILE_MAGIC)) != 0
+        || header.version != STATE_MACHINE_FILE_VERSION
+        || header.byte_order != STATE_MACHINE_FILE_BYTE_ORDER
+        || header.max_state == 0
+        || header.max_state > STATE_MACHINE_COMPACT_MAX_STATE
+        || header.max_event == 0
+        || header.callback_count > STATE_MACHINE_COMPACT_MAX_CALLBACKS
+        || header.table_offset < sizeof(header)
+        || header.table_offset % sizeof(State_machine_compact_transition) != 0
+        || header.table_offset > (uint64_t)st.st_size
+        || ((uint64_t)st.st_size - header.table_offset)
+            / sizeof(State_machine_compact_transition)
+            < (uint64_t)header.max_state * header.max_event)
+    {
+        (void)munmap(base, (size_t)st.st_size);
+
+        return STATE_MACHINE_INVALID;
+    }
+
+    mapped->base = base;
+    mapped->length = (size_t)st.st_size;
+    mapped->max_state = header.max_state;
+    mapped->max_event = header.max_event;
+    mapped->callback_count = header.callback_count;
+    mapped->table = (const State_machine_compact_transition *)
+        ((const char *)base + header.table_offset);
+
+    return STATE_MACHINE_SUCCESS;
+#else
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
+
+void state_machine_unmap_table(State_machine_mapped_table *const mapped)
+{
+    ASSERT_NOT_NULL(mapped);
+
+#ifdef _POSIX_MAPPED_FILES
+    if (mapped->base != NULL)
+    {
+        (void)munmap(mapped->base, mapped->length);
+    }
+#endif
+    memset(mapped, 0, sizeof(State_machine_mapped_table));
+}
+
+uint32_t state_machine_init_mapped_table(State_machine *const sm,
+    const State_machine_mapped_table *const mapped,
+    const uint32_t init_state,
+    State_machine_locking locking,
+    const State_machine_compact_callback *const callbacks,
+    const uint32_t callback_count,
+    void *const data)
+{
+    ASSERT_NOT_NULL(mapped);
+
+    if (mapped->callback_count > callback_count
+        || init_state >= mapped->max_state)
+    {
+        return STATE_MACHINE_INVALID;
+    }
+
+    state_machine_init_compact_table(sm, mapped->max_state, mapped->max_event,
+        init_state, locking, mapped->table, callbacks, data);
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+/* 64 bit FNV-1a.
+ */
+#define FNV_OFFSET_BASIS    UINT64_C(0xcbf29ce484222325)
+#define FNV_PRIME           UINT64_C(0x100000001b3)
+
+static INLINE uint64_t hash_uint32(uint64_t hash, uint32_t value)
+{
+    for (size_t i = 0; i < sizeof(value); i++)
+    {
+        hash = (hash ^ (value & 0xff)) * FNV_PRIME;
+        value >>= 8;
+    }
+
+    return hash;
+}
+
+uint64_t state_machine_fleet_table_hash(State_machine_fleet *const fleet)
+{
+    ASSERT_NOT_NULL(fleet);
+
+    const State_machine_implementation *const impl = &FLEET_TRANSITION(fleet);
+    const uint32_t max_event = FLEET_MAX_EVENT(fleet);
+    const size_t cells = (size_t)FLEET_MAX_STATE(fleet) * max_event;
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    if (IMPL_USING_ANY_FUNCTION(impl))
+    {
+        return 0;
+    }
+
+    hash = hash_uint32(hash, IMPL_TYPE(impl));
+    hash = hash_uint32(hash, FLEET_MAX_STATE(fleet));
+    hash = hash_uint32(hash, max_event);
+    for (size_t i = 0; i < cells; i++)
+    {
+        if (IMPL_TYPE(impl) == STATE_MACHINE_USING_COMPACT_TABLE)
+        {
+            hash = hash_uint32(hash, IMPL(impl, compact).table[i]);
+        }
+        else
+        {
+            State_machine_transition buffer;
+            State_machine_transition *t;
+
+            (void)implementation_lookup(impl, max_event,
+                (uint32_t)(i / max_event), (uint32_t)(i % max_event), NULL,
+                &buffer, &t);
+            hash = hash_uint32(hash, IS_TRANSITION(t)
+                ? RESULT_TRANSITION(t).next_state : UINT32_MAX);
+        }
+    }
+
+    /* Zero means that there is no hash. */
+    return hash == 0 ? 1 : hash;
+}
+
+uint32_t state_machine_fleet_checkpoint(State_machine_fleet *const fleet,
+    const int fd,
+    const uint64_t table_hash)
+{
+    ASSERT_NOT_NULL(fleet);
+
+#ifdef _POSIX_VERSION
+    State_machine_checkpoint_header header;
+    struct iovec iov[2];
+    int count = 2;
+
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, STATE_MACHINE_CHECKPOINT_MAGIC);
+    header.version = STATE_MACHINE_CHECKPOINT_VERSION;
+    header.byte_order = STATE_MACHINE_FILE_BYTE_ORDER;
+    header.size = FLEET_SIZE(fleet);
+    header.max_state = FLEET_MAX_STATE(fleet);
+    header.table_hash = table_hash;
+
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = fleet->current_state;
+    iov[1].iov_len = (size_t)FLEET_SIZE(fleet) * sizeof(uint32_t);
+
+    /* Normally everything is written at once, but pipes and sockets may
+     * accept only part of it.
+     */
+    while (count > 0)
+    {
+        ssize_t n = writev(fd, &iov[2 - count], count);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return STATE_MACHINE_SYSTEM_ERROR;
+        }
+
+        while (count > 0 && (size_t)n >= iov[2 - count].iov_len)
+        {
+            n -= (ssize_t)iov[2 - count].iov_len;
+            count--;
+        }
+        if (count > 0)
+        {
+            iov[2 - count].iov_base = (char *)iov[2 - count].iov_base + n;
+            iov[2 - count].iov_len -= (size_t)n;
+        }
+    }
+
+    return STATE_MACHINE_SUCCESS;
+#else
+    (void)fd;
+    (void)table_hash;
+
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
+
+#ifdef _POSIX_VERSION
+/* Reads in to all "count" buffers of "iov", which is modified. Returns number
+ * of bytes read, which is less then their total size only at the end of file,
+ * or -1 on failure.
+ */
+static ssize_t readv_all(const int fd, struct iovec *const iov, int count)
+{
+    const int total = count;
+    size_t done = 0;
+
+    /* Normally everything is read at once, but pipes and sockets may return
+     * only part of it.
+     */
+    while (count > 0)
+    {
+        ssize_t n = readv(fd, &iov[total - count], count);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return -1;
+        }
+        if (n == 0)
+        {
+            break;
+        }
+        done += (size_t)n;
+
+        while (count > 0 && (size_t)n >= iov[total - count].iov_len)
+        {
+            n -= (ssize_t)iov[total - count].iov_len;
+            count--;
+        }
+        if (count > 0)
+        {
+            iov[total - count].iov_base =
+                (char *)iov[total - count].iov_base + n;
+            iov[total - count].iov_len -= (size_t)n;
+        }
+    }
+
+    return (ssize_t)done;
+}
+#endif
+
+uint32_t state_machine_fleet_restore(State_machine_fleet *const fleet,
+    const int fd,
+    const uint64_t table_hash)
+{
+    ASSERT_NOT_NULL(fleet);
+
+#ifdef _POSIX_VERSION
+    const size_t size = (size_t)FLEET_SIZE(fleet) * sizeof(uint32_t);
+    const uint32_t max_state = FLEET_MAX_STATE(fleet);
+    State_machine_checkpoint_header header;
+    struct iovec iov[2];
+    ssize_t n;
+
+    /* Header and states are read together, the same way as they are written
+     * by state_machine_fleet_checkpoint().
+     */
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = fleet->current_state;
+    iov[1].iov_len = size;
+
+    if ((n = readv_all(fd, iov, 2)) < 0)
+    {
+        return STATE_MACHINE_SYSTEM_ERROR;
+    }
+    if ((size_t)n < sizeof(header)
+        || memcmp(header.magic, STATE_MACHINE_CHECKPOINT_MAGIC,
+            sizeof(STATE_MACHINE_CHECKPOINT_MAGIC)) != 0
+        || header.version != STATE_MACHINE_CHECKPOINT_VERSION
+        || header.byte_order != STATE_MACHINE_FILE_BYTE_ORDER
+        || header.size != FLEET_SIZE(fleet)
+        || header.max_state != max_state
+        || (table_hash != 0 && header.table_hash != 0
+            && header.table_hash != table_hash)
+        || (size_t)n != sizeof(header) + size)
+    {
+        return STATE_MACHINE_INVALID;
+    }
+
+    for (uint32_t i = 0; i < FLEET_SIZE(fleet); i++)
+    {
+        if (FLEET_CURRENT_STATE(fleet, i) >= max_state)
+        {
+            return STATE_MACHINE_INVALID;
+        }
+    }
+
+    return STATE_MACHINE_SUCCESS;
+#else
+    (void)fd;
+    (void)table_hash;
+
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
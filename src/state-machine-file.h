@@ -0,0 +1,302 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_FILE_H_051663188631589674657414759648135666824
+#define STATE_MACHINE_FILE_H_051663188631589674657414759648135666824
+
+#include "state-machine.h"
+#include "state-machine-fleet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Binary file format of compact transition tables. File can be mapped in to
+ * memory and state machine initialized directly on it, therefore all
+ * processes that use the same file share its pages and nothing has to be
+ * built at start up.
+ *
+ * File consists of a header followed by compact transition table, see
+ * <tt>State_machine_compact_transition</tt>. Callbacks are stored as indexes
+ * in to array of callbacks registered by application when state machine is
+ * initialized, and all other references are offsets from the beginning of
+ * the file. Values are stored in byte order of the machine that wrote the
+ * file.
+ */
+
+#define STATE_MACHINE_FILE_MAGIC        "SMTABLE"
+#define STATE_MACHINE_FILE_VERSION      1
+
+/* Value of <tt>byte_order</tt> as seen by machine with the same byte order
+ * as the one that wrote the file.
+ */
+#define STATE_MACHINE_FILE_BYTE_ORDER   UINT32_C(0x01020304)
+
+typedef struct
+{
+    /** <tt>STATE_MACHINE_FILE_MAGIC</tt> including terminating zero.
+     */
+    char magic[8];
+
+    /** <tt>STATE_MACHINE_FILE_VERSION</tt>.
+     */
+    uint32_t version;
+
+    /** <tt>STATE_MACHINE_FILE_BYTE_ORDER</tt>.
+     */
+    uint32_t byte_order;
+
+    uint32_t max_state;
+    uint32_t max_event;
+
+    /** Number of callbacks that application has to register, i.e. greatest
+     * callback index used by table plus one.
+     */
+    uint32_t callback_count;
+
+    /** Reserved for future use, it is zero.
+     */
+    uint32_t reserved;
+
+    /** Offset of transition table from the beginning of the file.
+     */
+    uint64_t table_offset;
+} State_machine_file_header;
+
+/** Transition table mapped in to memory.
+ */
+typedef struct
+{
+    /** Start and length of memory mapping.
+     */
+    void *base;
+    size_t length;
+
+    uint32_t max_state;
+    uint32_t max_event;
+    uint32_t callback_count;
+
+    /** Compact transition table, it points in to the mapping.
+     */
+    const State_machine_compact_transition *table;
+} State_machine_mapped_table;
+
+/** Write compact transition table in to a file.
+ *
+ * @param[in] path
+ *   File that is created or truncated.
+ *
+ * @param[in] table
+ *   Compact transition table, e.g. one created by
+ *   <tt>state_machine_compact_table()</tt>.
+ *
+ * @param[in] max_state
+ *   Upper bound on number of states.
+ *
+ * @param[in] max_event
+ *   Upper bound on number of events.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If writing
+ *   fails, then it returns <tt>STATE_MACHINE_SYSTEM_ERROR</tt> and errno
+ *   describes the problem. If memory mapped files aren't available, then it
+ *   returns <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_write_table(const char *const path,
+    const State_machine_compact_transition *const table,
+    const uint32_t max_state,
+    const uint32_t max_event);
+
+/** Map file with transition table in to memory.
+ *
+ * Only the header is checked, pages of transition table are read when they
+ * are first used. Therefore file has to come from a trusted source, next
+ * states stored in transition table aren't checked to be in bounds.
+ *
+ * @param[in] path
+ *   File written by <tt>state_machine_write_table()</tt>.
+ *
+ * @param[out] mapped
+ *   Description of the mapping.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If file
+ *   doesn't have expected format, version or byte order, then it returns
+ *   <tt>STATE_MACHINE_INVALID</tt>. If operating system call fails, then it
+ *   returns <tt>STATE_MACHINE_SYSTEM_ERROR</tt> and errno describes the
+ *   problem. If memory mapped files aren't available, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_map_table(const char *const path,
+    State_machine_mapped_table *const mapped);
+
+/** Release mapping created by <tt>state_machine_map_table()</tt>.
+ *
+ * No state machine may use it afterwards.
+ */
+void state_machine_unmap_table(State_machine_mapped_table *const mapped);
+
+/** Initialize state machine using mapped transition table.
+ *
+ * Same as <tt>state_machine_init_compact_table()</tt> with table from the
+ * mapping. Compact transition table of the mapping may be passed directly to
+ * <tt>state_machine_fleet_init_compact_table()</tt> as well.
+ *
+ * @param[in] mapped
+ *   Mapping that has to stay valid for as long as state machine is used.
+ *
+ * @param[in] callbacks
+ *   Array of callbacks registered by application. Entry with index zero
+ *   should be <tt>{NULL, NULL}</tt>.
+ *
+ * @param[in] callback_count
+ *   Number of entries in <tt>callbacks</tt>.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If table
+ *   refers to more callbacks then there are in <tt>callbacks</tt>, or if
+ *   <tt>init_state</tt> is out of bounds, then it returns
+ *   <tt>STATE_MACHINE_INVALID</tt>.
+ */
+uint32_t state_machine_init_mapped_table(State_machine *const state_machine,
+    const State_machine_mapped_table *const mapped,
+    const uint32_t init_state,
+    State_machine_locking locking,
+    const State_machine_compact_callback *const callbacks,
+    const uint32_t callback_count,
+    void *const data);
+
+/* Checkpoint of a fleet is a header followed by array of current states of
+ * all its instances. It is written using one system call and read back using
+ * one, to a file descriptor that may be a file, pipe or socket.
+ */
+
+#define STATE_MACHINE_CHECKPOINT_MAGIC      "SMCHKPT"
+#define STATE_MACHINE_CHECKPOINT_VERSION    1
+
+typedef struct
+{
+    /** <tt>STATE_MACHINE_CHECKPOINT_MAGIC</tt> including terminating zero.
+     */
+    char magic[8];
+
+    /** <tt>STATE_MACHINE_CHECKPOINT_VERSION</tt>.
+     */
+    uint32_t version;
+
+    /** <tt>STATE_MACHINE_FILE_BYTE_ORDER</tt>.
+     */
+    uint32_t byte_order;
+
+    /** Number of instances, i.e. number of states that follow the header.
+     */
+    uint32_t size;
+
+    uint32_t max_state;
+
+    /** Identity of transition table, see
+     * <tt>state_machine_fleet_table_hash()</tt>, or zero if it wasn't
+     * stored.
+     */
+    uint64_t table_hash;
+} State_machine_checkpoint_header;
+
+/** Compute identity of transition table of a fleet.
+ *
+ * Hash covers dimensions of the table and next states of all cells, for
+ * compact transition table also callback indexes. Callback pointers aren't
+ * included, since they differ between processes.
+ *
+ * @return
+ *   Non-zero hash, or zero for fleets that use transition function.
+ */
+uint64_t state_machine_fleet_table_hash(State_machine_fleet *const fleet);
+
+/** Write current states of all instances of a fleet.
+ *
+ * Fleet must not be changed while this function is running.
+ *
+ * @param[in] fleet
+ *   Initialized fleet.
+ *
+ * @param[in] fd
+ *   File descriptor opened for writing.
+ *
+ * @param[in] table_hash
+ *   Value stored in the checkpoint to be checked when it is restored, e.g.
+ *   <tt>state_machine_fleet_table_hash()</tt>, or zero.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If writing
+ *   fails, then it returns <tt>STATE_MACHINE_SYSTEM_ERROR</tt> and errno
+ *   describes the problem. If POSIX system calls aren't available, then it
+ *   returns <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_fleet_checkpoint(State_machine_fleet *const fleet,
+    const int fd,
+    const uint64_t table_hash);
+
+/** Restore current states of all instances of a fleet from a checkpoint.
+ *
+ * Fleet must not be used while this function is running. Private data of
+ * instances aren't changed.
+ *
+ * @param[in] fleet
+ *   Fleet of the same size and number of states as the one that was
+ *   checkpointed.
+ *
+ * @param[in] fd
+ *   File descriptor opened for reading.
+ *
+ * @param[in] table_hash
+ *   If both this value and the one stored in the checkpoint are non-zero,
+ *   then they have to be equal.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If
+ *   checkpoint doesn't match the fleet, is truncated or contains states out
+ *   of bounds, then it returns <tt>STATE_MACHINE_INVALID</tt> and current
+ *   states of instances are unspecified, since header and states are read
+ *   using a single system call. If reading
+ *   fails, then it returns <tt>STATE_MACHINE_SYSTEM_ERROR</tt> and errno
+ *   describes the problem. If POSIX system calls aren't available, then it
+ *   returns <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_fleet_restore(State_machine_fleet *const fleet,
+    const int fd,
+    const uint64_t table_hash);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_FILE_H_051663188631589674657414759648135666824 */
@@ -0,0 +1,398 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-fleet.h"
+#include "state-machine-private.h"
+
+/* Vectorized implementations are available only for x86 and compilers that
+ * are able to compile functions for instruction set extensions that weren't
+ * enabled on command line.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))   \
+    && !defined(STATE_MACHINE_NO_SIMD)
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+typedef struct
+{
+    uint32_t max_state;
+    uint32_t max_event;
+    uint32_t *states;
+    const State_machine_compact_transition *table;
+    const State_machine_compact_callback *callbacks;
+    const uint32_t *instances;
+    const uint32_t *events;
+    State_machine_fleet_pending *pending;
+    size_t max_pending;
+    size_t pending_count;
+    State_machine_trace *trace;
+
+    /* Set when entry with index zero of callbacks isn't {NULL, NULL}, which
+     * state_machine_compact_table() never produces.
+     */
+    bool zero_callback;
+} Step_context;
+
+/* Record callback for event with index "i" if there is one. Returns false
+ * when "pending" is full.
+ */
+static INLINE bool step_record(Step_context *const ctx, const size_t i,
+    const State_machine_compact_transition compact, const uint32_t state)
+{
+    const State_machine_compact_callback *const callback =
+        &ctx->callbacks[COMPACT_CALLBACK(compact)];
+    const bool is_transition = COMPACT_IS_TRANSITION(compact);
+    State_machine_fleet_pending *p;
+
+    if (is_transition
+        ? callback->on_enter == NULL
+        : callback->on_undefined_transition == NULL)
+    {
+        return true;
+    }
+
+    if (ctx->pending_count >= ctx->max_pending)
+    {
+        return false;
+    }
+
+    p = &ctx->pending[ctx->pending_count++];
+    p->index = i;
+    p->instance = ctx->instances[i];
+    p->cause = ctx->events[i];
+    p->callback = COMPACT_CALLBACK(compact);
+    p->is_transition = is_transition;
+    if (is_transition)
+    {
+        p->current_state = COMPACT_NEXT_STATE(compact);
+        p->previous_state = state;
+    }
+    else
+    {
+        p->current_state = state;
+        p->previous_state = ctx->max_state;
+    }
+
+    return true;
+}
+
+/* Process events from "begin" until "end" or until "pending" is full. Returns
+ * index of first event that wasn't processed.
+ */
+static size_t step_scalar(Step_context *const ctx, size_t begin,
+    const size_t end)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        const uint32_t instance = ctx->instances[i];
+        const uint32_t event = ctx->events[i];
+        const uint32_t state = ctx->states[instance];
+
+        assert(event < ctx->max_event);
+        assert(state < ctx->max_state);
+
+        const State_machine_compact_transition compact =
+            ctx->table[(size_t)state * ctx->max_event + event];
+
+        if (!step_record(ctx, i, compact, state))
+        {
+            return i;
+        }
+#ifndef __STDC_NO_ATOMICS__
+        trace_write(ctx->trace, instance, state, event,
+            COMPACT_IS_TRANSITION(compact), COMPACT_NEXT_STATE(compact));
+#endif
+        if (COMPACT_IS_TRANSITION(compact))
+        {
+            ctx->states[instance] = COMPACT_NEXT_STATE(compact);
+        }
+    }
+
+    return end;
+}
+
+#ifdef HAVE_X86_SIMD
+/* Lanes of a vector are processed one after another when recording callbacks
+ * and, in case of AVX2, storing states. Entries with callback index zero are
+ * usually skipped without looking at callbacks at all.
+ */
+static INLINE void step_lanes(Step_context *const ctx, const size_t i,
+    const size_t lanes, const uint32_t *const state,
+    const uint32_t *const compact, const bool store)
+{
+    for (size_t l = 0; l < lanes; l++)
+    {
+        if (store && COMPACT_IS_TRANSITION(compact[l]))
+        {
+            ctx->states[ctx->instances[i + l]] = COMPACT_NEXT_STATE(compact[l]);
+        }
+        if (COMPACT_CALLBACK(compact[l]) != 0 || ctx->zero_callback)
+        {
+            /* Caller made sure that there is enough space.
+             */
+            (void)step_record(ctx, i + l, compact[l], state[l]);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static size_t step_avx2(Step_context *const ctx, size_t i, const size_t end)
+{
+    const __m256i max_event = _mm256_set1_epi32((int)ctx->max_event);
+    const __m256i rotate[4] =
+    {
+        _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0),
+        _mm256_setr_epi32(2, 3, 4, 5, 6, 7, 0, 1),
+        _mm256_setr_epi32(3, 4, 5, 6, 7, 0, 1, 2),
+        _mm256_setr_epi32(4, 5, 6, 7, 0, 1, 2, 3)
+    };
+    uint32_t state[8];
+    uint32_t compact[8];
+
+    while (i + 8 <= end && ctx->max_pending - ctx->pending_count >= 8)
+    {
+        const __m256i instance =
+            _mm256_loadu_si256((const __m256i *)&ctx->instances[i]);
+        __m256i conflict = _mm256_setzero_si256();
+
+        /* Same instance may occur more then once among lanes, in which case
+         * later lane has to see state computed by the former one. Comparing
+         * with rotations by one to four lanes covers all pairs.
+         */
+        for (int r = 0; r < 4; r++)
+        {
+            conflict = _mm256_or_si256(conflict, _mm256_cmpeq_epi32(instance,
+                _mm256_permutevar8x32_epi32(instance, rotate[r])));
+        }
+        if (!_mm256_testz_si256(conflict, conflict))
+        {
+            i = step_scalar(ctx, i, i + 8);
+            continue;
+        }
+
+        const __m256i event =
+            _mm256_loadu_si256((const __m256i *)&ctx->events[i]);
+        const __m256i s =
+            _mm256_i32gather_epi32((const int *)ctx->states, instance, 4);
+        const __m256i c = _mm256_i32gather_epi32((const int *)ctx->table,
+            _mm256_add_epi32(_mm256_mullo_epi32(s, max_event), event), 4);
+
+        _mm256_storeu_si256((__m256i *)state, s);
+        _mm256_storeu_si256((__m256i *)compact, c);
+
+        /* There is no scatter in AVX2, therefore states are stored while
+         * going through lanes.
+         */
+        step_lanes(ctx, i, 8, state, compact, true);
+        i += 8;
+    }
+
+    return i;
+}
+
+__attribute__((target("avx512f,avx512cd")))
+static size_t step_avx512(Step_context *const ctx, size_t i, const size_t end)
+{
+    const __m512i max_event = _mm512_set1_epi32((int)ctx->max_event);
+    const __m512i state_mask =
+        _mm512_set1_epi32((int)(STATE_MACHINE_COMPACT_MAX_STATE - 1));
+    const __m512i callback_mask = _mm512_set1_epi32((int)
+        ((STATE_MACHINE_COMPACT_MAX_CALLBACKS - 1)
+            << STATE_MACHINE_COMPACT_STATE_BITS));
+    const __m512i zero = _mm512_setzero_si512();
+    uint32_t state[16];
+    uint32_t compact[16];
+
+    while (i + 16 <= end && ctx->max_pending - ctx->pending_count >= 16)
+    {
+        const __m512i instance =
+            _mm512_loadu_si512((const void *)&ctx->instances[i]);
+
+        /* Same instance may occur more then once among lanes, in which case
+         * later lane has to see state computed by the former one.
+         */
+        if (_mm512_test_epi32_mask(_mm512_conflict_epi32(instance),
+            _mm512_conflict_epi32(instance)) != 0)
+        {
+            i = step_scalar(ctx, i, i + 16);
+            continue;
+        }
+
+        const __m512i event = _mm512_loadu_si512((const void *)&ctx->events[i]);
+        const __m512i s = _mm512_i32gather_epi32(instance,
+            (const void *)ctx->states, 4);
+        const __m512i c = _mm512_i32gather_epi32(
+            _mm512_add_epi32(_mm512_mullo_epi32(s, max_event), event),
+            (const void *)ctx->table, 4);
+
+        /* Most significant bit of compact transition is set when it is a
+         * valid transition, i.e. when it is negative.
+         */
+        const __mmask16 is_transition = _mm512_cmplt_epi32_mask(c, zero);
+
+        _mm512_mask_i32scatter_epi32((void *)ctx->states, is_transition,
+            instance, _mm512_and_si512(c, state_mask), 4);
+
+        if (_mm512_test_epi32_mask(c, callback_mask) != 0
+            || ctx->zero_callback)
+        {
+            _mm512_storeu_si512((void *)state, s);
+            _mm512_storeu_si512((void *)compact, c);
+            step_lanes(ctx, i, 16, state, compact, false);
+        }
+        i += 16;
+    }
+
+    return i;
+}
+#endif
+
+uint32_t state_machine_fleet_step(State_machine_fleet *const fleet,
+    const uint32_t *const instances,
+    const uint32_t *const events,
+    const size_t count,
+    State_machine_fleet_pending *const pending,
+    const size_t max_pending,
+    size_t *const pending_count,
+    size_t *const consumed)
+{
+    Step_context ctx;
+    size_t i = 0;
+
+    ASSERT_NOT_NULL(fleet);
+    ASSERT_NOT_NULL(pending_count);
+    assert(count == 0 || (instances != NULL && events != NULL));
+    assert(max_pending == 0 || pending != NULL);
+
+    *pending_count = 0;
+    if (consumed != NULL)
+    {
+        *consumed = 0;
+    }
+
+    if (FLEET_TRANSITION(fleet).type != STATE_MACHINE_USING_COMPACT_TABLE)
+    {
+        return STATE_MACHINE_NOT_SUPPORTED;
+    }
+
+#ifndef NDEBUG
+    for (size_t j = 0; j < count; j++)
+    {
+        assert(instances[j] < FLEET_SIZE(fleet));
+        assert(events[j] < FLEET_MAX_EVENT(fleet));
+    }
+#endif
+
+    ctx.max_state = FLEET_MAX_STATE(fleet);
+    ctx.max_event = FLEET_MAX_EVENT(fleet);
+    ctx.states = fleet->current_state;
+    ctx.table = FLEET_TRANSITION_IMPL(fleet, compact).table;
+    ctx.callbacks = FLEET_TRANSITION_IMPL(fleet, compact).callbacks;
+    ctx.instances = instances;
+    ctx.events = events;
+    ctx.pending = pending;
+    ctx.max_pending = max_pending;
+    ctx.pending_count = 0;
+    ctx.trace = FLEET_TRACE(fleet);
+    ctx.zero_callback = ctx.callbacks[0].on_enter != NULL
+        || ctx.callbacks[0].on_undefined_transition != NULL;
+
+#ifdef HAVE_X86_SIMD
+    /* Gather instructions use signed 32 bit indexes. Vectorized
+     * implementations don't write trace records.
+     */
+    if (ctx.trace == NULL
+        && (uint64_t)ctx.max_state * ctx.max_event <= INT32_MAX
+        && FLEET_SIZE(fleet) <= INT32_MAX)
+    {
+        if (__builtin_cpu_supports("avx512f")
+            && __builtin_cpu_supports("avx512cd"))
+        {
+            i = step_avx512(&ctx, i, count);
+        }
+        else if (__builtin_cpu_supports("avx2"))
+        {
+            i = step_avx2(&ctx, i, count);
+        }
+    }
+#endif
+
+    /* Remainder that doesn't fill whole vector, or everything if there is no
+     * vectorized implementation available.
+     */
+    i = step_scalar(&ctx, i, count);
+
+    *pending_count = ctx.pending_count;
+    if (consumed != NULL)
+    {
+        *consumed = i;
+    }
+
+    return i < count ? STATE_MACHINE_NO_SPACE : STATE_MACHINE_SUCCESS;
+}
+
+void state_machine_fleet_dispatch(State_machine_fleet *const fleet,
+    const State_machine_fleet_pending *const pending,
+    const size_t count,
+    void *const *const event_data)
+{
+    ASSERT_NOT_NULL(fleet);
+    assert(count == 0 || pending != NULL);
+    assert(FLEET_TRANSITION(fleet).type == STATE_MACHINE_USING_COMPACT_TABLE);
+
+    const State_machine_compact_callback *const callbacks =
+        FLEET_TRANSITION_IMPL(fleet, compact).callbacks;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const State_machine_fleet_pending *const p = &pending[i];
+        const State_machine_compact_callback *const callback =
+            &callbacks[p->callback];
+        void *const ed = event_data == NULL ? NULL : event_data[p->index];
+        void *const data = FLEET_DATA(fleet, p->instance);
+
+        if (p->is_transition)
+        {
+            if (callback->on_enter != NULL)
+            {
+                callback->on_enter(p->cause, p->current_state,
+                    p->previous_state, ed, data);
+            }
+        }
+        else if (callback->on_undefined_transition != NULL)
+        {
+            callback->on_undefined_transition(p->cause, p->current_state, ed,
+                data);
+        }
+    }
+}
@@ -0,0 +1,389 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-fleet.h"
+#include "state-machine-private.h"
+#include <string.h>     /* memset() */
+
+static INLINE void state_machine_fleet_init_common(
+    State_machine_fleet *const fleet,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    const uint32_t size,
+    State_machine_fleet_locking lock,
+    const uint32_t transition_type,
+    uint32_t *const states,
+    void **const data)
+{
+    ASSERT_NOT_NULL(fleet);
+    ASSERT_NOT_NULL(states);
+    assert(max_state > 0);
+    assert(max_event > 0);
+    assert(init_state < max_state);
+    ASSERT_LOCKING_DEFINITION_CONSISTENCY(lock);
+
+    memset(fleet, 0, sizeof(State_machine_fleet));
+    FLEET_MAX_STATE(fleet) = max_state;
+    FLEET_MAX_EVENT(fleet) = max_event;
+    FLEET_SIZE(fleet) = size;
+    FLEET_LOCK(fleet) = lock;
+    FLEET_TRANSITION(fleet).type = transition_type;
+    fleet->current_state = states;
+    fleet->data = data;
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        states[i] = init_state;
+    }
+}
+
+void state_machine_fleet_init_table(State_machine_fleet *const fleet,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    const uint32_t size,
+    State_machine_fleet_locking locking,
+    State_machine_transition *transition_table,
+    uint32_t *const states,
+    void **const data)
+{
+    ASSERT_NOT_NULL(transition_table);
+
+    state_machine_fleet_init_common(fleet, max_state, max_event, init_state,
+        size, locking, STATE_MACHINE_USING_TABLE, states, data);
+    FLEET_TRANSITION_IMPL(fleet, table) = transition_table;
+}
+
+void state_machine_fleet_init_compact_table(State_machine_fleet *const fleet,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    const uint32_t size,
+    State_machine_fleet_locking locking,
+    const State_machine_compact_transition *transition_table,
+    const State_machine_compact_callback *callbacks,
+    uint32_t *const states,
+    void **const data)
+{
+    ASSERT_NOT_NULL(transition_table);
+    ASSERT_NOT_NULL(callbacks);
+    assert(max_state <= STATE_MACHINE_COMPACT_MAX_STATE);
+
+    state_machine_fleet_init_common(fleet, max_state, max_event, init_state,
+        size, locking, STATE_MACHINE_USING_COMPACT_TABLE, states, data);
+    FLEET_TRANSITION_IMPL(fleet, compact).table = transition_table;
+    FLEET_TRANSITION_IMPL(fleet, compact).callbacks = callbacks;
+}
+
+void state_machine_fleet_init_output_function(
+    State_machine_fleet *const fleet,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    const uint32_t size,
+    State_machine_fleet_locking locking,
+    State_machine_transition_output_function transition,
+    uint32_t *const states,
+    void **const data)
+{
+    ASSERT_NOT_NULL(transition);
+
+    state_machine_fleet_init_common(fleet, max_state, max_event, init_state,
+        size, locking, STATE_MACHINE_USING_OUTPUT_FUNCTION, states, data);
+    FLEET_TRANSITION_IMPL(fleet, output_function).transition = transition;
+}
+
+void state_machine_fleet_init_function(State_machine_fleet *const fleet,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    const uint32_t size,
+    State_machine_fleet_locking locking,
+    State_machine_transition_function transition,
+    State_machine_transition_cleanup_function cleanup,
+    uint32_t *const states,
+    void **const data)
+{
+    /* Note: Function cleanup may be NULL if no cleanup is necessary.
+     */
+    ASSERT_NOT_NULL(transition);
+
+    state_machine_fleet_init_common(fleet, max_state, max_event, init_state,
+        size, locking, STATE_MACHINE_USING_FUNCTION, states, data);
+    FLEET_TRANSITION_IMPL(fleet, function).transition = transition;
+    FLEET_TRANSITION_IMPL(fleet, function).cleanup = cleanup;
+}
+
+uint32_t state_machine_fleet_set_lock_free(State_machine_fleet *const fleet)
+{
+    ASSERT_NOT_NULL(fleet);
+
+#ifndef __STDC_NO_ATOMICS__
+    if (!IMPL_USING_ANY_FUNCTION((&FLEET_TRANSITION(fleet))))
+    {
+        FLEET_OPTIONS(fleet) |= STATE_MACHINE_OPTION_LOCK_FREE;
+
+        return STATE_MACHINE_SUCCESS;
+    }
+#endif
+
+    return STATE_MACHINE_NOT_SUPPORTED;
+}
+
+/* Fleet counterparts of lock_take(), lock_give() and their shared variants
+ * from state-machine-private.h.
+ */
+static INLINE uint32_t fleet_lock_take(State_machine_fleet *const fleet,
+    const uint32_t instance, const uint32_t flags)
+{
+    ASSERT_LOCKING_DEFINITION_CONSISTENCY(FLEET_LOCK(fleet));
+
+    if (FLEET_USE_LOCKING(fleet))
+    {
+        if (flags & STATE_MACHINE_NONBLOCK)
+        {
+            if (!FLEET_LOCK(fleet).try_take(fleet, instance))
+            {
+                return STATE_MACHINE_WOULD_BLOCK;
+            }
+        }
+        else
+        {
+            FLEET_LOCK(fleet).take(fleet, instance);
+        }
+    }
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+static INLINE void fleet_lock_give(State_machine_fleet *const fleet,
+    const uint32_t instance)
+{
+    ASSERT_LOCKING_DEFINITION_CONSISTENCY(FLEET_LOCK(fleet));
+
+    if (FLEET_USE_LOCKING(fleet))
+    {
+        FLEET_LOCK(fleet).give(fleet, instance);
+    }
+}
+
+static INLINE uint32_t fleet_lock_take_shared(State_machine_fleet *const fleet,
+    const uint32_t instance, const uint32_t flags)
+{
+    ASSERT_SHARED_LOCKING_DEFINITION_CONSISTENCY(FLEET_LOCK(fleet));
+
+    if (!FLEET_USE_SHARED_LOCKING(fleet))
+    {
+        return fleet_lock_take(fleet, instance, flags);
+    }
+
+    if (flags & STATE_MACHINE_NONBLOCK)
+    {
+        if (!FLEET_LOCK(fleet).try_take_shared(fleet, instance))
+        {
+            return STATE_MACHINE_WOULD_BLOCK;
+        }
+    }
+    else
+    {
+        FLEET_LOCK(fleet).take_shared(fleet, instance);
+    }
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+static INLINE void fleet_lock_give_shared(State_machine_fleet *const fleet,
+    const uint32_t instance)
+{
+    ASSERT_SHARED_LOCKING_DEFINITION_CONSISTENCY(FLEET_LOCK(fleet));
+
+    if (!FLEET_USE_SHARED_LOCKING(fleet))
+    {
+        fleet_lock_give(fleet, instance);
+
+        return;
+    }
+
+    FLEET_LOCK(fleet).give_shared(fleet, instance);
+}
+
+uint32_t state_machine_fleet_reset(State_machine_fleet *const fleet,
+    const uint32_t instance,
+    const uint32_t state,
+    void *const data,
+    const uint32_t flags)
+{
+    uint32_t ret;
+
+    ASSERT_NOT_NULL(fleet);
+    assert(instance < FLEET_SIZE(fleet));
+    assert(state < FLEET_MAX_STATE(fleet));
+    assert(data == NULL || fleet->data != NULL);
+
+    if_sm_failure (ret = fleet_lock_take(fleet, instance, flags))
+    {
+        return ret;
+    }
+    if (fleet->data != NULL)
+    {
+        fleet->data[instance] = data;
+    }
+#ifndef __STDC_NO_ATOMICS__
+    if (FLEET_IS_LOCK_FREE(fleet))
+    {
+        atomic_store_explicit(
+            ATOMIC_STATE(&FLEET_CURRENT_STATE(fleet, instance)), state,
+            memory_order_release);
+    }
+    else
+#endif
+    {
+        FLEET_CURRENT_STATE(fleet, instance) = state;
+    }
+    fleet_lock_give(fleet, instance);
+
+    return ret;
+}
+
+uint32_t state_machine_fleet_current_state(State_machine_fleet *const fleet,
+    const uint32_t instance,
+    uint32_t *const state,
+    const uint32_t flags)
+{
+    uint32_t ret;
+
+    ASSERT_NOT_NULL(fleet);
+    ASSERT_NOT_NULL(state);
+    assert(instance < FLEET_SIZE(fleet));
+
+#ifndef __STDC_NO_ATOMICS__
+    if (FLEET_IS_LOCK_FREE(fleet))
+    {
+        *state = atomic_load_explicit(
+            ATOMIC_STATE(&FLEET_CURRENT_STATE(fleet, instance)),
+            memory_order_acquire);
+
+        return STATE_MACHINE_SUCCESS;
+    }
+#endif
+
+    if_sm_failure (ret = fleet_lock_take_shared(fleet, instance, flags))
+    {
+        return ret;
+    }
+    *state = FLEET_CURRENT_STATE(fleet, instance);
+    fleet_lock_give_shared(fleet, instance);
+
+    return ret;
+}
+
+uint32_t state_machine_fleet_event(State_machine_fleet *const fleet,
+    const uint32_t instance,
+    const uint32_t event,
+    void *const event_data,
+    const uint32_t flags)
+{
+    State_machine_transition buffer;
+    State_machine_transition *transition;
+    uint32_t ret = STATE_MACHINE_SUCCESS;
+
+    ASSERT_NOT_NULL(fleet);
+    assert(instance < FLEET_SIZE(fleet));
+    assert(event < FLEET_MAX_EVENT(fleet));
+
+    const uint32_t max_state = FLEET_MAX_STATE(fleet);
+    const uint32_t max_event = FLEET_MAX_EVENT(fleet);
+
+#ifndef __STDC_NO_ATOMICS__
+    if (FLEET_IS_LOCK_FREE(fleet))
+    {
+        uint32_t current_state;
+        uint32_t previous_state;
+        void *data = FLEET_DATA(fleet, instance);
+
+        implementation_lock_free(&FLEET_TRANSITION(fleet), max_state,
+            max_event, ATOMIC_STATE(&FLEET_CURRENT_STATE(fleet, instance)),
+            event, data, &buffer, &transition, &current_state,
+            &previous_state);
+        TRACE_TRANSITION(FLEET_TRACE(fleet), instance, IS_TRANSITION(transition)
+            ? previous_state : current_state, event, transition);
+
+        return implementation_callbacks(&FLEET_TRANSITION(fleet), transition,
+            event, current_state, previous_state, event_data, data);
+    }
+#endif
+
+    /* {{{ Critical Section ************************************************ */
+
+    if_sm_failure (ret = fleet_lock_take(fleet, instance, flags))
+    {
+        return ret;
+    }
+
+    uint32_t current_state = FLEET_CURRENT_STATE(fleet, instance);
+    uint32_t previous_state = max_state;
+    void *data = FLEET_DATA(fleet, instance);
+
+    assert(current_state < max_state);
+
+    ret = implementation_lookup(&FLEET_TRANSITION(fleet), max_event,
+        current_state, event, data, &buffer, &transition);
+
+    /* See state_machine_event() for why failure handling is delayed.
+     */
+    if (is_sm_success(ret))
+    {
+        TRACE_TRANSITION(FLEET_TRACE(fleet), instance, current_state, event,
+            transition);
+    }
+    if (is_sm_success(ret) && IS_TRANSITION(transition))
+    {
+        previous_state = current_state;
+        current_state = RESULT_TRANSITION(transition).next_state;
+        FLEET_CURRENT_STATE(fleet, instance) = current_state;
+    }
+
+    assert(current_state < max_state);
+
+    fleet_lock_give(fleet, instance);
+
+    /* }}} Critical Section ************************************************ */
+
+    if_sm_failure (ret)
+    {
+        return ret;
+    }
+
+    return implementation_callbacks(&FLEET_TRANSITION(fleet), transition,
+        event, current_state, previous_state, event_data, data);
+}
@@ -0,0 +1,377 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_FLEET_H_161382617064119049092490303151544433262
+#define STATE_MACHINE_FLEET_H_161382617064119049092490303151544433262
+
+#include "state-machine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Fleet is a group of identical state machines that share transition table,
+ * or function, and locking primitives. Only current state, and optionally
+ * private data, is stored for each instance, which are addressed by their
+ * index within fleet.
+ */
+
+struct State_machine_fleet_s;   /* Forward declaration. */
+
+/** Interface for locking primitives of a fleet.
+ *
+ * Instance index is passed to every operation so that implementation can
+ * decide if it uses one lock for whole fleet, one lock per instance, or
+ * anything in between. Shared operations are optional and have the same
+ * meaning as in <tt>State_machine_locking</tt>.
+ */
+typedef struct
+{
+    bool (*try_take)(struct State_machine_fleet_s *, uint32_t instance);
+    void (*take)(struct State_machine_fleet_s *, uint32_t instance);
+    void (*give)(struct State_machine_fleet_s *, uint32_t instance);
+    bool (*try_take_shared)(struct State_machine_fleet_s *,
+        uint32_t instance);
+    void (*take_shared)(struct State_machine_fleet_s *, uint32_t instance);
+    void (*give_shared)(struct State_machine_fleet_s *, uint32_t instance);
+} State_machine_fleet_locking;
+
+/** Use this macro to statically initialize
+ * <tt>State_machine_fleet_locking</tt> when locking is not necessary.
+ */
+#define STATE_MACHINE_FLEET_NO_LOCKING  \
+    {.take = NULL, .try_take = NULL, .give = NULL, .take_shared = NULL, \
+        .try_take_shared = NULL, .give_shared = NULL}
+
+typedef struct State_machine_fleet_s
+{
+    /** Upper bound on number of states.
+     *
+     * State may be value between 0 (including) and <tt>max_state</tt>
+     * (excluding).
+     */
+    uint32_t max_state;
+
+    /** Upper bound on number of events.
+     *
+     * Event may be value between 0 (including) and <tt>max_event</tt>
+     * (excluding).
+     */
+    uint32_t max_event;
+
+    /** Number of state machine instances in this fleet.
+     */
+    uint32_t size;
+
+    /** Bit field of <tt>STATE_MACHINE_OPTION_*</tt> values.
+     */
+    uint32_t options;
+
+    /** Locking primitives.
+     */
+    State_machine_fleet_locking lock;
+
+    /** How state transitions are looked up, shared by all instances.
+     */
+    State_machine_implementation transition;
+
+    /** Array of <tt>size</tt> current states, one for each instance.
+     *
+     * When <tt>STATE_MACHINE_OPTION_LOCK_FREE</tt> is set, then its entries
+     * are accessed only using atomic operations.
+     */
+    uint32_t *current_state;
+
+    /** Array of <tt>size</tt> pointers to private implementation data, one
+     * for each instance. It may be NULL if instances don't have any.
+     */
+    void **data;
+
+    /** Ring buffer of recent steps, see <tt>state-machine-trace.h</tt>. It
+     * may be NULL.
+     */
+    struct State_machine_trace_s *trace;
+} State_machine_fleet;
+
+/** Initialize fleet of state machines using transition table.
+ *
+ * @param[in] max_state
+ *   Upper bound on number of states. It has to be greater then zero.
+ *
+ * @param[in] max_event
+ *   Upper bound on number of events. It has to be greater then zero.
+ *
+ * @param[in] init_state
+ *   Initial state of all instances. It may be between zero (including) and
+ *   max_state (excluding).
+ *
+ * @param[in] size
+ *   Number of state machine instances.
+ *
+ * @param[in] transition_table
+ *   Two dimensional array of at least <tt>max_state * max_event</tt> size.
+ *
+ * @param[in] states
+ *   Array of at least <tt>size</tt> entries which will hold current state of
+ *   each instance.
+ *
+ * @param[in] data
+ *   Array of at least <tt>size</tt> pointers to private data of each
+ *   instance. It may be NULL.
+ */
+void state_machine_fleet_init_table(State_machine_fleet *const fleet,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    const uint32_t size,
+    State_machine_fleet_locking locking,
+    State_machine_transition *transition_table,
+    uint32_t *const states,
+    void **const data);
+
+/** Initialize fleet of state machines using compact transition table.
+ *
+ * Arguments are the same as for <tt>state_machine_fleet_init_table()</tt>
+ * and <tt>state_machine_init_compact_table()</tt>.
+ */
+void state_machine_fleet_init_compact_table(State_machine_fleet *const fleet,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    const uint32_t size,
+    State_machine_fleet_locking locking,
+    const State_machine_compact_transition *transition_table,
+    const State_machine_compact_callback *callbacks,
+    uint32_t *const states,
+    void **const data);
+
+/** Initialize fleet of state machines using transition function that stores
+ * its result in to a buffer.
+ *
+ * Arguments are the same as for <tt>state_machine_fleet_init_table()</tt>
+ * and <tt>state_machine_init_output_function()</tt>.
+ */
+void state_machine_fleet_init_output_function(
+    State_machine_fleet *const fleet,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    const uint32_t size,
+    State_machine_fleet_locking locking,
+    State_machine_transition_output_function transition,
+    uint32_t *const states,
+    void **const data);
+
+/** Initialize fleet of state machines using transition function.
+ *
+ * Arguments are the same as for <tt>state_machine_fleet_init_table()</tt>
+ * and <tt>state_machine_init_function()</tt>. Transition function gets
+ * private data of the instance for which it is called.
+ */
+void state_machine_fleet_init_function(State_machine_fleet *const fleet,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    const uint32_t size,
+    State_machine_fleet_locking locking,
+    State_machine_transition_function transition,
+    State_machine_transition_cleanup_function cleanup,
+    uint32_t *const states,
+    void **const data);
+
+/** Switch fleet that uses transition table or compact transition table to
+ * lock-free operation.
+ *
+ * See <tt>state_machine_set_lock_free()</tt> for details.
+ */
+uint32_t state_machine_fleet_set_lock_free(State_machine_fleet *const fleet);
+
+/** Put instance in to specified state and change its private data.
+ *
+ * This is useful when instance is being reused, e.g. for a new connection.
+ * Callbacks aren't called.
+ *
+ * @param[in] flags
+ *   Same as for <tt>state_machine_fleet_event()</tt>.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If flags have
+ *   <tt>STATE_MACHINE_NONBLOCK</tt> bit set and function was unable to acquire
+ *   lock, then it returns <tt>STATE_MACHINE_WOULD_BLOCK</tt>.
+ */
+uint32_t state_machine_fleet_reset(State_machine_fleet *const fleet,
+    const uint32_t instance,
+    const uint32_t state,
+    void *const data,
+    const uint32_t flags);
+
+/** Get current state of an instance.
+ *
+ * Behaves as <tt>state_machine_current_state()</tt> would for state machine
+ * with index <tt>instance</tt>.
+ */
+uint32_t state_machine_fleet_current_state(State_machine_fleet *const fleet,
+    const uint32_t instance,
+    uint32_t *const state,
+    const uint32_t flags);
+
+/** Send <tt>event</tt> to an instance for it to handle.
+ *
+ * Behaves as <tt>state_machine_event()</tt> would for state machine with
+ * index <tt>instance</tt>.
+ */
+uint32_t state_machine_fleet_event(State_machine_fleet *const fleet,
+    const uint32_t instance,
+    const uint32_t event,
+    void *const event_data,
+    const uint32_t flags);
+
+/** Callback that <tt>state_machine_fleet_step()</tt> didn't invoke, but
+ * recorded for <tt>state_machine_fleet_dispatch()</tt> to invoke it later.
+ */
+typedef struct
+{
+    /** Index of event, in arrays passed to
+     * <tt>state_machine_fleet_step()</tt>, which caused this callback.
+     */
+    size_t index;
+
+    /** Instance that handled the event.
+     */
+    uint32_t instance;
+
+    /** Event that caused state transition.
+     */
+    uint32_t cause;
+
+    /** State in which instance was after event was handled.
+     */
+    uint32_t current_state;
+
+    /** State from which instance transitioned, or <tt>max_state</tt> in case
+     * of undefined transition.
+     */
+    uint32_t previous_state;
+
+    /** Index in to array of callbacks of compact transition table.
+     */
+    uint32_t callback;
+
+    /** Flag that indicates if there was transition, i.e. if
+     * <tt>on_enter</tt> or <tt>on_undefined_transition</tt> should be
+     * invoked.
+     */
+    bool is_transition;
+} State_machine_fleet_pending;
+
+/** Send events to multiple instances of a fleet that uses compact transition
+ * table.
+ *
+ * Events are processed in order, i.e. <tt>events[i]</tt> is handled by
+ * instance <tt>instances[i]</tt>, and the same instance may occur multiple
+ * times. Callbacks aren't invoked, instead they are recorded in
+ * <tt>pending</tt>, in order, and it is up to the caller to pass them to
+ * <tt>state_machine_fleet_dispatch()</tt>.
+ *
+ * Next states are computed in bulk using AVX-512 or AVX2 gather instructions
+ * if CPU supports them, otherwise scalar implementation is used.
+ *
+ * Locking primitives are not used, caller has to make sure that no other
+ * thread of execution accesses the same fleet while this function is running.
+ *
+ * @param[in] fleet
+ *   Fleet initialized using <tt>state_machine_fleet_init_compact_table()</tt>.
+ *
+ * @param[in] instances
+ *   Array of <tt>count</tt> instance indexes.
+ *
+ * @param[in] events
+ *   Array of <tt>count</tt> events.
+ *
+ * @param[in] count
+ *   Number of entries in <tt>instances</tt> and <tt>events</tt> arrays.
+ *
+ * @param[out] pending
+ *   Array of at least <tt>max_pending</tt> entries for callbacks that need to
+ *   be invoked. Only callbacks that aren't NULL are recorded.
+ *
+ * @param[in] max_pending
+ *   Size of <tt>pending</tt> array. Array of <tt>count</tt> entries is always
+ *   big enough.
+ *
+ * @param[out] pending_count
+ *   Number of entries stored in <tt>pending</tt>.
+ *
+ * @param[out] consumed
+ *   Number of events that were processed is stored here. It may be NULL.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If
+ *   <tt>pending</tt> is full and there are events left, then it returns
+ *   <tt>STATE_MACHINE_NO_SPACE</tt>. If fleet doesn't use compact transition
+ *   table, then it returns <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_fleet_step(State_machine_fleet *const fleet,
+    const uint32_t *const instances,
+    const uint32_t *const events,
+    const size_t count,
+    State_machine_fleet_pending *const pending,
+    const size_t max_pending,
+    size_t *const pending_count,
+    size_t *const consumed);
+
+/** Invoke callbacks recorded by <tt>state_machine_fleet_step()</tt>.
+ *
+ * @param[in] fleet
+ *   Fleet passed to <tt>state_machine_fleet_step()</tt>.
+ *
+ * @param[in] pending
+ *   Array of <tt>count</tt> callbacks, they are invoked in order.
+ *
+ * @param[in] count
+ *   Number of entries in <tt>pending</tt>.
+ *
+ * @param[in] event_data
+ *   Array of pointers that, if not NULL, is indexed by
+ *   <tt>State_machine_fleet_pending.index</tt> to get event data for
+ *   callback.
+ */
+void state_machine_fleet_dispatch(State_machine_fleet *const fleet,
+    const State_machine_fleet_pending *const pending,
+    const size_t count,
+    void *const *const event_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_FLEET_H_161382617064119049092490303151544433262 */
@@ -0,0 +1,358 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-private.h"
+#include "state-machine-hierarchy.h"
+
+#define NONE    STATE_MACHINE_HIERARCHY_NONE
+
+#define PARENT(states, s)   ((states)[s].parent)
+
+/* Trampolines that are stored in flattened transition table. State machine
+ * private data is the hierarchy.
+ */
+static void hierarchy_on_enter(uint32_t cause, uint32_t current_state,
+    uint32_t previous_state, void *event_data, void *data)
+{
+    const State_machine_hierarchy *const hierarchy = data;
+    const State_machine_hierarchy_action *action = &hierarchy->actions[
+        hierarchy->chains[(size_t)previous_state * hierarchy->max_event
+            + cause]];
+
+    (void)current_state;
+
+    for (; action->action != NULL; action++)
+    {
+        action->action(cause, action->state, previous_state, event_data,
+            hierarchy->data);
+    }
+}
+
+static void hierarchy_on_undefined_transition(uint32_t cause,
+    uint32_t current_state, void *event_data, void *data)
+{
+    const State_machine_hierarchy *const hierarchy = data;
+
+    hierarchy->on_undefined_transition(cause, current_state, event_data,
+        hierarchy->data);
+}
+
+/* Returns number of ancestors of "s", or NONE if they form a cycle.
+ */
+static uint32_t state_depth(const State_machine_hierarchy_state *const states,
+    const uint32_t max_state, uint32_t s)
+{
+    uint32_t depth = 0;
+
+    while (PARENT(states, s) != NONE)
+    {
+        if (++depth >= max_state)
+        {
+            return NONE;
+        }
+        s = PARENT(states, s);
+    }
+
+    return depth;
+}
+
+static INLINE bool is_ancestor_or_self(
+    const State_machine_hierarchy_state *const states,
+    const uint32_t ancestor, uint32_t s)
+{
+    for (; s != NONE; s = PARENT(states, s))
+    {
+        if (s == ancestor)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static INLINE uint32_t initial_leaf(
+    const State_machine_hierarchy_state *const states, uint32_t s)
+{
+    while (states[s].initial != NONE)
+    {
+        s = states[s].initial;
+    }
+
+    return s;
+}
+
+/* Nearest state that is proper ancestor of both "source" and "target", or
+ * NONE if they have no common ancestor.
+ */
+static uint32_t common_ancestor(
+    const State_machine_hierarchy_state *const states,
+    const uint32_t source, const uint32_t target)
+{
+    uint32_t s = PARENT(states, source);
+
+    while (s != NONE
+        && (s == target || !is_ancestor_or_self(states, s, target)))
+    {
+        s = PARENT(states, s);
+    }
+
+    return s;
+}
+
+static INLINE void chain_add(State_machine_hierarchy_action *const actions,
+    const size_t max_actions,
+    size_t *const count,
+    On_state_enter action,
+    const uint32_t state)
+{
+    if (actions != NULL && *count < max_actions)
+    {
+        actions[*count].action = action;
+        actions[*count].state = state;
+    }
+    (*count)++;
+}
+
+/* Appends actions of transition from "leaf" that is handled by "source" and
+ * leads to "target", terminated by NULL action. Returns false if there
+ * aren't any actions, in which case nothing is appended.
+ */
+static bool chain_build(const State_machine_hierarchy_state *const states,
+    const uint32_t leaf,
+    const uint32_t source,
+    const uint32_t target,
+    On_state_enter action,
+    State_machine_hierarchy_action *const actions,
+    const size_t max_actions,
+    size_t *const count)
+{
+    const uint32_t ancestor = common_ancestor(states, source, target);
+    const uint32_t target_leaf = initial_leaf(states, target);
+    const size_t start = *count;
+    uint32_t length = 0;
+
+    for (uint32_t s = leaf; s != ancestor; s = PARENT(states, s))
+    {
+        if (states[s].on_exit != NULL)
+        {
+            chain_add(actions, max_actions, count, states[s].on_exit, s);
+        }
+    }
+
+    if (action != NULL)
+    {
+        chain_add(actions, max_actions, count, action, target);
+    }
+
+    /* Entry actions are called from the outermost state, but states can be
+     * walked only towards their ancestors.
+     */
+    for (uint32_t s = target_leaf; s != ancestor; s = PARENT(states, s))
+    {
+        length++;
+    }
+    for (uint32_t i = length; i > 0; i--)
+    {
+        uint32_t s = target_leaf;
+
+        for (uint32_t j = 1; j < i; j++)
+        {
+            s = PARENT(states, s);
+        }
+        if (states[s].on_entry != NULL)
+        {
+            chain_add(actions, max_actions, count, states[s].on_entry, s);
+        }
+    }
+
+    if (*count == start)
+    {
+        return false;
+    }
+    chain_add(actions, max_actions, count, NULL, NONE);
+
+    return true;
+}
+
+uint32_t state_machine_flatten_hierarchy(
+    State_machine_hierarchy *const hierarchy,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const State_machine_hierarchy_state *const states,
+    const State_machine_hierarchy_transition *const transitions,
+    const size_t transition_count,
+    On_undefined_state_transition on_undefined_transition,
+    State_machine_transition *const table,
+    uint32_t *const chains,
+    State_machine_hierarchy_action *const actions,
+    const size_t max_actions,
+    size_t *const action_count)
+{
+    uint32_t max_depth = 0;
+    size_t count = 0;
+
+    ASSERT_NOT_NULL(hierarchy);
+    ASSERT_NOT_NULL(states);
+    assert(transition_count == 0 || transitions != NULL);
+    ASSERT_NOT_NULL(table);
+    ASSERT_NOT_NULL(chains);
+    ASSERT_NOT_NULL(action_count);
+    assert(max_state > 0 && max_state < NONE);
+    assert(max_event > 0);
+
+    for (uint32_t s = 0; s < max_state; s++)
+    {
+        const uint32_t parent = PARENT(states, s);
+        const uint32_t initial = states[s].initial;
+
+        if ((parent != NONE && parent >= max_state)
+            || (initial != NONE
+                && (initial >= max_state || PARENT(states, initial) != s)))
+        {
+            return STATE_MACHINE_INVALID;
+        }
+
+        const uint32_t depth = state_depth(states, max_state, s);
+
+        if (depth == NONE)
+        {
+            return STATE_MACHINE_INVALID;
+        }
+        max_depth = depth > max_depth ? depth : max_depth;
+    }
+
+    /* First every cell is filled with transition that its own state
+     * handles, without resolving target to a leaf state.
+     */
+    for (uint32_t s = 0; s < max_state; s++)
+    {
+        for (uint32_t e = 0; e < max_event; e++)
+        {
+            table[(size_t)s * max_event + e] = (State_machine_transition)
+                STATE_MACHINE_NO_TRANSITION(s, e, NULL);
+        }
+    }
+    for (size_t i = 0; i < transition_count; i++)
+    {
+        const State_machine_hierarchy_transition *const t = &transitions[i];
+
+        if (t->state >= max_state || t->event >= max_event
+            || t->next_state >= max_state
+            || table[(size_t)t->state * max_event + t->event].is_transition)
+        {
+            return STATE_MACHINE_INVALID;
+        }
+        table[(size_t)t->state * max_event + t->event] =
+            (State_machine_transition)STATE_MACHINE_TRANSITION(t->state,
+                t->event, t->next_state, t->action);
+    }
+
+    /* Then cells are resolved, deepest states first, so that cells of
+     * ancestors of a state still contain what was defined for them when it
+     * is being resolved.
+     */
+    for (uint32_t depth = max_depth + 1; depth-- > 0; )
+    {
+        for (uint32_t s = 0; s < max_state; s++)
+        {
+            if (state_depth(states, max_state, s) != depth)
+            {
+                continue;
+            }
+
+            for (uint32_t e = 0; e < max_event; e++)
+            {
+                const size_t cell = (size_t)s * max_event + e;
+                uint32_t source = s;
+
+                while (source != NONE
+                    && !table[(size_t)source * max_event + e].is_transition)
+                {
+                    source = PARENT(states, source);
+                }
+
+                if (source == NONE)
+                {
+                    table[cell] = (State_machine_transition)
+                        STATE_MACHINE_NO_TRANSITION(s, e,
+                            on_undefined_transition == NULL
+                                ? NULL : hierarchy_on_undefined_transition);
+                    continue;
+                }
+
+                const State_machine_transition *const defined =
+                    &table[(size_t)source * max_event + e];
+                const uint32_t target = RESULT_TRANSITION(defined).next_state;
+                const size_t start = count;
+                const bool has_actions = chain_build(states, s, source,
+                    target, RESULT_TRANSITION(defined).on_enter, actions,
+                    max_actions, &count);
+
+                chains[cell] = (uint32_t)start;
+                table[cell] = (State_machine_transition)
+                    STATE_MACHINE_TRANSITION(s, e,
+                        initial_leaf(states, target),
+                        has_actions ? hierarchy_on_enter : NULL);
+            }
+        }
+    }
+
+    hierarchy->max_state = max_state;
+    hierarchy->max_event = max_event;
+    hierarchy->states = states;
+    hierarchy->table = table;
+    hierarchy->chains = chains;
+    hierarchy->actions = actions;
+    hierarchy->on_undefined_transition = on_undefined_transition;
+    hierarchy->data = NULL;
+
+    *action_count = count;
+
+    return actions == NULL || count > max_actions
+        ? STATE_MACHINE_NO_SPACE : STATE_MACHINE_SUCCESS;
+}
+
+void state_machine_init_hierarchy(State_machine *const sm,
+    State_machine_hierarchy *const hierarchy,
+    const uint32_t init_state,
+    State_machine_locking locking,
+    void *const data)
+{
+    ASSERT_NOT_NULL(hierarchy);
+    assert(init_state < hierarchy->max_state);
+
+    hierarchy->data = data;
+    state_machine_init_table(sm, hierarchy->max_state, hierarchy->max_event,
+        initial_leaf(hierarchy->states, init_state), locking,
+        hierarchy->table, hierarchy);
+}
@@ -0,0 +1,242 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_HIERARCHY_H_52553472070682365703347518905173225297
+#define STATE_MACHINE_HIERARCHY_H_52553472070682365703347518905173225297
+
+#include "state-machine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Hierarchical state machines. States may be nested in to other states and
+ * events that aren't handled by a state are handled by its nearest ancestor
+ * that handles them. Hierarchy is flattened once in to ordinary transition
+ * table in which only the leaf states are ever reached, exit and entry
+ * actions of each cell are precomputed in to a list that is invoked by a
+ * single on-enter callback. Handling of an event therefore costs the same as
+ * with flat transition table.
+ */
+
+/** Value of <tt>parent</tt> or <tt>initial</tt> that means there is none.
+ */
+#define STATE_MACHINE_HIERARCHY_NONE    UINT32_MAX
+
+/** State of hierarchical state machine.
+ *
+ * Exit and entry actions are called with the state that is being exited or
+ * entered as their <tt>current_state</tt> and the leaf state in which event
+ * arrived as their <tt>previous_state</tt>.
+ */
+typedef struct
+{
+    /** Parent state, or <tt>STATE_MACHINE_HIERARCHY_NONE</tt> for top level
+     * state.
+     */
+    uint32_t parent;
+
+    /** Child state entered when this state is entered, or
+     * <tt>STATE_MACHINE_HIERARCHY_NONE</tt> for leaf state.
+     */
+    uint32_t initial;
+
+    /** Entry action, it may be NULL.
+     */
+    On_state_enter on_entry;
+
+    /** Exit action, it may be NULL.
+     */
+    On_state_enter on_exit;
+} State_machine_hierarchy_state;
+
+/** Transition of hierarchical state machine.
+ *
+ * Transition exits all states from the current leaf state up to, but not
+ * including, the nearest common proper ancestor of <tt>state</tt> and
+ * <tt>next_state</tt>, then calls <tt>action</tt> and then enters states
+ * down to <tt>next_state</tt> and further through their initial states down
+ * to a leaf state. Transition of a state to itself therefore exits and
+ * re-enters it.
+ */
+typedef struct
+{
+    /** State that handles <tt>event</tt>, including all its descendants that
+     * don't handle it themselves.
+     */
+    uint32_t state;
+
+    uint32_t event;
+
+    uint32_t next_state;
+
+    /** Called with <tt>next_state</tt> as its <tt>current_state</tt> after
+     * exit actions and before entry actions. It may be NULL.
+     */
+    On_state_enter action;
+} State_machine_hierarchy_transition;
+
+/** One exit, transition or entry action of a precomputed list.
+ */
+typedef struct
+{
+    /** Action or NULL that terminates the list.
+     */
+    On_state_enter action;
+
+    /** State that is passed to <tt>action</tt> as its
+     * <tt>current_state</tt>.
+     */
+    uint32_t state;
+} State_machine_hierarchy_action;
+
+typedef struct
+{
+    uint32_t max_state;
+    uint32_t max_event;
+
+    const State_machine_hierarchy_state *states;
+
+    /** Flattened transition table of <tt>max_state * max_event</tt> cells.
+     */
+    State_machine_transition *table;
+
+    /** Index of the first action of each cell of <tt>table</tt> that has
+     * any actions.
+     */
+    uint32_t *chains;
+
+    State_machine_hierarchy_action *actions;
+
+    /** Callback of undefined transitions, it may be NULL.
+     */
+    On_undefined_state_transition on_undefined_transition;
+
+    /** Private data passed to actions.
+     */
+    void *data;
+} State_machine_hierarchy;
+
+/** Flatten hierarchical state machine in to transition table.
+ *
+ * Function may be called with <tt>actions</tt> set to NULL to find out how
+ * big it has to be.
+ *
+ * @param[out] hierarchy
+ *   Storage allocated by caller.
+ *
+ * @param[in] max_state
+ *   Number of all states, including the ones that have children. It has to
+ *   be greater then zero.
+ *
+ * @param[in] max_event
+ *   Upper bound on number of events. It has to be greater then zero.
+ *
+ * @param[in] states
+ *   Array of <tt>max_state</tt> states. It has to stay valid for as long as
+ *   <tt>hierarchy</tt> is used.
+ *
+ * @param[in] transitions
+ *   Array of <tt>transition_count</tt> transitions, each state may handle
+ *   each event at most once.
+ *
+ * @param[in] transition_count
+ *   Number of entries in <tt>transitions</tt>.
+ *
+ * @param[in] on_undefined_transition
+ *   Called for events that neither state nor any of its ancestors handle. It
+ *   may be NULL.
+ *
+ * @param[out] table
+ *   Array of at least <tt>max_state * max_event</tt> entries. It may be
+ *   converted in to compact transition table using
+ *   <tt>state_machine_compact_table()</tt>.
+ *
+ * @param[out] chains
+ *   Array of at least <tt>max_state * max_event</tt> entries.
+ *
+ * @param[out] actions
+ *   Array of at least <tt>max_actions</tt> entries.
+ *
+ * @param[in] max_actions
+ *   Size of <tt>actions</tt> array.
+ *
+ * @param[out] action_count
+ *   Number of entries of <tt>actions</tt> that are needed is stored here.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If
+ *   <tt>actions</tt> is NULL or it is too small, then
+ *   <tt>STATE_MACHINE_NO_SPACE</tt> is returned. If states form a cycle,
+ *   initial state isn't a child of its state, or transitions are out of
+ *   bounds or duplicate, then <tt>STATE_MACHINE_INVALID</tt> is returned.
+ */
+uint32_t state_machine_flatten_hierarchy(
+    State_machine_hierarchy *const hierarchy,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const State_machine_hierarchy_state *const states,
+    const State_machine_hierarchy_transition *const transitions,
+    const size_t transition_count,
+    On_undefined_state_transition on_undefined_transition,
+    State_machine_transition *const table,
+    uint32_t *const chains,
+    State_machine_hierarchy_action *const actions,
+    const size_t max_actions,
+    size_t *const action_count);
+
+/** Initialize state machine using flattened hierarchy.
+ *
+ * Private data of state machine is the <tt>hierarchy</tt>, actions get
+ * <tt>data</tt> instead. Entry actions of initial state aren't called.
+ *
+ * @param[in] hierarchy
+ *   Successfully flattened using <tt>state_machine_flatten_hierarchy()</tt>.
+ *
+ * @param[in] init_state
+ *   Initial state, if it isn't a leaf state, then its initial states are
+ *   followed down to one.
+ *
+ * @param[in] data
+ *   Private data passed to actions.
+ */
+void state_machine_init_hierarchy(State_machine *const state_machine,
+    State_machine_hierarchy *const hierarchy,
+    const uint32_t init_state,
+    State_machine_locking locking,
+    void *const data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_HIERARCHY_H_52553472070682365703347518905173225297 */
@@ -0,0 +1,192 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-private.h"
+#include "state-machine-layout.h"
+
+/* Entry "a" goes before entry "b" if it has more hits, or the same number of
+ * hits and lower index.
+ */
+static INLINE bool before(const uint64_t *const weight, const uint32_t a,
+    const uint32_t b)
+{
+    return weight[a] > weight[b] || (weight[a] == weight[b] && a < b);
+}
+
+static void sift_down(const uint64_t *const weight, uint32_t *const order,
+    size_t root, const size_t count)
+{
+    for (;;)
+    {
+        size_t child = 2 * root + 1;
+
+        if (child >= count)
+        {
+            return;
+        }
+        if (child + 1 < count
+            && before(weight, order[child], order[child + 1]))
+        {
+            child++;
+        }
+        if (!before(weight, order[root], order[child]))
+        {
+            return;
+        }
+
+        const uint32_t tmp = order[root];
+
+        order[root] = order[child];
+        order[child] = tmp;
+        root = child;
+    }
+}
+
+/* Heap sort of indexes, it needs no memory and ties are broken by index,
+ * therefore result doesn't depend on sorting algorithm.
+ */
+static void sort_order(const uint64_t *const weight, uint32_t *const order,
+    uint32_t *const map, const uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        order[i] = i;
+    }
+    for (size_t i = count / 2; i > 0; i--)
+    {
+        sift_down(weight, order, i - 1, count);
+    }
+    for (size_t end = count; end > 1; end--)
+    {
+        const uint32_t tmp = order[0];
+
+        order[0] = order[end - 1];
+        order[end - 1] = tmp;
+        sift_down(weight, order, 0, end - 1);
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        map[order[i]] = i;
+    }
+}
+
+void state_machine_profile_order(const uint64_t *const cell_hits,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    uint32_t *const state_map,
+    uint32_t *const state_order,
+    uint32_t *const event_map,
+    uint32_t *const event_order,
+    uint64_t *const scratch)
+{
+    ASSERT_NOT_NULL(cell_hits);
+    assert(max_state > 0);
+    assert(max_event > 0);
+    ASSERT_NOT_NULL(state_map);
+    ASSERT_NOT_NULL(state_order);
+    assert((event_map == NULL) == (event_order == NULL));
+    ASSERT_NOT_NULL(scratch);
+
+    for (uint32_t s = 0; s < max_state; s++)
+    {
+        const uint64_t *const row = &cell_hits[(size_t)s * max_event];
+
+        scratch[s] = 0;
+        for (uint32_t e = 0; e < max_event; e++)
+        {
+            scratch[s] += row[e];
+        }
+    }
+    sort_order(scratch, state_order, state_map, max_state);
+
+    if (event_map == NULL)
+    {
+        return;
+    }
+
+    for (uint32_t e = 0; e < max_event; e++)
+    {
+        scratch[e] = 0;
+    }
+    for (uint32_t s = 0; s < max_state; s++)
+    {
+        const uint64_t *const row = &cell_hits[(size_t)s * max_event];
+
+        for (uint32_t e = 0; e < max_event; e++)
+        {
+            scratch[e] += row[e];
+        }
+    }
+    sort_order(scratch, event_order, event_map, max_event);
+}
+
+void state_machine_renumber_table(
+    const State_machine_transition *const transition_table,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t *const state_map,
+    const uint32_t *const event_map,
+    State_machine_transition *const output)
+{
+    ASSERT_NOT_NULL(transition_table);
+    assert(max_state > 0);
+    assert(max_event > 0);
+    ASSERT_NOT_NULL(state_map);
+    ASSERT_NOT_NULL(output);
+
+    for (uint32_t s = 0; s < max_state; s++)
+    {
+        const size_t row = (size_t)state_map[s] * max_event;
+
+        assert(state_map[s] < max_state);
+
+        for (uint32_t e = 0; e < max_event; e++)
+        {
+            const State_machine_transition *const t =
+                &transition_table[(size_t)s * max_event + e];
+            const uint32_t event = event_map == NULL ? e : event_map[e];
+            State_machine_transition *const o = &output[row + event];
+
+            assert(event < max_event);
+
+            *o = *t;
+            o->current_state = state_map[s];
+            o->cause = event;
+            if (IS_TRANSITION(t))
+            {
+                assert(RESULT_TRANSITION(t).next_state < max_state);
+                RESULT_TRANSITION(o).next_state =
+                    state_map[RESULT_TRANSITION(t).next_state];
+            }
+        }
+    }
+}
@@ -0,0 +1,137 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_LAYOUT_H_326838546321316286806671382987214688529
+#define STATE_MACHINE_LAYOUT_H_326838546321316286806671382987214688529
+
+#include "state-machine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Profile-guided layout of transition tables. Per-cell hit counts, e.g.
+ * collected by an instrumented build, see state-machine-statistics.h, are
+ * used to renumber states and events so that frequently used rows come
+ * first and frequently used cells of each row share the same cache lines.
+ * Application keeps its own numbering and translates states and events at
+ * the boundary using mapping arrays.
+ */
+
+/** Compute order of states and events by their number of hits.
+ *
+ * States are ordered by total number of hits of their rows and events by
+ * total number of hits of their columns, both from the most used one. Ties
+ * keep original order.
+ *
+ * @param[in] cell_hits
+ *   Array of <tt>max_state * max_event</tt> counters indexed by
+ *   <tt>state * max_event + event</tt>, e.g.
+ *   <tt>State_machine_statistics.cell_hits</tt>.
+ *
+ * @param[in] max_state
+ *   Upper bound on number of states. It has to be greater then zero.
+ *
+ * @param[in] max_event
+ *   Upper bound on number of events. It has to be greater then zero.
+ *
+ * @param[out] state_map
+ *   Array of <tt>max_state</tt> entries, new number of state <tt>s</tt> is
+ *   stored in <tt>state_map[s]</tt>.
+ *
+ * @param[out] state_order
+ *   Array of <tt>max_state</tt> entries, inverse of <tt>state_map</tt>.
+ *
+ * @param[out] event_map
+ *   Array of <tt>max_event</tt> entries, new number of event <tt>e</tt> is
+ *   stored in <tt>event_map[e]</tt>. It may be NULL, together with
+ *   <tt>event_order</tt>, if events have to keep their numbering.
+ *
+ * @param[out] event_order
+ *   Array of <tt>max_event</tt> entries, inverse of <tt>event_map</tt>.
+ *
+ * @param[out] scratch
+ *   Array of at least <tt>max_state</tt> and at least <tt>max_event</tt>
+ *   entries used during computation.
+ */
+void state_machine_profile_order(const uint64_t *const cell_hits,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    uint32_t *const state_map,
+    uint32_t *const state_order,
+    uint32_t *const event_map,
+    uint32_t *const event_order,
+    uint64_t *const scratch);
+
+/** Renumber states and events of transition table.
+ *
+ * Entry for state <tt>s</tt> and event <tt>e</tt> is moved to row
+ * <tt>state_map[s]</tt> and column <tt>event_map[e]</tt>, and its
+ * <tt>current_state</tt>, <tt>cause</tt> and <tt>next_state</tt> are
+ * translated. Callbacks then get new numbers of states and events. Result
+ * may be converted in to compact transition table, and <tt>state_map</tt>
+ * can be passed as <tt>remap</tt> to <tt>state_machine_replace_table()</tt>
+ * to switch running state machine to it.
+ *
+ * @param[in] transition_table
+ *   Two dimensional array of at least <tt>max_state * max_event</tt> size.
+ *
+ * @param[in] max_state
+ *   Upper bound on number of states. It has to be greater then zero.
+ *
+ * @param[in] max_event
+ *   Upper bound on number of events. It has to be greater then zero.
+ *
+ * @param[in] state_map
+ *   Array of <tt>max_state</tt> entries that is a permutation of states.
+ *
+ * @param[in] event_map
+ *   Array of <tt>max_event</tt> entries that is a permutation of events. It
+ *   may be NULL if events keep their numbering.
+ *
+ * @param[out] output
+ *   Two dimensional array of at least <tt>max_state * max_event</tt> size.
+ *   It must not overlap with <tt>transition_table</tt>.
+ */
+void state_machine_renumber_table(
+    const State_machine_transition *const transition_table,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t *const state_map,
+    const uint32_t *const event_map,
+    State_machine_transition *const output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_LAYOUT_H_326838546321316286806671382987214688529 */
@@ -0,0 +1,275 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Needed for syscall() and sched_yield(). */
+#define _DEFAULT_SOURCE
+
+#include "state-machine-private.h"
+#include "state-machine-lock.h"
+
+#ifdef STATE_MACHINE_HAVE_PTHREAD
+#include <sched.h>
+#endif
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/* Number of times a lock is polled before waiting thread lets others run.
+ */
+#define SPIN_LIMIT                      128
+
+#define LOCKED(sm)                      ((State_machine_locked *)(sm))
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_RELAX()                     __builtin_ia32_pause()
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define CPU_RELAX()                     __asm__ __volatile__ ("yield")
+#else
+#define CPU_RELAX()
+#endif
+
+#ifndef __STDC_NO_ATOMICS__
+#define ATOMIC_WORD(w)                  ((_Atomic uint32_t *)&(w))
+
+static INLINE void yield(void)
+{
+#ifdef STATE_MACHINE_HAVE_PTHREAD
+    (void)sched_yield();
+#endif
+}
+
+/* Sleep while *word is equal to value, or return right away. Spurious wake
+ * ups are allowed.
+ */
+static INLINE void wait_on(uint32_t *const word, const uint32_t value)
+{
+#ifdef __linux__
+    (void)syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+#else
+    (void)word;
+    (void)value;
+    yield();
+#endif
+}
+
+static INLINE void wake_one(uint32_t *const word)
+{
+#ifdef __linux__
+    (void)syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+    (void)word;
+#endif
+}
+
+/* {{{ Ticket lock ********************************************************* */
+
+static bool ticket_try_take(State_machine *const sm)
+{
+    State_machine_lock *const lock = &LOCKED(sm)->lock;
+    uint32_t ticket = atomic_load_explicit(ATOMIC_WORD(lock->ticket.serving),
+        memory_order_relaxed);
+
+    /* Succeeds only if nobody holds the lock nor waits for it. */
+    return atomic_compare_exchange_strong_explicit(
+        ATOMIC_WORD(lock->ticket.next), &ticket, ticket + 1,
+        memory_order_acquire, memory_order_relaxed);
+}
+
+static void ticket_take(State_machine *const sm)
+{
+    State_machine_lock *const lock = &LOCKED(sm)->lock;
+    const uint32_t ticket = atomic_fetch_add_explicit(
+        ATOMIC_WORD(lock->ticket.next), 1, memory_order_relaxed);
+
+    for (uint32_t spin = 1; atomic_load_explicit(
+        ATOMIC_WORD(lock->ticket.serving), memory_order_acquire) != ticket;
+        spin++)
+    {
+        CPU_RELAX();
+        if (spin % SPIN_LIMIT == 0)
+        {
+            yield();
+        }
+    }
+}
+
+static void ticket_give(State_machine *const sm)
+{
+    State_machine_lock *const lock = &LOCKED(sm)->lock;
+
+    /* Only the holder writes it. */
+    atomic_store_explicit(ATOMIC_WORD(lock->ticket.serving),
+        atomic_load_explicit(ATOMIC_WORD(lock->ticket.serving),
+            memory_order_relaxed) + 1,
+        memory_order_release);
+}
+
+/* }}} Ticket lock ********************************************************* */
+
+/* {{{ Adaptive lock ******************************************************* */
+
+/* Lock word is 0 when unlocked, 1 when locked and 2 when locked and there
+ * might be threads sleeping on it. This is the mutex from "Futexes Are
+ * Tricky" by Ulrich Drepper.
+ */
+
+static bool adaptive_try_take(State_machine *const sm)
+{
+    uint32_t unlocked = 0;
+
+    return atomic_compare_exchange_strong_explicit(
+        ATOMIC_WORD(LOCKED(sm)->lock.adaptive), &unlocked, 1,
+        memory_order_acquire, memory_order_relaxed);
+}
+
+static void adaptive_take(State_machine *const sm)
+{
+    _Atomic uint32_t *const word = ATOMIC_WORD(LOCKED(sm)->lock.adaptive);
+    for (uint32_t spin = 0; spin < SPIN_LIMIT; spin++)
+    {
+        uint32_t c = 0;
+
+        if (atomic_compare_exchange_weak_explicit(word, &c, 1,
+            memory_order_acquire, memory_order_relaxed))
+        {
+            return;
+        }
+        CPU_RELAX();
+    }
+
+    /* Sleeping thread can't tell if there are others, therefore it always
+     * marks lock as contended.
+     */
+    while (atomic_exchange_explicit(word, 2, memory_order_acquire) != 0)
+    {
+        wait_on(&LOCKED(sm)->lock.adaptive, 2);
+    }
+}
+
+static void adaptive_give(State_machine *const sm)
+{
+    _Atomic uint32_t *const word = ATOMIC_WORD(LOCKED(sm)->lock.adaptive);
+
+    if (atomic_exchange_explicit(word, 0, memory_order_release) == 2)
+    {
+        wake_one(&LOCKED(sm)->lock.adaptive);
+    }
+}
+
+/* }}} Adaptive lock ******************************************************* */
+#endif
+
+/* {{{ Mutex lock ********************************************************** */
+
+#ifdef STATE_MACHINE_HAVE_PTHREAD
+static bool mutex_try_take(State_machine *const sm)
+{
+    return pthread_mutex_trylock(&LOCKED(sm)->lock.mutex) == 0;
+}
+
+static void mutex_take(State_machine *const sm)
+{
+    (void)pthread_mutex_lock(&LOCKED(sm)->lock.mutex);
+}
+
+static void mutex_give(State_machine *const sm)
+{
+    (void)pthread_mutex_unlock(&LOCKED(sm)->lock.mutex);
+}
+#endif
+
+/* }}} Mutex lock ********************************************************** */
+
+uint32_t state_machine_init_lock(State_machine_locked *const locked,
+    const uint32_t kind,
+    State_machine_locking *const locking)
+{
+    State_machine_locking no_locking = STATE_MACHINE_NO_LOCKING;
+
+    ASSERT_NOT_NULL(locked);
+    ASSERT_NOT_NULL(locking);
+
+    *locking = no_locking;
+    switch (kind)
+    {
+#ifndef __STDC_NO_ATOMICS__
+        case STATE_MACHINE_TICKET_LOCK:
+            locked->lock.ticket.next = 0;
+            locked->lock.ticket.serving = 0;
+            locking->try_take = ticket_try_take;
+            locking->take = ticket_take;
+            locking->give = ticket_give;
+            break;
+
+        case STATE_MACHINE_ADAPTIVE_LOCK:
+            locked->lock.adaptive = 0;
+            locking->try_take = adaptive_try_take;
+            locking->take = adaptive_take;
+            locking->give = adaptive_give;
+            break;
+#endif
+
+#ifdef STATE_MACHINE_HAVE_PTHREAD
+        case STATE_MACHINE_MUTEX_LOCK:
+            if (pthread_mutex_init(&locked->lock.mutex, NULL) != 0)
+            {
+                return STATE_MACHINE_NOT_SUPPORTED;
+            }
+            locking->try_take = mutex_try_take;
+            locking->take = mutex_take;
+            locking->give = mutex_give;
+            break;
+#endif
+
+        default:
+            return STATE_MACHINE_NOT_SUPPORTED;
+    }
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+void state_machine_destroy_lock(State_machine_locked *const locked,
+    const uint32_t kind)
+{
+    ASSERT_NOT_NULL(locked);
+
+#ifdef STATE_MACHINE_HAVE_PTHREAD
+    if (kind == STATE_MACHINE_MUTEX_LOCK)
+    {
+        (void)pthread_mutex_destroy(&locked->lock.mutex);
+    }
+#else
+    (void)kind;
+#endif
+}
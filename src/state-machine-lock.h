@@ -0,0 +1,160 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_LOCK_H_318152061914624792553728069798038538609
+#define STATE_MACHINE_LOCK_H_318152061914624792553728069798038538609
+
+#include "state-machine.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define STATE_MACHINE_HAVE_PTHREAD
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Locking primitives provided by this library, for those who don't need
+ * anything special. Critical section of state_machine_event() is only a few
+ * loads and a store, therefore locks that spin first usually do better than
+ * a mutex that puts thread to sleep right away:
+ *
+ * - Ticket lock spins, and yields processor after a while, until it is its
+ *   turn. It is fair, threads get the lock in order in which they asked for
+ *   it, but it suffers when there are more threads then processors.
+ *
+ * - Adaptive lock spins for a while and then sleeps, using futex on Linux.
+ *   It isn't fair, but it copes with any number of threads.
+ *
+ * - Mutex lock is an adapter of pthread mutex.
+ *
+ * Lock is stored next to state machine in State_machine_locked, since
+ * locking primitives get only pointer to state machine.
+ */
+
+/** Assumed size of cache line in bytes.
+ */
+#ifndef STATE_MACHINE_CACHE_LINE
+#define STATE_MACHINE_CACHE_LINE        64
+#endif
+
+/** Alignment specifier that works in both C11 and C++11, since
+ * <tt>_Alignas</tt> is a C keyword only.
+ */
+#ifdef __cplusplus
+#define STATE_MACHINE_ALIGNAS(alignment)        alignas(alignment)
+#else
+#define STATE_MACHINE_ALIGNAS(alignment)        _Alignas(alignment)
+#endif
+
+/* Kinds of locks, see state_machine_init_lock().
+ */
+#define STATE_MACHINE_TICKET_LOCK       0
+#define STATE_MACHINE_ADAPTIVE_LOCK     1
+#define STATE_MACHINE_MUTEX_LOCK        2
+
+/** Storage of a lock, which is used depends on kind of lock. It is accessed
+ * only by locking primitives.
+ */
+typedef union State_machine_lock_u
+{
+    struct
+    {
+        uint32_t next;
+        uint32_t serving;
+    } ticket;
+
+    uint32_t adaptive;
+
+#ifdef STATE_MACHINE_HAVE_PTHREAD
+    pthread_mutex_t mutex;
+#endif
+} State_machine_lock;
+
+/** State machine together with its lock.
+ *
+ * Lock is on its own cache line, so that threads that wait for it don't
+ * take cache line with <tt>current_state</tt> away from thread that holds
+ * it. When allocated dynamically, <tt>aligned_alloc()</tt> has to be used
+ * to get the same alignment.
+ */
+typedef struct State_machine_locked_s
+{
+    /** State machine, it has to be the first member.
+     */
+    State_machine state_machine;
+
+    /** Lock of state machine.
+     */
+    STATE_MACHINE_ALIGNAS(STATE_MACHINE_CACHE_LINE) State_machine_lock lock;
+} State_machine_locked;
+
+/** Initialize lock and get locking primitives that use it.
+ *
+ * @param[in] locked
+ *   Storage allocated by caller, its state machine is initialized
+ *   afterwards with <tt>locking</tt>, e.g. using
+ *   <tt>state_machine_init_table()</tt>.
+ *
+ * @param[in] kind
+ *   One of <tt>STATE_MACHINE_*_LOCK</tt> values.
+ *
+ * @param[out] locking
+ *   Locking primitives are stored here.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If lock of
+ *   this kind isn't available, e.g. compiler doesn't support C11 atomic
+ *   operations, then it returns <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_init_lock(State_machine_locked *const locked,
+    const uint32_t kind,
+    State_machine_locking *const locking);
+
+/** Release resources held by lock initialized using
+ * <tt>state_machine_init_lock()</tt>.
+ *
+ * @param[in] locked
+ *   State machine and lock that nothing uses any more.
+ *
+ * @param[in] kind
+ *   Kind of lock that was passed to <tt>state_machine_init_lock()</tt>.
+ */
+void state_machine_destroy_lock(State_machine_locked *const locked,
+    const uint32_t kind);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_LOCK_H_318152061914624792553728069798038538609 */
@@ -0,0 +1,232 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-private.h"
+#include "state-machine-numa.h"
+#include <string.h>     /* memcpy() */
+
+static INLINE bool is_replicable(const State_machine_implementation *const impl)
+{
+    return IMPL_TYPE(impl) == STATE_MACHINE_USING_TABLE
+        || IMPL_TYPE(impl) == STATE_MACHINE_USING_COMPACT_TABLE;
+}
+
+static INLINE const void *table_of(
+    const State_machine_implementation *const impl)
+{
+    if (IMPL_TYPE(impl) == STATE_MACHINE_USING_TABLE)
+    {
+        return IMPL(impl, table);
+    }
+
+    return IMPL(impl, compact).table;
+}
+
+uint32_t state_machine_replicate(State_machine_replicas *const replicas,
+    State_machine_implementation *const implementations,
+    const uint32_t nodes,
+    const State_machine_implementation *const original,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    State_machine_node_allocate allocate,
+    State_machine_node_release release,
+    void *const context)
+{
+    ASSERT_NOT_NULL(replicas);
+    ASSERT_NOT_NULL(implementations);
+    ASSERT_NOT_NULL(original);
+    ASSERT_NOT_NULL(allocate);
+    ASSERT_NOT_NULL(release);
+    assert(nodes > 0);
+
+    if (!is_replicable(original))
+    {
+        return STATE_MACHINE_NOT_SUPPORTED;
+    }
+
+    const size_t size = (size_t)max_state * max_event
+        * (IMPL_TYPE(original) == STATE_MACHINE_USING_TABLE
+            ? sizeof(State_machine_transition)
+            : sizeof(State_machine_compact_transition));
+
+    for (uint32_t node = 0; node < nodes; node++)
+    {
+        State_machine_implementation *const replica = implementations + node;
+        void *const copy = allocate(context, size, node);
+
+        if (copy == NULL)
+        {
+            while (node-- > 0)
+            {
+                release(context, (void *)table_of(implementations + node),
+                    size);
+            }
+
+            return STATE_MACHINE_NO_SPACE;
+        }
+        memcpy(copy, table_of(original), size);
+
+        *replica = *original;
+        if (IMPL_TYPE(original) == STATE_MACHINE_USING_TABLE)
+        {
+            IMPL(replica, table) = copy;
+        }
+        else
+        {
+            IMPL(replica, compact).table = copy;
+        }
+    }
+
+    replicas->implementations = implementations;
+    replicas->nodes = nodes;
+    replicas->max_state = max_state;
+    replicas->max_event = max_event;
+    replicas->size = size;
+    replicas->release = release;
+    replicas->context = context;
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+void state_machine_release_replicas(State_machine_replicas *const replicas)
+{
+    ASSERT_NOT_NULL(replicas);
+
+    for (uint32_t node = 0; node < replicas->nodes; node++)
+    {
+        replicas->release(replicas->context,
+            (void *)table_of(replicas->implementations + node),
+            replicas->size);
+    }
+    replicas->nodes = 0;
+}
+
+uint32_t state_machine_place(State_machine *const sm,
+    const State_machine_replicas *const replicas,
+    const uint32_t node)
+{
+    ASSERT_NOT_NULL(sm);
+    ASSERT_NOT_NULL(replicas);
+    assert(node < replicas->nodes);
+    assert(SM_MAX_STATE(sm) == replicas->max_state);
+    assert(SM_MAX_EVENT(sm) == replicas->max_event);
+
+    const State_machine_implementation *const replica =
+        replicas->implementations + node;
+
+    if (SM_TRANSITION_TYPE(sm) != IMPL_TYPE(replica))
+    {
+        return STATE_MACHINE_NOT_SUPPORTED;
+    }
+    SM_TRANSITION(sm) = *replica;
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+uint32_t state_machine_fleet_place(State_machine_fleet *const fleet,
+    const State_machine_replicas *const replicas,
+    const uint32_t node)
+{
+    ASSERT_NOT_NULL(fleet);
+    ASSERT_NOT_NULL(replicas);
+    assert(node < replicas->nodes);
+    assert(FLEET_MAX_STATE(fleet) == replicas->max_state);
+    assert(FLEET_MAX_EVENT(fleet) == replicas->max_event);
+
+    const State_machine_implementation *const replica =
+        replicas->implementations + node;
+
+    if (FLEET_TRANSITION(fleet).type != IMPL_TYPE(replica))
+    {
+        return STATE_MACHINE_NOT_SUPPORTED;
+    }
+    FLEET_TRANSITION(fleet) = *replica;
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+/* Range i owns pages that start between its first entry (including) and
+ * first entry of range i + 1 (excluding). First range also owns the page in
+ * which array starts and the last one the page in which it ends.
+ */
+static void bind_array(void *const array,
+    const size_t entry_size,
+    const uint32_t size,
+    const uint32_t *const first,
+    const uint32_t *const nodes,
+    const uint32_t count,
+    const size_t page_size,
+    State_machine_node_bind bind,
+    void *const context)
+{
+    const uintptr_t base = (uintptr_t)array;
+    const uintptr_t mask = (uintptr_t)page_size - 1;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const uint32_t end = i + 1 < count ? first[i + 1] : size;
+        const uintptr_t from = i == 0
+            ? base & ~mask : (base + first[i] * entry_size + mask) & ~mask;
+        const uintptr_t to = (base + end * entry_size + mask) & ~mask;
+
+        assert(first[i] <= end);
+
+        if (from < to)
+        {
+            bind(context, (void *)from, to - from, nodes[i]);
+        }
+    }
+}
+
+void state_machine_fleet_bind(const State_machine_fleet *const fleet,
+    const uint32_t *const first,
+    const uint32_t *const nodes,
+    const uint32_t count,
+    const size_t page_size,
+    State_machine_node_bind bind,
+    void *const context)
+{
+    ASSERT_NOT_NULL(fleet);
+    ASSERT_NOT_NULL(first);
+    ASSERT_NOT_NULL(nodes);
+    ASSERT_NOT_NULL(bind);
+    assert(count > 0 && first[0] == 0);
+    assert(page_size > 0 && (page_size & (page_size - 1)) == 0);
+
+    bind_array(fleet->current_state, sizeof(uint32_t), FLEET_SIZE(fleet),
+        first, nodes, count, page_size, bind, context);
+    if (fleet->data != NULL)
+    {
+        bind_array(fleet->data, sizeof(void *), FLEET_SIZE(fleet), first,
+            nodes, count, page_size, bind, context);
+    }
+}
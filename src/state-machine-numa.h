@@ -0,0 +1,250 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_NUMA_H_167310125130518446816836497083823713641
+#define STATE_MACHINE_NUMA_H_167310125130518446816836497083823713641
+
+#include "state-machine.h"
+#include "state-machine-fleet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Placement of transition tables and fleet state on NUMA nodes. Transition
+ * tables are only read, therefore each node may have its own copy, and
+ * state machine or fleet is placed on a node by switching it to the copy of
+ * that node. Current states of a fleet are written, they stay in one array
+ * and its pages are bound to nodes of shards that own them. Memory is
+ * allocated and bound by functions provided by application, e.g. on top of
+ * libnuma, this library doesn't make any system calls.
+ *
+ * Placement is done once, usually when state machine is assigned to a
+ * worker, not on every event, since finding out on which node the caller
+ * runs would cost more than remote access does.
+ */
+
+/** Function that allocates <tt>size</tt> bytes of memory on NUMA node
+ * <tt>node</tt>, e.g. using <tt>numa_alloc_onnode()</tt>. It returns NULL on
+ * failure.
+ */
+typedef void *(*State_machine_node_allocate)(void *context, size_t size,
+    uint32_t node);
+
+/** Function that frees memory allocated by
+ * <tt>State_machine_node_allocate</tt>.
+ */
+typedef void (*State_machine_node_release)(void *context, void *memory,
+    size_t size);
+
+/** Function that moves pages from <tt>address</tt> (including) to
+ * <tt>address + length</tt> (excluding) to NUMA node <tt>node</tt>, e.g.
+ * using <tt>mbind()</tt> or by touching them from a thread of execution
+ * that runs on that node. Both <tt>address</tt> and <tt>length</tt> are
+ * multiples of page size.
+ */
+typedef void (*State_machine_node_bind)(void *context, void *address,
+    size_t length, uint32_t node);
+
+/** Copies of transition table, one for each NUMA node.
+ */
+typedef struct State_machine_replicas_s
+{
+    /** Array of <tt>nodes</tt> implementations, entry <tt>i</tt> uses copy
+     * of table allocated on node <tt>i</tt>.
+     */
+    State_machine_implementation *implementations;
+
+    /** Number of NUMA nodes.
+     */
+    uint32_t nodes;
+
+    /** Upper bound on number of states of the table.
+     */
+    uint32_t max_state;
+
+    /** Upper bound on number of events of the table.
+     */
+    uint32_t max_event;
+
+    /** Size of each copy in bytes.
+     */
+    size_t size;
+
+    /** Releases copies, see <tt>state_machine_release_replicas()</tt>.
+     */
+    State_machine_node_release release;
+
+    /** Passed to <tt>release</tt>.
+     */
+    void *context;
+} State_machine_replicas;
+
+/** Copy transition table on to every NUMA node.
+ *
+ * @param[in] replicas
+ *   Storage allocated by caller.
+ *
+ * @param[in] implementations
+ *   Array of <tt>nodes</tt> entries allocated by caller. It has to stay
+ *   valid for as long as replicas are used.
+ *
+ * @param[in] nodes
+ *   Number of NUMA nodes, at least one.
+ *
+ * @param[in] original
+ *   Implementation that uses transition table or compact transition table,
+ *   e.g. <tt>transition</tt> of initialized state machine. Array of callbacks
+ *   of compact table isn't copied, it is small and shared by all copies.
+ *
+ * @param[in] max_state
+ *   Upper bound on number of states of the table.
+ *
+ * @param[in] max_event
+ *   Upper bound on number of events of the table.
+ *
+ * @param[in] allocate
+ *   Function that allocates memory on a node.
+ *
+ * @param[in] release
+ *   Function that frees memory allocated by <tt>allocate</tt>.
+ *
+ * @param[in] context
+ *   Passed to <tt>allocate</tt> and <tt>release</tt>.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If
+ *   allocation fails, then copies that were already made are freed and
+ *   <tt>STATE_MACHINE_NO_SPACE</tt> is returned. If implementation doesn't
+ *   use transition table or compact transition table, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_replicate(State_machine_replicas *const replicas,
+    State_machine_implementation *const implementations,
+    const uint32_t nodes,
+    const State_machine_implementation *const original,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    State_machine_node_allocate allocate,
+    State_machine_node_release release,
+    void *const context);
+
+/** Free copies made by <tt>state_machine_replicate()</tt>.
+ *
+ * Nothing may use them any more, i.e. state machines and fleets that were
+ * placed using them have to be switched to other transition table first.
+ */
+void state_machine_release_replicas(State_machine_replicas *const replicas);
+
+/** Switch state machine to copy of transition table on NUMA node
+ * <tt>node</tt>.
+ *
+ * This has to be done before state machine is shared with other threads of
+ * execution. State machine that is already in use can be moved using
+ * <tt>state_machine_replace_table()</tt> with table of the copy.
+ *
+ * @param[in] state_machine
+ *   State machine that uses the same kind of table as replicas and has the
+ *   same dimensions.
+ *
+ * @param[in] replicas
+ *   Copies made by <tt>state_machine_replicate()</tt>.
+ *
+ * @param[in] node
+ *   NUMA node smaller then number of nodes of replicas.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If state
+ *   machine uses other kind of table, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_place(State_machine *const state_machine,
+    const State_machine_replicas *const replicas,
+    const uint32_t node);
+
+/** Switch fleet to copy of transition table on NUMA node <tt>node</tt>.
+ *
+ * Behaves as <tt>state_machine_place()</tt> does. It is useful when fleet is
+ * split in to fleets that are each used by workers on one node.
+ */
+uint32_t state_machine_fleet_place(State_machine_fleet *const fleet,
+    const State_machine_replicas *const replicas,
+    const uint32_t node);
+
+/** Bind pages of fleet state to NUMA nodes of shards that own them.
+ *
+ * Fleet instances are divided in to <tt>count</tt> consecutive ranges,
+ * range <tt>i</tt> starts with instance <tt>first[i]</tt> and belongs to
+ * node <tt>nodes[i]</tt>. Array of current states, and array of data
+ * pointers if fleet has one, are divided at page boundaries and each page
+ * is bound to node of the range that owns the first entry that starts in
+ * it. When ranges are much bigger then a page, then most instances end up
+ * on the node of their shard.
+ *
+ * This has to be done before fleet is shared with other threads of
+ * execution.
+ *
+ * @param[in] fleet
+ *   Initialized fleet.
+ *
+ * @param[in] first
+ *   Array of <tt>count</tt> ascending instance indexes, the first one is
+ *   zero.
+ *
+ * @param[in] nodes
+ *   Array of <tt>count</tt> NUMA nodes.
+ *
+ * @param[in] count
+ *   Number of ranges, at least one.
+ *
+ * @param[in] page_size
+ *   Page size in bytes, a power of two.
+ *
+ * @param[in] bind
+ *   Function that moves pages to a node.
+ *
+ * @param[in] context
+ *   Passed to <tt>bind</tt>.
+ */
+void state_machine_fleet_bind(const State_machine_fleet *const fleet,
+    const uint32_t *const first,
+    const uint32_t *const nodes,
+    const uint32_t count,
+    const size_t page_size,
+    State_machine_node_bind bind,
+    void *const context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_NUMA_H_167310125130518446816836497083823713641 */
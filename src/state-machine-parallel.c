@@ -0,0 +1,467 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-private.h"
+#include "state-machine-parallel.h"
+#include <string.h>     /* memset() */
+
+#define DEAD    STATE_MACHINE_DEAD_STATE
+
+/* Runs from different states are merged once in this many bytes.
+ */
+#define MERGE_INTERVAL  64
+
+#define IS_BYTE_MACHINE(sm)     \
+    ((SM_USING_TRANSITION_TABLE(sm) || SM_USING_COMPACT_TABLE(sm)) \
+        && SM_MAX_EVENT(sm) >= 256)
+
+/* Next state after "byte" in "state", or DEAD. Argument "compact" is
+ * constant in each caller, see event_specialized().
+ */
+static INLINE uint32_t next_state(State_machine *const sm,
+    const uint32_t state, const uint8_t byte, const bool compact)
+{
+    const size_t cell = (size_t)state * SM_MAX_EVENT(sm) + byte;
+
+    if (state == DEAD)
+    {
+        return DEAD;
+    }
+    if (compact)
+    {
+        const State_machine_compact_transition c =
+            SM_TRANSITION_IMPL(sm, compact).table[cell];
+
+        return COMPACT_IS_TRANSITION(c) ? COMPACT_NEXT_STATE(c) : DEAD;
+    }
+    else
+    {
+        const State_machine_transition *const t =
+            &SM_TRANSITION_IMPL(sm, table)[cell];
+
+        return t->is_transition ? t->result.transition.next_state : DEAD;
+    }
+}
+
+/* Number of distinct runs is reduced by merging runs that are in the same
+ * state. Array "index" of max_state entries is used as a map from state to
+ * new run.
+ */
+static uint32_t merge_runs(const uint32_t max_state,
+    uint32_t *const runs,
+    const uint32_t run_count,
+    uint32_t *const owner,
+    uint32_t *const remap,
+    uint32_t *const index)
+{
+    uint32_t dead = DEAD;
+    uint32_t count = 0;
+
+    for (uint32_t s = 0; s < max_state; s++)
+    {
+        index[s] = DEAD;
+    }
+
+    for (uint32_t r = 0; r < run_count; r++)
+    {
+        const uint32_t state = runs[r];
+        uint32_t *const slot = state == DEAD ? &dead : &index[state];
+
+        /* New index is never greater then the old one, therefore runs can
+         * be moved in place.
+         */
+        if (*slot == DEAD)
+        {
+            *slot = count;
+            runs[count++] = state;
+        }
+        remap[r] = *slot;
+    }
+
+    for (uint32_t s = 0; s < max_state; s++)
+    {
+        owner[s] = remap[owner[s]];
+    }
+
+    return count;
+}
+
+static INLINE void chunk_map(State_machine *const sm,
+    const uint8_t *const input,
+    const size_t length,
+    uint32_t *const map,
+    uint32_t *const scratch,
+    const bool compact)
+{
+    const uint32_t max_state = SM_MAX_STATE(sm);
+    uint32_t *const runs = scratch;
+    uint32_t *const owner = &scratch[max_state];
+    uint32_t *const remap = &scratch[2 * (size_t)max_state];
+    uint32_t run_count = max_state;
+    size_t i = 0;
+
+    for (uint32_t s = 0; s < max_state; s++)
+    {
+        runs[s] = s;
+        owner[s] = s;
+    }
+
+    while (i < length && run_count > 1)
+    {
+        const size_t end = length - i < MERGE_INTERVAL
+            ? length : i + MERGE_INTERVAL;
+
+        for (; i < end; i++)
+        {
+            for (uint32_t r = 0; r < run_count; r++)
+            {
+                runs[r] = next_state(sm, runs[r], input[i], compact);
+            }
+        }
+        run_count = merge_runs(max_state, runs, run_count, owner, remap, map);
+    }
+
+    /* All runs converged, the rest of the chunk is as cheap as without
+     * speculation.
+     */
+    if (run_count == 1)
+    {
+        uint32_t state = runs[0];
+
+        for (; i < length && state != DEAD; i++)
+        {
+            state = next_state(sm, state, input[i], compact);
+        }
+        runs[0] = state;
+    }
+
+    for (uint32_t s = 0; s < max_state; s++)
+    {
+        map[s] = runs[owner[s]];
+    }
+}
+
+/* State machine through which "sm" is accessed without holding its lock.
+ * When its table may be replaced, it is a copy with consistent copy of the
+ * implementation, and caller has to be counted as a reader of table swap.
+ * Otherwise it is "sm" itself.
+ */
+static State_machine *snapshot(State_machine *const sm,
+    State_machine *const copy)
+{
+    if (SM_SWAP(sm) == NULL)
+    {
+        return sm;
+    }
+
+    memset(copy, 0, sizeof(State_machine));
+    SM_MAX_STATE(copy) = SM_MAX_STATE(sm);
+    SM_MAX_EVENT(copy) = SM_MAX_EVENT(sm);
+    SM_DATA(copy) = SM_DATA(sm);
+#ifndef __STDC_NO_ATOMICS__
+    if (SM_IS_LOCK_FREE(sm))
+    {
+        swap_lock_free_implementation(sm, &SM_TRANSITION(copy));
+
+        return copy;
+    }
+#endif
+    (void)lock_take_shared(sm, 0);
+    SM_TRANSITION(copy) = SM_TRANSITION(sm);
+    lock_give_shared(sm);
+
+    return copy;
+}
+
+static INLINE bool same_table(const State_machine_implementation *const a,
+    const State_machine_implementation *const b)
+{
+    return IMPL_TYPE(a) == STATE_MACHINE_USING_COMPACT_TABLE
+        ? IMPL(a, compact).table == IMPL(b, compact).table
+            && IMPL(a, compact).callbacks == IMPL(b, compact).callbacks
+        : IMPL(a, table) == IMPL(b, table);
+}
+
+uint32_t state_machine_chunk_map(State_machine *const sm,
+    const uint8_t *const input,
+    const size_t length,
+    uint32_t *const map,
+    uint32_t *const scratch)
+{
+    ASSERT_NOT_NULL(sm);
+    assert(length == 0 || input != NULL);
+    ASSERT_NOT_NULL(map);
+    ASSERT_NOT_NULL(scratch);
+
+    if (!IS_BYTE_MACHINE(sm))
+    {
+        return STATE_MACHINE_NOT_SUPPORTED;
+    }
+
+    State_machine copy;
+    const uint32_t index = SM_SWAP(sm) == NULL ? 0 : swap_enter(SM_SWAP(sm));
+    State_machine *const view = snapshot(sm, &copy);
+
+    if (SM_USING_COMPACT_TABLE(view))
+    {
+        chunk_map(view, input, length, map, scratch, true);
+    }
+    else
+    {
+        chunk_map(view, input, length, map, scratch, false);
+    }
+
+    if (SM_SWAP(sm) != NULL)
+    {
+        swap_leave(SM_SWAP(sm), index);
+    }
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+/* Sequential run from "*state" that stops before undefined transition,
+ * optionally invoking callbacks. Returns number of bytes processed.
+ */
+static size_t walk(State_machine *const sm,
+    const uint8_t *const input,
+    const size_t length,
+    uint32_t *const state,
+    const bool callbacks)
+{
+    const bool compact = SM_USING_COMPACT_TABLE(sm);
+    uint32_t current = *state;
+    size_t i;
+
+    for (i = 0; i < length; i++)
+    {
+        const uint32_t next = compact
+            ? next_state(sm, current, input[i], true)
+            : next_state(sm, current, input[i], false);
+
+        if (next == DEAD)
+        {
+            break;
+        }
+        if (callbacks)
+        {
+            State_machine_transition buffer;
+            State_machine_transition *transition;
+
+            (void)implementation_lookup(&SM_TRANSITION(sm), SM_MAX_EVENT(sm),
+                current, input[i], SM_DATA(sm), &buffer, &transition);
+            (void)implementation_callbacks(&SM_TRANSITION(sm), transition,
+                input[i], next, current, NULL, SM_DATA(sm));
+        }
+        current = next;
+    }
+    *state = current;
+
+    return i;
+}
+
+typedef struct
+{
+    State_machine *sm;
+    const uint8_t *input;
+    size_t length;
+    size_t chunk;
+    uint32_t *maps;
+    uint32_t *scratch;
+} Parallel_job;
+
+static void parallel_task(void *argument, const size_t index)
+{
+    const Parallel_job *const job = argument;
+    const size_t max_state = SM_MAX_STATE(job->sm);
+    const size_t start = index * job->chunk < job->length
+        ? index * job->chunk : job->length;
+    const size_t length = job->length - start < job->chunk
+        ? job->length - start : job->chunk;
+
+    (void)state_machine_chunk_map(job->sm, job->input + start, length,
+        &job->maps[index * max_state], &job->scratch[index * 3 * max_state]);
+}
+
+uint32_t state_machine_match_parallel(State_machine *const sm,
+    const uint8_t *const input,
+    const size_t length,
+    const size_t chunk_count,
+    uint32_t *const maps,
+    uint32_t *const scratch,
+    uint32_t *const chunk_states,
+    State_machine_executor executor,
+    void *const context,
+    size_t *const consumed,
+    const uint32_t flags)
+{
+    uint32_t ret;
+
+    ASSERT_NOT_NULL(sm);
+    assert(length == 0 || input != NULL);
+    assert(chunk_count > 0);
+    ASSERT_NOT_NULL(maps);
+    ASSERT_NOT_NULL(scratch);
+    ASSERT_NOT_NULL(executor);
+    ASSERT_NOT_NULL(consumed);
+
+    *consumed = 0;
+
+    if (!IS_BYTE_MACHINE(sm) || SM_IS_LOCK_FREE(sm))
+    {
+        return STATE_MACHINE_NOT_SUPPORTED;
+    }
+
+    const size_t max_state = SM_MAX_STATE(sm);
+    Parallel_job job =
+    {
+        .input = input,
+        .length = length,
+        .chunk = (length + chunk_count - 1) / chunk_count,
+        .maps = maps,
+        .scratch = scratch
+    };
+    State_machine copy;
+    const uint32_t index = SM_SWAP(sm) == NULL ? 0 : swap_enter(SM_SWAP(sm));
+    State_machine *view;
+
+    for (;;)
+    {
+        view = snapshot(sm, &copy);
+        job.sm = view;
+        executor(context, parallel_task, &job, chunk_count);
+
+        /* {{{ Critical Section ******************************************** */
+
+        if_sm_failure (ret = lock_take(sm, flags))
+        {
+            if (SM_SWAP(sm) != NULL)
+            {
+                swap_leave(SM_SWAP(sm), index);
+            }
+
+            return ret;
+        }
+        if (view == sm || same_table(&SM_TRANSITION(sm), &SM_TRANSITION(view)))
+        {
+            break;
+        }
+
+        /* Table was replaced while chunks were processed, states in maps
+         * may not even mean the same thing any more.
+         */
+        lock_give(sm);
+    }
+
+    uint32_t state = SM_CURRENT_STATE(sm);
+    size_t done = 0;
+
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        if (chunk_states != NULL)
+        {
+            chunk_states[i] = state;
+        }
+        if (state == DEAD)
+        {
+            continue;
+        }
+
+        const uint32_t next = maps[i * max_state + state];
+
+        if (next == DEAD)
+        {
+            /* Exact position of undefined transition has to be found by
+             * running the chunk once more from the right state.
+             */
+            done += walk(view, input + done,
+                length - done < job.chunk ? length - done : job.chunk,
+                &state, false);
+            SM_CURRENT_STATE(sm) = state;
+            state = DEAD;
+            ret = STATE_MACHINE_INVALID;
+            continue;
+        }
+        state = next;
+        done += length - done < job.chunk ? length - done : job.chunk;
+    }
+    if (state != DEAD)
+    {
+        SM_CURRENT_STATE(sm) = state;
+    }
+    state = SM_CURRENT_STATE(sm);
+
+    lock_give(sm);
+
+    /* }}} Critical Section ************************************************ */
+
+    if (SM_TIMER(sm) != NULL && done > 0)
+    {
+        timer_enter(SM_TIMER(sm), state);
+    }
+
+    if (SM_SWAP(sm) != NULL)
+    {
+        swap_leave(SM_SWAP(sm), index);
+    }
+
+    *consumed = done;
+
+    return ret;
+}
+
+uint32_t state_machine_replay(State_machine *const sm,
+    const uint8_t *const input,
+    const size_t length,
+    const uint32_t state)
+{
+    uint32_t current = state;
+
+    ASSERT_NOT_NULL(sm);
+    assert(length == 0 || input != NULL);
+    assert(state < SM_MAX_STATE(sm));
+
+    if (!IS_BYTE_MACHINE(sm))
+    {
+        return STATE_MACHINE_NOT_SUPPORTED;
+    }
+
+    State_machine copy;
+    const uint32_t index = SM_SWAP(sm) == NULL ? 0 : swap_enter(SM_SWAP(sm));
+    const size_t n = walk(snapshot(sm, &copy), input, length, &current, true);
+
+    if (SM_SWAP(sm) != NULL)
+    {
+        swap_leave(SM_SWAP(sm), index);
+    }
+
+    return n < length ? STATE_MACHINE_INVALID : STATE_MACHINE_SUCCESS;
+}
@@ -0,0 +1,207 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_PARALLEL_H_43787486206580329017541849497664611993
+#define STATE_MACHINE_PARALLEL_H_43787486206580329017541849497664611993
+
+#include "state-machine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Parallel speculative processing of one long byte stream, see
+ * state_machine_match(). Input is split in to chunks and each chunk is run
+ * from every state at once, which gives a map from the state in which chunk
+ * starts to the state in which it ends. Chunks are independent, therefore
+ * they can be processed by multiple threads of execution. Maps are then
+ * composed, starting in current state of state machine, which is cheap
+ * compared to processing of chunks. This pays off for state machines with
+ * small number of states, especially when runs from different states
+ * converge to the same state, which is detected and then only one run is
+ * continued.
+ */
+
+/** Value in a chunk map that means that chunk contains undefined transition
+ * when it starts in given state.
+ */
+#define STATE_MACHINE_DEAD_STATE    UINT32_MAX
+
+/** Compute map of a chunk of input.
+ *
+ * State machine isn't changed, it is only used to access its transition
+ * table. Therefore multiple threads of execution may call this function for
+ * the same state machine at the same time.
+ *
+ * @param[in] state_machine
+ *   State machine that uses transition table or compact transition table,
+ *   and that has at least 256 events.
+ *
+ * @param[in] input
+ *   Array of <tt>length</tt> bytes.
+ *
+ * @param[in] length
+ *   Number of bytes in <tt>input</tt>.
+ *
+ * @param[out] map
+ *   Array of <tt>max_state</tt> entries, <tt>map[s]</tt> is set to the state
+ *   in which chunk ends when it's started in state <tt>s</tt>, or to
+ *   <tt>STATE_MACHINE_DEAD_STATE</tt>.
+ *
+ * @param[out] scratch
+ *   Array of <tt>3 * max_state</tt> entries used during computation.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If state
+ *   machine uses other implementation, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_chunk_map(State_machine *const state_machine,
+    const uint8_t *const input,
+    const size_t length,
+    uint32_t *const map,
+    uint32_t *const scratch);
+
+/** Function that executes one task of a parallel computation.
+ */
+typedef void (*State_machine_task)(void *argument, size_t index);
+
+/** Function that calls <tt>task(argument, i)</tt> for every <tt>i</tt> less
+ * then <tt>count</tt>, in any order and on any threads of execution, and
+ * returns after all of them finished. It is provided by application, e.g. on
+ * top of its thread pool.
+ */
+typedef void (*State_machine_executor)(void *context, State_machine_task task,
+    void *argument, size_t count);
+
+/** Run state machine over a buffer of bytes using parallel speculation.
+ *
+ * Result is the same as of <tt>state_machine_match()</tt> without stop
+ * states, except that no callbacks are invoked. Chunks are processed
+ * without taking lock, which is taken only when their maps are composed and
+ * the final state is stored.
+ *
+ * @param[in] state_machine
+ *   State machine that uses transition table or compact transition table,
+ *   and that has at least 256 events. It must not be lock-free.
+ *
+ * @param[in] input
+ *   Array of <tt>length</tt> bytes.
+ *
+ * @param[in] length
+ *   Number of bytes in <tt>input</tt>.
+ *
+ * @param[in] chunk_count
+ *   Number of chunks in to which input is split. It has to be greater then
+ *   zero.
+ *
+ * @param[out] maps
+ *   Array of <tt>chunk_count * max_state</tt> entries.
+ *
+ * @param[out] scratch
+ *   Array of <tt>chunk_count * 3 * max_state</tt> entries.
+ *
+ * @param[out] chunk_states
+ *   Array of <tt>chunk_count</tt> entries, state in which each chunk was
+ *   really started is stored there, so that callbacks can be replayed using
+ *   <tt>state_machine_replay()</tt>. It may be NULL.
+ *
+ * @param[in] executor
+ *   Function that runs processing of chunks.
+ *
+ * @param[in] context
+ *   Passed to <tt>executor</tt>.
+ *
+ * @param[out] consumed
+ *   Number of bytes that were processed is stored here.
+ *
+ * @param[in] flags
+ *   Same as for <tt>state_machine_event()</tt>.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If byte at
+ *   offset <tt>*consumed</tt> has undefined transition, then it returns
+ *   <tt>STATE_MACHINE_INVALID</tt>, entries of <tt>chunk_states</tt> for
+ *   chunks that weren't reached are set to
+ *   <tt>STATE_MACHINE_DEAD_STATE</tt>. If flags have
+ *   <tt>STATE_MACHINE_NONBLOCK</tt> bit set and function was unable to
+ *   acquire lock, then it returns <tt>STATE_MACHINE_WOULD_BLOCK</tt>. If
+ *   state machine uses other implementation or it is lock-free, then it
+ *   returns <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_match_parallel(State_machine *const state_machine,
+    const uint8_t *const input,
+    const size_t length,
+    const size_t chunk_count,
+    uint32_t *const maps,
+    uint32_t *const scratch,
+    uint32_t *const chunk_states,
+    State_machine_executor executor,
+    void *const context,
+    size_t *const consumed,
+    const uint32_t flags);
+
+/** Invoke callbacks of transitions that state machine makes over a buffer
+ * of bytes when started in given state.
+ *
+ * State machine isn't changed, callbacks get NULL event data. Replay of
+ * different chunks may run in parallel, if callbacks allow that.
+ *
+ * @param[in] state_machine
+ *   State machine that uses transition table or compact transition table,
+ *   and that has at least 256 events.
+ *
+ * @param[in] input
+ *   Array of <tt>length</tt> bytes.
+ *
+ * @param[in] length
+ *   Number of bytes in <tt>input</tt>.
+ *
+ * @param[in] state
+ *   State in which replay starts, e.g. entry of <tt>chunk_states</tt>.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If an
+ *   undefined transition is encountered, then replay stops and it returns
+ *   <tt>STATE_MACHINE_INVALID</tt>. If state machine uses other
+ *   implementation, then it returns <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_replay(State_machine *const state_machine,
+    const uint8_t *const input,
+    const size_t length,
+    const uint32_t state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_PARALLEL_H_43787486206580329017541849497664611993 */
@@ -0,0 +1,1114 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Definitions shared by translation units of this library. This header is not
+ * part of public interface.
+ */
+
+#ifndef STATE_MACHINE_PRIVATE_H_247974569318769375053588401954258151908
+#define STATE_MACHINE_PRIVATE_H_247974569318769375053588401954258151908
+
+#include "state-machine.h"
+#include "state-machine-fleet.h"
+#include "state-machine-trace.h"
+#include "state-machine-deferred.h"
+#include "state-machine-rtc.h"
+#include "state-machine-timer.h"
+#include "state-machine-swap.h"
+#include "state-machine-queue.h"
+#include <assert.h>
+
+#ifndef __STDC_NO_ATOMICS__
+#include <stdatomic.h>
+#endif
+
+/* Run-to-completion queue identifies its owner by address of thread-local
+ * variable.
+ */
+#if !defined(__STDC_NO_ATOMICS__) && !defined(__STDC_NO_THREADS__)
+#define HAVE_RTC_QUEUE
+#endif
+
+#if __STDC_VERSION__ >= 199901L
+/* Standards C99 and C11 understand "inline" keyword. */
+#define INLINE inline
+#else
+#define INLINE
+#endif
+
+/* Accessors for State_machine */
+#define SM_MAX_STATE(sm)                (sm->max_state)
+#define SM_MAX_EVENT(sm)                (sm->max_event)
+#define SM_CURRENT_STATE(sm)            (sm->current_state)
+#define SM_OPTIONS(sm)                  (sm->options)
+#define SM_IS_LOCK_FREE(sm)             \
+    ((SM_OPTIONS(sm) & STATE_MACHINE_OPTION_LOCK_FREE) != 0)
+#define SM_LOCK(sm)                     (sm->lock)
+#define SM_DATA(sm)                     (sm->data)
+#define SM_TRANSITION(sm)               (sm->transition)
+#define SM_TRANSITION_TYPE(sm)          (SM_TRANSITION(sm).type)
+#define SM_USING_TRANSITION_TABLE(sm)   \
+    (SM_TRANSITION_TYPE(sm) == STATE_MACHINE_USING_TABLE)
+#define SM_USING_COMPACT_TABLE(sm)      \
+    (SM_TRANSITION_TYPE(sm) == STATE_MACHINE_USING_COMPACT_TABLE)
+#define SM_USING_TRANSITION_FUNCTION(sm)    \
+    (SM_TRANSITION_TYPE(sm) == STATE_MACHINE_USING_FUNCTION)
+#define SM_USING_ANY_FUNCTION(sm)       \
+    IMPL_USING_ANY_FUNCTION((&SM_TRANSITION(sm)))
+#define SM_TRANSITION_IMPL(sm, it)      (SM_TRANSITION(sm).implementation.it)
+#define SM_STATISTICS(sm)               (sm->statistics)
+#define SM_TRACE(sm)                    (sm->trace)
+#define SM_DEFERRED(sm)                 (sm->deferred)
+#define SM_RTC_QUEUE(sm)                (sm->rtc_queue)
+#define SM_TIMER(sm)                    (sm->timer)
+#define SM_SWAP(sm)                     (sm->swap)
+#define SM_QUEUE(sm)                    (sm->queue)
+
+/* Accessors for State_machine_fleet */
+#define FLEET_MAX_STATE(f)              (f->max_state)
+#define FLEET_MAX_EVENT(f)              (f->max_event)
+#define FLEET_SIZE(f)                   (f->size)
+#define FLEET_OPTIONS(f)                (f->options)
+#define FLEET_IS_LOCK_FREE(f)           \
+    ((FLEET_OPTIONS(f) & STATE_MACHINE_OPTION_LOCK_FREE) != 0)
+#define FLEET_LOCK(f)                   (f->lock)
+#define FLEET_TRANSITION(f)             (f->transition)
+#define FLEET_TRANSITION_IMPL(f, it)    (FLEET_TRANSITION(f).implementation.it)
+#define FLEET_CURRENT_STATE(f, i)       (f->current_state[i])
+#define FLEET_DATA(f, i)                (f->data == NULL ? NULL : f->data[i])
+#define FLEET_TRACE(f)                  (f->trace)
+
+#define FLEET_USE_LOCKING(f)            (FLEET_LOCK(f).take != NULL)
+#define FLEET_USE_SHARED_LOCKING(f)     (FLEET_LOCK(f).take_shared != NULL)
+
+/* Accessors for State_machine_implementation */
+#define IMPL_TYPE(impl)                 (impl->type)
+#define IMPL(impl, it)                  (impl->implementation.it)
+#define IMPL_USING_ANY_FUNCTION(impl)   \
+    (IMPL_TYPE(impl) == STATE_MACHINE_USING_FUNCTION \
+        || IMPL_TYPE(impl) == STATE_MACHINE_USING_OUTPUT_FUNCTION)
+
+/* Accessors for State_machine_transition */
+#define IS_TRANSITION(t)                (t->is_transition)
+#define RESULT_TRANSITION(t)            (t->result.transition)
+#define RESULT_NO_TRANSITION(t)         (t->result.no_transition)
+
+/* Accessors for State_machine_compact_transition */
+#define COMPACT_IS_TRANSITION(ct)       \
+    ((ct & STATE_MACHINE_COMPACT_IS_TRANSITION) != 0)
+#define COMPACT_NEXT_STATE(ct)          \
+    (ct & (STATE_MACHINE_COMPACT_MAX_STATE - 1))
+#define COMPACT_CALLBACK(ct)            \
+    ((ct >> STATE_MACHINE_COMPACT_STATE_BITS)   \
+        & (STATE_MACHINE_COMPACT_MAX_CALLBACKS - 1))
+
+/* In this macros we assume that caller will check if sm != NULL and if locking
+ * is defined consistently.
+ */
+#define USE_LOCKING(sm)                 (SM_LOCK(sm).take != NULL)
+#define USE_SHARED_LOCKING(sm)          (SM_LOCK(sm).take_shared != NULL)
+
+/* Either our implementation supports locking or not, there is no middle
+ * ground.
+ */
+#define ASSERT_LOCKING_DEFINITION_CONSISTENCY(lock)                           \
+    assert((lock.take == NULL && lock.try_take == NULL && lock.give == NULL)  \
+        || (lock.take != NULL && lock.try_take != NULL && lock.give != NULL))
+
+/* Shared operations are optional, but again, all or nothing, and only on top
+ * of exclusive ones.
+ */
+#define ASSERT_SHARED_LOCKING_DEFINITION_CONSISTENCY(lock)                    \
+    assert((lock.take_shared == NULL && lock.try_take_shared == NULL          \
+            && lock.give_shared == NULL)                                      \
+        || (lock.take_shared != NULL && lock.try_take_shared != NULL          \
+            && lock.give_shared != NULL && lock.take != NULL))
+
+#define ASSERT_NOT_NULL(x)              assert(x != NULL)
+
+#ifndef __STDC_NO_ATOMICS__
+/* Public header has to be usable from C++ as well, therefore states aren't
+ * declared as _Atomic. They have the same size and alignment as their atomic
+ * counterparts, which are lock-free on all platforms we care about.
+ */
+#define ATOMIC_STATE(s)                 ((_Atomic uint32_t *)(s))
+#define SM_ATOMIC_CURRENT_STATE(sm)     ATOMIC_STATE(&SM_CURRENT_STATE(sm))
+#endif
+
+/* Lookup in cache of pure transition function. Cached transitions are
+ * copied in to "buffer", since entry may be replaced by other thread of
+ * execution as soon as critical section is left.
+ */
+static INLINE uint32_t implementation_cached_lookup(
+    const State_machine_implementation *const impl,
+    const uint32_t max_event,
+    const uint32_t current_state,
+    const uint32_t event,
+    void *const data,
+    State_machine_transition *const buffer,
+    State_machine_transition **const transition)
+{
+    State_machine_transition_cache_entry *const cache =
+        IMPL(impl, function).cache;
+    const size_t size = IMPL(impl, function).cache_size;
+    const uint64_t cell = (uint64_t)current_state * max_event + event;
+    State_machine_transition_cache_entry *entry;
+    State_machine_transition *computed;
+    uint32_t ret;
+
+    /* Cache that is big enough has entry for every cell. Cache that is too
+     * small for all cells has power of two entries, cells that are beyond
+     * its end are scattered in it using multiplicative hashing.
+     */
+    entry = cell < size ? &cache[cell]
+        : &cache[((cell * UINT64_C(0x9E3779B97F4A7C15)) >> 32) & (size - 1)];
+
+    if (entry->key != cell + 1)
+    {
+        if_sm_failure (ret = IMPL(impl, function).transition(current_state,
+            event, data, &computed))
+        {
+            return ret;
+        }
+
+        *buffer = *computed;
+        if (IMPL(impl, function).cleanup != NULL)
+        {
+            if_sm_failure (ret = IMPL(impl, function).cleanup(data, computed))
+            {
+                return ret;
+            }
+        }
+        entry->transition = *buffer;
+        entry->key = cell + 1;
+    }
+    else
+    {
+        *buffer = entry->transition;
+    }
+    *transition = buffer;
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+/* Look up transition for "event" in "current_state". This has to be called
+ * inside critical section. Return value is either STATE_MACHINE_SUCCESS or
+ * return value of transition function, in which case value of "transition" is
+ * undefined.
+ *
+ * Compact transition table entries are decoded in to "buffer", which has to
+ * stay valid until callbacks are invoked.
+ */
+static INLINE uint32_t implementation_lookup(
+    const State_machine_implementation *const impl,
+    const uint32_t max_event,
+    const uint32_t current_state,
+    const uint32_t event,
+    void *const data,
+    State_machine_transition *const buffer,
+    State_machine_transition **const transition)
+{
+    /* Caller has to make sure that event and current_state are in bounds.
+     */
+    if (IMPL_TYPE(impl) == STATE_MACHINE_USING_TABLE)
+    {
+        State_machine_transition (*table)[max_event] =
+            (State_machine_transition (*)[max_event])IMPL(impl, table);
+
+        *transition = &(table[current_state][event]);
+
+        return STATE_MACHINE_SUCCESS;
+    }
+    else if (IMPL_TYPE(impl) == STATE_MACHINE_USING_COMPACT_TABLE)
+    {
+        const State_machine_compact_transition compact =
+            IMPL(impl, compact).table[(size_t)current_state * max_event + event];
+        const State_machine_compact_callback *const callback =
+            &IMPL(impl, compact).callbacks[COMPACT_CALLBACK(compact)];
+
+        buffer->cause = event;
+        buffer->current_state = current_state;
+        buffer->is_transition = COMPACT_IS_TRANSITION(compact);
+        if (IS_TRANSITION(buffer))
+        {
+            RESULT_TRANSITION(buffer).next_state = COMPACT_NEXT_STATE(compact);
+            RESULT_TRANSITION(buffer).on_enter = callback->on_enter;
+        }
+        else
+        {
+            RESULT_NO_TRANSITION(buffer).on_undefined_transition =
+                callback->on_undefined_transition;
+        }
+        *transition = buffer;
+
+        return STATE_MACHINE_SUCCESS;
+    }
+    else if (IMPL_TYPE(impl) == STATE_MACHINE_USING_SPARSE_TABLE)
+    {
+        const State_machine_transition *const transitions =
+            IMPL(impl, sparse).transitions;
+        uint32_t low = IMPL(impl, sparse).rows[current_state];
+        uint32_t high = IMPL(impl, sparse).rows[current_state + 1];
+
+        /* Binary search for "event" among transitions of current state.
+         */
+        while (low < high)
+        {
+            const uint32_t middle = low + (high - low) / 2;
+            const uint32_t cause = transitions[middle].cause;
+
+            if (cause == event)
+            {
+                *transition = (State_machine_transition *)&transitions[middle];
+
+                return STATE_MACHINE_SUCCESS;
+            }
+            else if (cause < event)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+
+        buffer->cause = event;
+        buffer->current_state = current_state;
+        buffer->is_transition = false;
+        RESULT_NO_TRANSITION(buffer).on_undefined_transition =
+            IMPL(impl, sparse).on_undefined_transition;
+        *transition = buffer;
+
+        return STATE_MACHINE_SUCCESS;
+    }
+    else if (IMPL_TYPE(impl) == STATE_MACHINE_USING_COMPILED_TABLE)
+    {
+        const size_t row = IMPL(impl, compiled).row[current_state];
+        const uint32_t event_class = IMPL(impl, compiled).event_class[event];
+
+        *transition = (State_machine_transition *)&IMPL(impl, compiled).rows[
+            row * IMPL(impl, compiled).class_count + event_class];
+
+        return STATE_MACHINE_SUCCESS;
+    }
+    else if (IMPL_TYPE(impl) == STATE_MACHINE_USING_OUTPUT_FUNCTION)
+    {
+        /* Same as for transition function below, but result is stored in
+         * to a buffer that lives until callbacks are done.
+         */
+        *transition = buffer;
+
+        return IMPL(impl, output_function).transition(current_state, event,
+            data, buffer);
+    }
+    else if (IMPL(impl, function).cache != NULL)
+    {
+        return implementation_cached_lookup(impl, max_event, current_state,
+            event, data, buffer, transition);
+    }
+    else
+    {
+        State_machine_transition_function transition_function =
+            IMPL(impl, function).transition;
+
+        /* If implementation of transition_function() uses its own private data
+         * (meaning sm->data) or calls outside functions, then one has to be
+         * aware of the fact that it is being done inside of critical section.
+         *
+         * It would be best if transition_function() was defined as a pure
+         * total function. In other words function that would behave as array
+         * lookup to the outside and for the same input would always provide
+         * same output. Unfortunately that is out of our control.
+         */
+        return transition_function(current_state, event, data, transition);
+    }
+}
+
+/* Call cleanup function of transition function, if there is one. */
+static INLINE uint32_t implementation_cleanup(
+    const State_machine_implementation *const impl,
+    State_machine_transition *const transition,
+    void *const data)
+{
+    uint32_t ret = STATE_MACHINE_SUCCESS;
+
+    /* When using transition function we need to call cleanup function, if
+     * provided. The reason behind this is that transition function may
+     * allocate memory or other resource and cleanup is then responsible to
+     * deallocate it. Results of pure transition function were already
+     * cleaned up when they were put in to cache.
+     */
+    if (IMPL_TYPE(impl) == STATE_MACHINE_USING_FUNCTION
+        && IMPL(impl, function).cache == NULL)
+    {
+        State_machine_transition_cleanup_function cleanup =
+            IMPL(impl, function).cleanup;
+
+        if (cleanup != NULL)
+        {
+            ret = cleanup(data, transition);
+            /* Caller handles this return value.
+             */
+        }
+    }
+
+    return ret;
+}
+
+/* Invoke on-enter or on-undefined-state callback and, when using transition
+ * function, cleanup function. This has to be called outside of critical
+ * section. Returns STATE_MACHINE_SUCCESS or return value of cleanup function.
+ */
+static INLINE uint32_t implementation_callbacks(
+    const State_machine_implementation *const impl,
+    State_machine_transition *const transition,
+    const uint32_t event,
+    const uint32_t current_state,
+    const uint32_t previous_state,
+    void *const event_data,
+    void *const data)
+{
+    /* On-enter or on-undefined-state callback function is invoked outside of
+     * critical section. For this to work consistently this invariants have to
+     * hold:
+     *
+     * - Value of transition variable is either constant or it is visible only
+     *   in current context and not by other thread of execution (regardles if
+     *   we are single-threaded event-driven system or multi-threaded system).
+     *
+     *   Most commonly it will be constant when state machine was initialized
+     *   using transition table and possibly variable value when using
+     *   transition function. Therefore transition function should return
+     *   either constant or newly allocated value visible only in current
+     *   context. Later requires that cleanup function works properly.
+     *
+     * - Private data stored in state machine "sm->data" pointer are either
+     *   thread safe or properly handled inside on-enter or on-undefined-state
+     *   callbacks.
+     */
+    if (IS_TRANSITION(transition))
+    {
+        On_state_enter on_enter = RESULT_TRANSITION(transition).on_enter;
+
+        if (on_enter != NULL)
+        {
+            on_enter(event, current_state, previous_state, event_data, data);
+        }
+    }
+    else
+    {
+        On_undefined_state_transition on_undefined_transition =
+            RESULT_NO_TRANSITION(transition).on_undefined_transition;
+
+        if (on_undefined_transition != NULL)
+        {
+            on_undefined_transition(event, current_state, event_data, data);
+        }
+    }
+
+    return implementation_cleanup(impl, transition, data);
+}
+
+#ifndef __STDC_NO_ATOMICS__
+/* Lock-free counterpart of critical section in state_machine_event(). It is
+ * applicable only to transition tables, since their lookup can't fail and its
+ * result doesn't need cleanup. On return "current_state" and "previous_state"
+ * hold values that should be passed to callbacks.
+ */
+static INLINE void implementation_lock_free(
+    const State_machine_implementation *const impl,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    _Atomic uint32_t *const state,
+    const uint32_t event,
+    void *const data,
+    State_machine_transition *const buffer,
+    State_machine_transition **const transition,
+    uint32_t *const current_state,
+    uint32_t *const previous_state)
+{
+    uint32_t current = atomic_load_explicit(state, memory_order_acquire);
+    uint32_t next;
+
+    assert(!IMPL_USING_ANY_FUNCTION(impl));
+
+    do
+    {
+        State_machine_transition *t;
+
+        assert(current < max_state);
+
+        (void)implementation_lookup(impl, max_event, current, event, data,
+            buffer, &t);
+        *transition = t;
+
+        if (!IS_TRANSITION(t))
+        {
+            /* There is nothing to store, undefined transition happened at
+             * the moment when current state was loaded.
+             */
+            *current_state = current;
+            *previous_state = max_state;
+
+            return;
+        }
+        next = RESULT_TRANSITION(t).next_state;
+
+        /* On failure "current" is updated to the value that some other
+         * thread stored in the meantime and lookup has to be done again.
+         */
+    }
+    while (!atomic_compare_exchange_weak_explicit(state, &current, next,
+        memory_order_acq_rel, memory_order_acquire));
+
+    assert(next < max_state);
+
+    *current_state = next;
+    *previous_state = current;
+}
+#endif
+
+#ifndef __STDC_NO_ATOMICS__
+#define TRACE_STORE_32(field, value)    \
+    atomic_store_explicit((_Atomic uint32_t *)&(field), value,  \
+        memory_order_relaxed)
+#define TRACE_STORE_64(field, value)    \
+    atomic_store_explicit((_Atomic uint64_t *)&(field), value,  \
+        memory_order_relaxed)
+
+/* Write record of a step in which "event" was looked up in "state". Record is
+ * protected by its sequence number in the same way as by a sequence lock,
+ * see state_machine_trace_snapshot().
+ */
+static INLINE void trace_write(State_machine_trace *const trace,
+    const uint32_t instance,
+    const uint32_t state,
+    const uint32_t event,
+    const bool is_transition,
+    const uint32_t next_state)
+{
+    if (trace == NULL)
+    {
+        return;
+    }
+
+    const uint64_t sequence = atomic_fetch_add_explicit(
+        (_Atomic uint64_t *)&trace->written, 1, memory_order_relaxed) + 1;
+    State_machine_trace_record *const record =
+        &trace->records[(sequence - 1) & (trace->size - 1)];
+
+    TRACE_STORE_64(record->sequence, 0);
+    atomic_thread_fence(memory_order_release);
+
+    TRACE_STORE_64(record->timestamp,
+        trace->clock == NULL ? 0 : trace->clock());
+    TRACE_STORE_32(record->instance, instance);
+    TRACE_STORE_32(record->cause, event);
+    TRACE_STORE_32(record->previous_state, state);
+    TRACE_STORE_32(record->next_state, is_transition ? next_state : state);
+    TRACE_STORE_32(record->is_transition, is_transition ? 1 : 0);
+
+    atomic_store_explicit((_Atomic uint64_t *)&record->sequence, sequence,
+        memory_order_release);
+}
+
+#define TRACE_TRANSITION(trace, instance, state, event, transition)   \
+    trace_write(trace, instance, state, event, IS_TRANSITION(transition), \
+        RESULT_TRANSITION(transition).next_state)
+#else
+#define TRACE_TRANSITION(trace, instance, state, event, transition)
+#endif
+
+/* Buffer of deferred callbacks is written only inside critical section of a
+ * state machine, therefore there is always only one writer. Without atomic
+ * operations it can't be attached at all, see state_machine_attach_deferred().
+ */
+static INLINE bool deferred_full(State_machine_deferred *const deferred)
+{
+#ifndef __STDC_NO_ATOMICS__
+    const uint64_t written = atomic_load_explicit(
+        (_Atomic uint64_t *)&deferred->written, memory_order_relaxed);
+    const uint64_t dispatched = atomic_load_explicit(
+        (_Atomic uint64_t *)&deferred->dispatched, memory_order_acquire);
+
+    return written - dispatched >= deferred->size;
+#else
+    (void)deferred;
+
+    return false;
+#endif
+}
+
+/* Record callback of a step in which "event" was looked up in "state", if it
+ * has any. Caller has to make sure that buffer isn't full. Returns true if
+ * callback was recorded.
+ */
+static INLINE bool deferred_append(State_machine_deferred *const deferred,
+    const State_machine_transition *const transition,
+    const uint32_t event,
+    const uint32_t state,
+    const uint32_t max_state,
+    void *const event_data,
+    void *const data)
+{
+#ifndef __STDC_NO_ATOMICS__
+    On_state_enter on_enter = NULL;
+    On_undefined_state_transition on_undefined_transition = NULL;
+
+    if (IS_TRANSITION(transition))
+    {
+        on_enter = RESULT_TRANSITION(transition).on_enter;
+    }
+    else
+    {
+        on_undefined_transition =
+            RESULT_NO_TRANSITION(transition).on_undefined_transition;
+    }
+    if (on_enter == NULL && on_undefined_transition == NULL)
+    {
+        return false;
+    }
+
+    const uint64_t written = atomic_load_explicit(
+        (_Atomic uint64_t *)&deferred->written, memory_order_relaxed);
+    State_machine_deferred_callback *const callback =
+        &deferred->callbacks[written & (deferred->size - 1)];
+
+    assert(!deferred_full(deferred));
+
+    callback->on_enter = on_enter;
+    callback->on_undefined_transition = on_undefined_transition;
+    callback->cause = event;
+    callback->current_state = IS_TRANSITION(transition)
+        ? RESULT_TRANSITION(transition).next_state : state;
+    callback->previous_state = IS_TRANSITION(transition) ? state : max_state;
+    callback->event_data = event_data;
+    callback->data = data;
+
+    /* Publishes content of the callback to the dispatching thread. */
+    atomic_store_explicit((_Atomic uint64_t *)&deferred->written, written + 1,
+        memory_order_release);
+
+    return true;
+#else
+    (void)deferred;
+    (void)transition;
+    (void)event;
+    (void)state;
+    (void)max_state;
+    (void)event_data;
+    (void)data;
+
+    return false;
+#endif
+}
+
+/* Timers that expire too far in the future are put in to the last slot of
+ * the highest level, from which they are cascaded again until they fit.
+ */
+#define WHEEL_RANGE \
+    (UINT64_C(1) << (STATE_MACHINE_WHEEL_BITS * STATE_MACHINE_WHEEL_LEVELS))
+
+static INLINE void wheel_insert(State_machine_wheel *const wheel,
+    State_machine_timer *const timer)
+{
+    uint64_t expires = timer->expires;
+    uint32_t level = 0;
+
+    /* Only timers cascaded by state_machine_wheel_advance() may expire at the
+     * current tick, they are put in to the slot that is processed next.
+     */
+    if (expires < wheel->now)
+    {
+        expires = timer->expires = wheel->now;
+    }
+    if (expires - wheel->now >= WHEEL_RANGE)
+    {
+        expires = wheel->now + WHEEL_RANGE - 1;
+    }
+    while (level < STATE_MACHINE_WHEEL_LEVELS - 1
+        && expires - wheel->now
+            >= UINT64_C(1) << (STATE_MACHINE_WHEEL_BITS * (level + 1)))
+    {
+        level++;
+    }
+
+    State_machine_timer **const slot = &wheel->slots[level][
+        (expires >> (STATE_MACHINE_WHEEL_BITS * level))
+            & (STATE_MACHINE_WHEEL_SLOTS - 1)];
+
+    timer->next = *slot;
+    if (timer->next != NULL)
+    {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = slot;
+    *slot = timer;
+    wheel->count++;
+}
+
+static INLINE void wheel_remove(State_machine_wheel *const wheel,
+    State_machine_timer *const timer)
+{
+    if (timer->pprev == NULL)
+    {
+        return;
+    }
+
+    *timer->pprev = timer->next;
+    if (timer->next != NULL)
+    {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+    wheel->count--;
+}
+
+/* Cancel timer and arm it for timeout of "state", if it has one.
+ */
+static INLINE void timer_enter(State_machine_timer *const timer,
+    const uint32_t state)
+{
+    const State_machine_timeout *const timeout = &timer->timeouts[state];
+
+    wheel_remove(timer->wheel, timer);
+    if (timeout->duration != 0)
+    {
+        timer->event = timeout->event;
+        timer->expires = timer->wheel->now + timeout->duration;
+        wheel_insert(timer->wheel, timer);
+    }
+}
+
+#ifndef __STDC_NO_ATOMICS__
+/* Generation word of table swap consists of generation number shifted by
+ * SWAP_PHASE_BITS and phase of the latest replacement. Readers of generation
+ * g are counted in readers[g & 1]. Only one replacement may be in progress,
+ * therefore only the latest two generations can have readers.
+ */
+#define SWAP_PHASE_BITS                 2
+#define SWAP_PHASE_MASK                 ((UINT32_C(1) << SWAP_PHASE_BITS) - 1)
+#define SWAP_IDLE                       0
+#define SWAP_BUSY                       1
+#define SWAP_PENDING                    2
+#define SWAP_PHASE(word)                ((word) & SWAP_PHASE_MASK)
+#define SWAP_INDEX(word)                (((word) >> SWAP_PHASE_BITS) & 1)
+#define SWAP_GENERATION(swap)           \
+    ((_Atomic uint32_t *)&(swap)->generation)
+#define SWAP_READERS(swap, i)           ((_Atomic uint32_t *)&(swap)->readers[i])
+
+/* Retire previous implementation if "word" is still the latest generation
+ * with replacement pending, otherwise someone else already did or does so.
+ */
+static INLINE void swap_retire(State_machine_swap *const swap, uint32_t word)
+{
+    const uint32_t generation = word & ~SWAP_PHASE_MASK;
+
+    if (atomic_compare_exchange_strong(SWAP_GENERATION(swap), &word,
+        generation | SWAP_BUSY))
+    {
+        if (swap->retire != NULL)
+        {
+            swap->retire(swap->state_machine, &swap->previous, swap->context);
+        }
+        atomic_store(SWAP_GENERATION(swap), generation | SWAP_IDLE);
+    }
+}
+
+static INLINE void swap_leave(State_machine_swap *const swap,
+    const uint32_t index)
+{
+    if (atomic_fetch_sub(SWAP_READERS(swap, index), 1) == 1)
+    {
+        const uint32_t word = atomic_load(SWAP_GENERATION(swap));
+
+        /* The last reader of previous generation has left. Counter is
+         * checked once more, since replacement that is pending may have
+         * started after this call left, in which case it waits for readers
+         * that came later.
+         */
+        if (SWAP_PHASE(word) == SWAP_PENDING && SWAP_INDEX(word) != index
+            && atomic_load(SWAP_READERS(swap, index)) == 0)
+        {
+            swap_retire(swap, word);
+        }
+    }
+}
+
+/* Count caller as a reader of current generation and return index that has
+ * to be passed to swap_leave().
+ */
+static INLINE uint32_t swap_enter(State_machine_swap *const swap)
+{
+    uint32_t word = atomic_load(SWAP_GENERATION(swap));
+
+    for (;;)
+    {
+        const uint32_t index = SWAP_INDEX(word);
+        uint32_t now;
+
+        (void)atomic_fetch_add(SWAP_READERS(swap, index), 1);
+        now = atomic_load(SWAP_GENERATION(swap));
+        if ((now >> SWAP_PHASE_BITS) == (word >> SWAP_PHASE_BITS))
+        {
+            return index;
+        }
+
+        /* New generation was started in the meantime and readers of the
+         * previous one may already be waited for.
+         */
+        swap_leave(swap, index);
+        word = now;
+    }
+}
+
+/* Copy of implementation of a lock-free state machine that has table swap
+ * attached. Its table is published using atomic store, while callbacks of
+ * compact table never change.
+ */
+static INLINE void swap_lock_free_implementation(State_machine *const sm,
+    State_machine_implementation *const impl)
+{
+    *impl = (State_machine_implementation){.type = SM_TRANSITION_TYPE(sm)};
+    if (SM_USING_COMPACT_TABLE(sm))
+    {
+        IMPL(impl, compact).table = atomic_load_explicit(
+            (_Atomic(const State_machine_compact_transition *) *)
+                &SM_TRANSITION_IMPL(sm, compact).table,
+            memory_order_acquire);
+        IMPL(impl, compact).callbacks =
+            SM_TRANSITION_IMPL(sm, compact).callbacks;
+    }
+    else
+    {
+        IMPL(impl, table) = atomic_load_explicit(
+            (_Atomic(State_machine_transition *) *)
+                &SM_TRANSITION_IMPL(sm, table),
+            memory_order_acquire);
+    }
+}
+#else
+/* Table swap can't be attached without atomic operations, see
+ * state_machine_attach_swap().
+ */
+static INLINE uint32_t swap_enter(State_machine_swap *const swap)
+{
+    (void)swap;
+
+    return 0;
+}
+
+static INLINE void swap_leave(State_machine_swap *const swap,
+    const uint32_t index)
+{
+    (void)swap;
+    (void)index;
+}
+#endif
+
+#ifdef STATE_MACHINE_STATISTICS
+#include "state-machine-statistics.h"
+
+#ifndef __STDC_NO_ATOMICS__
+#define STATISTICS_INCREMENT(counter)   \
+    ((void)atomic_fetch_add_explicit((_Atomic uint64_t *)&(counter), 1, \
+        memory_order_relaxed))
+#define STATISTICS_LOAD(counter)        \
+    atomic_load_explicit((_Atomic uint64_t *)&(counter), memory_order_relaxed)
+#else
+#define STATISTICS_INCREMENT(counter)   ((void)(counter)++)
+#define STATISTICS_LOAD(counter)        (counter)
+#endif
+
+/* Current time in nanoseconds, see state-machine-statistics.c. It isn't
+ * inline, since monotonic clock is available only with POSIX feature test
+ * macro, which has to be defined before any system header is included.
+ */
+uint64_t state_machine_statistics_now(void);
+
+/* Add duration since "start" in to a histogram.
+ */
+static INLINE void statistics_duration(uint64_t *const histogram,
+    const uint64_t start)
+{
+    uint64_t ns = state_machine_statistics_now() - start;
+    size_t bucket = 0;
+
+    while (ns != 0 && bucket < STATE_MACHINE_HISTOGRAM_BUCKETS - 1)
+    {
+        ns >>= 1;
+        bucket++;
+    }
+
+    STATISTICS_INCREMENT(histogram[bucket]);
+}
+
+/* Record event that was looked up in "state".
+ */
+static INLINE void statistics_transition(
+    State_machine_statistics *const statistics,
+    const uint32_t max_event,
+    const uint32_t state,
+    const uint32_t event,
+    const State_machine_transition *const transition)
+{
+    if (statistics == NULL)
+    {
+        return;
+    }
+
+    STATISTICS_INCREMENT(statistics->events);
+    if (!IS_TRANSITION(transition))
+    {
+        STATISTICS_INCREMENT(statistics->undefined_transitions);
+    }
+    if (statistics->cell_hits != NULL)
+    {
+        STATISTICS_INCREMENT(
+            statistics->cell_hits[(size_t)state * max_event + event]);
+    }
+}
+
+#define STATISTICS_TRANSITION(sm, state, event, transition)     \
+    statistics_transition(SM_STATISTICS(sm), SM_MAX_EVENT(sm), state, event, \
+        transition)
+#else
+#define STATISTICS_TRANSITION(sm, state, event, transition)
+#endif
+
+/* Internal wrapper for take() and try_take() locking operations. Please bear
+ * in mind that return value indicates if code is in ciritical section or not.
+ */
+static INLINE uint32_t lock_take(State_machine *const sm, const uint32_t flags)
+{
+    /* Function that calls this has to check that value of sm is not NULL.
+     */
+    ASSERT_LOCKING_DEFINITION_CONSISTENCY(SM_LOCK(sm));
+
+    if (USE_LOCKING(sm))
+    {
+        if (flags & STATE_MACHINE_NONBLOCK)
+        {
+            if (!SM_LOCK(sm).try_take(sm))
+            {
+                return STATE_MACHINE_WOULD_BLOCK;
+            }
+        }
+        else
+        {
+#ifdef STATE_MACHINE_STATISTICS
+            if (SM_STATISTICS(sm) != NULL)
+            {
+                const uint64_t start = state_machine_statistics_now();
+
+                SM_LOCK(sm).take(sm);
+                statistics_duration(SM_STATISTICS(sm)->lock_wait, start);
+
+                return STATE_MACHINE_SUCCESS;
+            }
+#endif
+            SM_LOCK(sm).take(sm);
+        }
+    }
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+static INLINE void lock_give(State_machine *const sm)
+{
+    /* Function that calls this has to check that value of sm is not NULL.
+     */
+    ASSERT_LOCKING_DEFINITION_CONSISTENCY(SM_LOCK(sm));
+
+    if (USE_LOCKING(sm))
+    {
+        SM_LOCK(sm).give(sm);
+    }
+}
+
+/* Variants of lock_take() and lock_give() for read-only queries. They fall
+ * back to exclusive operations if shared ones aren't provided.
+ */
+static INLINE uint32_t lock_take_shared(State_machine *const sm,
+    const uint32_t flags)
+{
+    ASSERT_SHARED_LOCKING_DEFINITION_CONSISTENCY(SM_LOCK(sm));
+
+    if (!USE_SHARED_LOCKING(sm))
+    {
+        return lock_take(sm, flags);
+    }
+
+    if (flags & STATE_MACHINE_NONBLOCK)
+    {
+        if (!SM_LOCK(sm).try_take_shared(sm))
+        {
+            return STATE_MACHINE_WOULD_BLOCK;
+        }
+    }
+    else
+    {
+        SM_LOCK(sm).take_shared(sm);
+    }
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+static INLINE void lock_give_shared(State_machine *const sm)
+{
+    ASSERT_SHARED_LOCKING_DEFINITION_CONSISTENCY(SM_LOCK(sm));
+
+    if (!USE_SHARED_LOCKING(sm))
+    {
+        lock_give(sm);
+
+        return;
+    }
+
+    SM_LOCK(sm).give_shared(sm);
+}
+
+/* This is Dmitry Vyukov's intrusive MPSC node-based queue. Producers only
+ * exchange head and then link previous head to their node, which makes
+ * posting wait-free. Consumer may observe a producer between these two steps
+ * in which case it behaves as if the queue was empty.
+ */
+
+static INLINE void queue_init(State_machine_queue *const queue,
+    State_machine_event_node_release release)
+{
+    queue->stub.next = NULL;
+    queue->stub.event = 0;
+    queue->stub.event_data = NULL;
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
+    queue->release = release;
+}
+
+#ifndef __STDC_NO_ATOMICS__
+#define ATOMIC_NODE(n)                  \
+    ((_Atomic(State_machine_event_node *) *)(n))
+
+static INLINE void queue_push(State_machine_queue *const queue,
+    State_machine_event_node *const node)
+{
+    State_machine_event_node *previous;
+
+    atomic_store_explicit(ATOMIC_NODE(&node->next), NULL,
+        memory_order_relaxed);
+    previous = atomic_exchange_explicit(ATOMIC_NODE(&queue->head), node,
+        memory_order_acq_rel);
+    atomic_store_explicit(ATOMIC_NODE(&previous->next), node,
+        memory_order_release);
+}
+
+/* Only one thread of execution may call this at a time. Returns NULL if the
+ * queue is empty or if producer didn't finish linking its node yet.
+ */
+static INLINE State_machine_event_node *queue_pop(
+    State_machine_queue *const queue)
+{
+    State_machine_event_node *tail = queue->tail;
+    State_machine_event_node *next =
+        atomic_load_explicit(ATOMIC_NODE(&tail->next), memory_order_acquire);
+
+    if (tail == &queue->stub)
+    {
+        if (next == NULL)
+        {
+            return NULL;
+        }
+        queue->tail = next;
+        tail = next;
+        next = atomic_load_explicit(ATOMIC_NODE(&tail->next),
+            memory_order_acquire);
+    }
+
+    if (next != NULL)
+    {
+        queue->tail = next;
+
+        return tail;
+    }
+
+    if (tail != atomic_load_explicit(ATOMIC_NODE(&queue->head),
+        memory_order_acquire))
+    {
+        return NULL;
+    }
+
+    /* Tail is the last node, stub has to be put behind it so that tail can
+     * be removed.
+     */
+    queue_push(queue, &queue->stub);
+
+    next = atomic_load_explicit(ATOMIC_NODE(&tail->next), memory_order_acquire);
+    if (next != NULL)
+    {
+        queue->tail = next;
+
+        return tail;
+    }
+
+    return NULL;
+}
+
+/* Put "count" nodes, that were taken out by queue_pop() in order in which
+ * they are in "nodes", back to the front of the queue. Producers never touch
+ * such nodes, since queue_pop() doesn't return node that is the most
+ * recently posted one, therefore only consumer may call this.
+ */
+static INLINE void queue_unpop(State_machine_queue *const queue,
+    State_machine_event_node *const *const nodes,
+    const size_t count)
+{
+    for (size_t i = count; i > 0; i--)
+    {
+        atomic_store_explicit(ATOMIC_NODE(&nodes[i - 1]->next), queue->tail,
+            memory_order_relaxed);
+        queue->tail = nodes[i - 1];
+    }
+}
+
+/* True if there is no node in the queue, including one that a producer is
+ * still linking.
+ */
+static INLINE bool queue_empty(State_machine_queue *const queue)
+{
+    return queue->tail == &queue->stub
+        && atomic_load(ATOMIC_NODE(&queue->head)) == &queue->stub;
+}
+#endif
+
+#endif /* STATE_MACHINE_PRIVATE_H_247974569318769375053588401954258151908 */
@@ -0,0 +1,164 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-queue.h"
+#include "state-machine-private.h"
+
+void state_machine_init_queue(State_machine *const sm,
+    State_machine_queue *const queue,
+    State_machine_event_node_release release)
+{
+    ASSERT_NOT_NULL(sm);
+    ASSERT_NOT_NULL(queue);
+
+    queue_init(queue, release);
+    SM_QUEUE(sm) = queue;
+}
+
+uint32_t state_machine_post(State_machine *const sm,
+    State_machine_event_node *const node)
+{
+    ASSERT_NOT_NULL(sm);
+    ASSERT_NOT_NULL(SM_QUEUE(sm));
+    ASSERT_NOT_NULL(node);
+    assert(node->event < SM_MAX_EVENT(sm));
+
+#ifndef __STDC_NO_ATOMICS__
+    queue_push(SM_QUEUE(sm), node);
+
+    return STATE_MACHINE_SUCCESS;
+#else
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t state_machine_drain(State_machine *const sm,
+    const size_t max_events,
+    size_t *const drained)
+{
+    uint32_t ret = STATE_MACHINE_SUCCESS;
+    size_t done = 0;
+
+    ASSERT_NOT_NULL(sm);
+    ASSERT_NOT_NULL(SM_QUEUE(sm));
+
+#ifndef __STDC_NO_ATOMICS__
+    State_machine_queue *const queue = SM_QUEUE(sm);
+    State_machine_event_node *nodes[STATE_MACHINE_BATCH_SIZE];
+    uint32_t events[STATE_MACHINE_BATCH_SIZE];
+    void *event_data[STATE_MACHINE_BATCH_SIZE];
+    uint32_t results[STATE_MACHINE_BATCH_SIZE];
+
+    while (done < max_events)
+    {
+        size_t n = 0;
+
+        /* Nodes are taken out of the queue first so that whole chunk can be
+         * handled with one critical section.
+         */
+        while (n < STATE_MACHINE_BATCH_SIZE && done + n < max_events
+            && (nodes[n] = queue_pop(queue)) != NULL)
+        {
+            events[n] = nodes[n]->event;
+            event_data[n] = nodes[n]->event_data;
+            n++;
+        }
+        if (n == 0)
+        {
+            break;
+        }
+
+        size_t i = 0;
+
+        while (i < n)
+        {
+            size_t consumed;
+
+            /* Failure of transition function stops the batch, but posted
+             * events can't be refused by it, therefore we carry on with the
+             * rest. Return value also covers events raised by callbacks when
+             * run-to-completion queue is attached.
+             */
+            const uint32_t batch = state_machine_event_batch(sm, &events[i],
+                &event_data[i], n - i, &results[i], &consumed, 0);
+
+            if (consumed == 0)
+            {
+                /* Event was refused, e.g. run-to-completion queue is full
+                 * when drained from inside of a callback. It and those after
+                 * it stay in the queue, otherwise we would never finish.
+                 */
+                ret = batch;
+                break;
+            }
+
+            for (size_t j = i; j < i + consumed; j++)
+            {
+                if (is_sm_failure(results[j]) && is_sm_success(ret))
+                {
+                    ret = results[j];
+                }
+            }
+            if (is_sm_failure(batch) && is_sm_success(ret))
+            {
+                ret = batch;
+            }
+            i += consumed;
+        }
+
+        queue_unpop(queue, &nodes[i], n - i);
+
+        if (queue->release != NULL)
+        {
+            for (size_t j = 0; j < i; j++)
+            {
+                queue->release(sm, nodes[j]);
+            }
+        }
+
+        done += i;
+        if (i < n)
+        {
+            break;
+        }
+    }
+#else
+    ret = STATE_MACHINE_NOT_SUPPORTED;
+#endif
+
+    if (drained != NULL)
+    {
+        *drained = done;
+    }
+
+    return ret;
+}
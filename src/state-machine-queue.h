@@ -0,0 +1,169 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_QUEUE_H_286719483094772085410815514311011712858
+#define STATE_MACHINE_QUEUE_H_286719483094772085410815514311011712858
+
+#include "state-machine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Multi-producer single-consumer queue of events attached to a state
+ * machine. Producers post events without blocking each other and one
+ * consumer applies them in order. Queue is intrusive, i.e. nodes are
+ * allocated by application, usually as part of a bigger structure, so that
+ * no memory allocation is done by this library.
+ */
+
+/** Node of event queue.
+ *
+ * Node belongs to the queue from the moment it was posted until it is passed
+ * to release function after its event was handled.
+ */
+typedef struct State_machine_event_node_s
+{
+    /** Next node in the queue, it is accessed only using atomic operations.
+     */
+    struct State_machine_event_node_s *next;
+
+    /** Event that is sent to state machine.
+     */
+    uint32_t event;
+
+    /** Data associated with event, see <tt>state_machine_event()</tt>.
+     */
+    void *event_data;
+} State_machine_event_node;
+
+/** Function called for every node after its event was handled.
+ */
+typedef void (*State_machine_event_node_release)(struct State_machine_s *,
+    State_machine_event_node *);
+
+typedef struct State_machine_queue_s
+{
+    /** Most recently posted node, producers exchange it atomically.
+     */
+    State_machine_event_node *head;
+
+    /** Node that consumer will look at next.
+     */
+    State_machine_event_node *tail;
+
+    /** Node that is in the queue when there is nothing else to keep it
+     * consistent.
+     */
+    State_machine_event_node stub;
+
+    /** Called for every node after its event was handled. It may be NULL.
+     */
+    State_machine_event_node_release release;
+} State_machine_queue;
+
+/** Initialize event queue and attach it to a state machine.
+ *
+ * This has to be done before state machine is shared with other threads of
+ * execution.
+ *
+ * @param[in] state_machine
+ *   Initialized state machine.
+ *
+ * @param[in] queue
+ *   Queue storage allocated by caller. It has to stay valid for as long as
+ *   state machine is used.
+ *
+ * @param[in] release
+ *   Function called for every node after its event was handled. It may be
+ *   NULL.
+ */
+void state_machine_init_queue(State_machine *const state_machine,
+    State_machine_queue *const queue,
+    State_machine_event_node_release release);
+
+/** Append event to a queue of state machine.
+ *
+ * This operation is wait-free, it doesn't take state machine lock and
+ * multiple threads of execution may call it concurrently.
+ *
+ * @param[in] state_machine
+ *   State machine with queue attached using
+ *   <tt>state_machine_init_queue()</tt>.
+ *
+ * @param[in] node
+ *   Node with <tt>event</tt> and <tt>event_data</tt> filled in.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If compiler
+ *   doesn't support C11 atomic operations, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_post(State_machine *const state_machine,
+    State_machine_event_node *const node);
+
+/** Handle events posted to state machine.
+ *
+ * Only one thread of execution may drain the same state machine at a time.
+ * Events are handled in order in which they were posted, each one including
+ * its callbacks, in chunks using <tt>state_machine_event_batch()</tt>.
+ * Function returns when there are no more events in the queue, or when
+ * <tt>max_events</tt> were handled. Event that is being posted in parallel
+ * may be left in the queue for the next call.
+ *
+ * @param[in] state_machine
+ *   State machine with queue attached using
+ *   <tt>state_machine_init_queue()</tt>.
+ *
+ * @param[in] max_events
+ *   Upper bound on number of events handled by this call.
+ *
+ * @param[out] drained
+ *   Number of events handled by this call is stored here. It may be NULL.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. Otherwise it
+ *   returns first failure that event handling produced, which doesn't stop
+ *   handling of following events. Locking is always blocking. If event is
+ *   refused, e.g. with <tt>STATE_MACHINE_NO_SPACE</tt> when run-to-completion
+ *   queue is full, then handling stops, that failure is returned and the
+ *   event, along with those posted after it, stays in the queue.
+ */
+uint32_t state_machine_drain(State_machine *const state_machine,
+    const size_t max_events,
+    size_t *const drained);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_QUEUE_H_286719483094772085410815514311011712858 */
@@ -0,0 +1,65 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-private.h"
+#include "state-machine-rtc.h"
+
+void state_machine_init_rtc_queue(State_machine_rtc_queue *const queue,
+    State_machine_raised_event *const events,
+    const size_t size)
+{
+    ASSERT_NOT_NULL(queue);
+    ASSERT_NOT_NULL(events);
+    assert(size > 0 && (size & (size - 1)) == 0);
+
+    queue->events = events;
+    queue->size = size;
+    queue->head = 0;
+    queue->count = 0;
+    queue->owner = NULL;
+}
+
+uint32_t state_machine_attach_rtc_queue(State_machine *const sm,
+    State_machine_rtc_queue *const queue)
+{
+    ASSERT_NOT_NULL(sm);
+
+#ifdef HAVE_RTC_QUEUE
+    SM_RTC_QUEUE(sm) = queue;
+
+    return STATE_MACHINE_SUCCESS;
+#else
+    (void)queue;
+
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
@@ -0,0 +1,141 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_RTC_H_283773783364634721583175646956842824970
+#define STATE_MACHINE_RTC_H_283773783364634721583175646956842824970
+
+#include "state-machine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Run-to-completion processing of events raised by callbacks. When a
+ * run-to-completion queue is attached to a state machine, then the thread of
+ * execution that handles an event becomes owner of the queue until it
+ * returns from state_machine_event(). The same holds for
+ * state_machine_event_batch() and therefore for state_machine_drain(), whose
+ * callbacks all run before events they raised. Calls of
+ * state_machine_event() and state_machine_event_batch() made by the owner
+ * from inside of callbacks only append events to the queue and return
+ * immediately. After callback returns, the owner handles queued events
+ * in order, in chunks using state_machine_event_batch(), until the queue is
+ * empty.
+ */
+
+/** Event raised from inside of a callback.
+ */
+typedef struct
+{
+    uint32_t event;
+    void *event_data;
+} State_machine_raised_event;
+
+typedef struct State_machine_rtc_queue_s
+{
+    /** Ring buffer of <tt>size</tt> events.
+     */
+    State_machine_raised_event *events;
+
+    /** Number of events, it is a power of two.
+     */
+    size_t size;
+
+    /** Index of the oldest event.
+     */
+    size_t head;
+
+    /** Number of events in the queue.
+     */
+    size_t count;
+
+    /** Thread of execution that owns the queue, or NULL. It is accessed only
+     * using atomic operations.
+     */
+    void *owner;
+} State_machine_rtc_queue;
+
+/** Initialize run-to-completion queue.
+ *
+ * @param[in] queue
+ *   Storage allocated by caller.
+ *
+ * @param[in] events
+ *   Array of <tt>size</tt> events allocated by caller. It has to stay valid
+ *   for as long as queue is used.
+ *
+ * @param[in] size
+ *   Number of events, it has to be a power of two. It bounds number of
+ *   events that may be waiting to be handled at once.
+ */
+void state_machine_init_rtc_queue(State_machine_rtc_queue *const queue,
+    State_machine_raised_event *const events,
+    const size_t size);
+
+/** Attach run-to-completion queue to a state machine.
+ *
+ * This has to be done before state machine is shared with other threads of
+ * execution. While the queue is owned by one thread, events sent by other
+ * threads are handled as usual, and events they send from inside callbacks
+ * are handled by nested calls. Once attached, calls of
+ * <tt>state_machine_event()</tt> from callbacks of the owner return
+ * <tt>STATE_MACHINE_SUCCESS</tt> after appending event to the queue, or
+ * <tt>STATE_MACHINE_NO_SPACE</tt> if it's full, in which case
+ * <tt>state_machine_event_batch()</tt> reports events that did fit as
+ * consumed. Outermost call returns its own result, or the first failure of
+ * events that were raised while it was running. Raised event that is
+ * refused, e.g. because buffer of deferred callbacks is full, stays in the
+ * queue, along with those raised after it, and is handled by the next owner.
+ * Specialized variants, such as <tt>state_machine_event_table_lock()</tt>,
+ * don't use the queue and <tt>state_machine_event_handler()</tt> doesn't
+ * select them.
+ *
+ * @param[in] state_machine
+ *   Initialized state machine.
+ *
+ * @param[in] queue
+ *   Queue initialized using <tt>state_machine_init_rtc_queue()</tt>, or NULL
+ *   to detach queue that is currently attached.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If compiler
+ *   doesn't support C11 atomic operations or thread-local storage, then it
+ *   returns <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_attach_rtc_queue(State_machine *const state_machine,
+    State_machine_rtc_queue *const queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_RTC_H_283773783364634721583175646956842824970 */
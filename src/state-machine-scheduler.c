@@ -0,0 +1,200 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-private.h"
+#include "state-machine-scheduler.h"
+
+#ifndef __STDC_NO_ATOMICS__
+#define SCHEDULED(s)                    ((_Atomic uint32_t *)&(s)->scheduled)
+#define SHARD_BUSY(shard)               ((_Atomic uint32_t *)&(shard)->busy)
+
+/* Put state machine in to ready queue of its shard, unless it already is
+ * there or some worker is handling it.
+ */
+static void reschedule(State_machine_scheduled *const scheduled)
+{
+    /* Pairs with the fence in state_machine_scheduler_run(), either this
+     * sees that worker has finished, or worker sees the new event.
+     */
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_exchange(SCHEDULED(scheduled), 1) == 0)
+    {
+        queue_push(&scheduled->shard->ready, &scheduled->node);
+    }
+}
+
+/* Take state machine out of ready queue of a shard, or NULL if it is empty
+ * or some other worker is using it at the moment.
+ */
+static State_machine_scheduled *take(State_machine_shard *const shard)
+{
+    State_machine_event_node *node;
+
+    if (atomic_exchange_explicit(SHARD_BUSY(shard), 1, memory_order_acquire)
+        != 0)
+    {
+        return NULL;
+    }
+    node = queue_pop(&shard->ready);
+    atomic_store_explicit(SHARD_BUSY(shard), 0, memory_order_release);
+
+    /* Node is the first member of State_machine_scheduled. */
+    return (State_machine_scheduled *)node;
+}
+#endif
+
+void state_machine_init_scheduler(State_machine_scheduler *const scheduler,
+    State_machine_shard *const shards,
+    const uint32_t size,
+    const size_t quantum)
+{
+    ASSERT_NOT_NULL(scheduler);
+    ASSERT_NOT_NULL(shards);
+    assert(size > 0);
+    assert(quantum > 0);
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        queue_init(&shards[i].ready, NULL);
+        shards[i].busy = 0;
+    }
+    scheduler->shards = shards;
+    scheduler->size = size;
+    scheduler->quantum = quantum;
+}
+
+uint32_t state_machine_schedule(State_machine_scheduler *const scheduler,
+    State_machine_scheduled *const scheduled,
+    State_machine *const sm,
+    const uint32_t shard)
+{
+    ASSERT_NOT_NULL(scheduler);
+    ASSERT_NOT_NULL(scheduled);
+    ASSERT_NOT_NULL(sm);
+    ASSERT_NOT_NULL(SM_QUEUE(sm));
+    assert(shard < scheduler->size);
+
+#ifndef __STDC_NO_ATOMICS__
+    scheduled->node.next = NULL;
+    scheduled->node.event = 0;
+    scheduled->node.event_data = NULL;
+    scheduled->scheduled = 0;
+    scheduled->shard = &scheduler->shards[shard];
+    scheduled->state_machine = sm;
+
+    return STATE_MACHINE_SUCCESS;
+#else
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t state_machine_scheduler_post(State_machine_scheduled *const scheduled,
+    State_machine_event_node *const node)
+{
+    uint32_t ret;
+
+    ASSERT_NOT_NULL(scheduled);
+
+    if_sm_failure (ret = state_machine_post(scheduled->state_machine, node))
+    {
+        return ret;
+    }
+
+#ifndef __STDC_NO_ATOMICS__
+    reschedule(scheduled);
+#endif
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+uint32_t state_machine_scheduler_run(State_machine_scheduler *const scheduler,
+    const uint32_t worker,
+    const size_t max_turns,
+    size_t *const handled)
+{
+    uint32_t ret = STATE_MACHINE_SUCCESS;
+    size_t done = 0;
+
+    ASSERT_NOT_NULL(scheduler);
+
+#ifndef __STDC_NO_ATOMICS__
+    for (size_t turn = 0; turn < max_turns; turn++)
+    {
+        State_machine_scheduled *scheduled = NULL;
+        size_t drained;
+        uint32_t result;
+
+        /* Own shard first, then steal from the others. */
+        for (uint32_t i = 0; i < scheduler->size && scheduled == NULL; i++)
+        {
+            scheduled = take(
+                &scheduler->shards[(worker + i) % scheduler->size]);
+        }
+        if (scheduled == NULL)
+        {
+            break;
+        }
+
+        State_machine *const sm = scheduled->state_machine;
+
+        result = state_machine_drain(sm, scheduler->quantum, &drained);
+        if (is_sm_failure(result) && is_sm_success(ret))
+        {
+            ret = result;
+        }
+        done += drained;
+
+        /* Events posted from now on schedule state machine again. Those that
+         * were posted before are either in the queue, or their producer sees
+         * that it isn't scheduled any more.
+         */
+        atomic_store(SCHEDULED(scheduled), 0);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!queue_empty(SM_QUEUE(sm)))
+        {
+            reschedule(scheduled);
+        }
+    }
+#else
+    (void)worker;
+    (void)max_turns;
+    ret = STATE_MACHINE_NOT_SUPPORTED;
+#endif
+
+    if (handled != NULL)
+    {
+        *handled = done;
+    }
+
+    return ret;
+}
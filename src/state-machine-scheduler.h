@@ -0,0 +1,225 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_SCHEDULER_H_104546487660776875478054212631492406236
+#define STATE_MACHINE_SCHEDULER_H_104546487660776875478054212631492406236
+
+#include "state-machine.h"
+#include "state-machine-queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Scheduler that distributes handling of events posted to many state
+ * machines among worker threads of execution. Each state machine has its
+ * event queue, see state-machine-queue.h, and belongs to a shard. Posting an
+ * event to a state machine that had nothing to do puts it in to ready queue
+ * of its shard. Worker takes state machines out of ready queue of its own
+ * shard and drains their event queues, and if that is empty it steals whole
+ * state machines with their pending events from other shards.
+ *
+ * State machine is in at most one ready queue at a time and only the worker
+ * that took it out handles its events, therefore state machines that are
+ * used only through scheduler need no locking, i.e. they may be initialized
+ * with STATE_MACHINE_NO_LOCKING.
+ *
+ * Threads of execution are provided by application, which also decides on
+ * which processors they run, usually worker number i is pinned to a
+ * processor near the data of shard number i.
+ */
+
+/** Shard of state machines.
+ */
+typedef struct State_machine_shard_s
+{
+    /** State machines with pending events, see
+     * <tt>State_machine_scheduled</tt>.
+     */
+    State_machine_queue ready;
+
+    /** Set while a worker takes state machine out of ready queue. It is
+     * accessed only using atomic operations.
+     */
+    uint32_t busy;
+} State_machine_shard;
+
+typedef struct State_machine_scheduler_s
+{
+    /** Array of shards.
+     */
+    State_machine_shard *shards;
+
+    /** Number of shards.
+     */
+    uint32_t size;
+
+    /** Maximum number of events handled at once per state machine, before
+     * worker moves on to the next one.
+     */
+    size_t quantum;
+} State_machine_scheduler;
+
+/** State machine that is handled by scheduler.
+ */
+typedef struct State_machine_scheduled_s
+{
+    /** Link in ready queue of a shard. Its fields other then
+     * <tt>next</tt> aren't used.
+     */
+    State_machine_event_node node;
+
+    /** Nonzero from the moment state machine is put in to ready queue until
+     * worker finished handling its events. It is accessed only using atomic
+     * operations.
+     */
+    uint32_t scheduled;
+
+    /** Shard in to which state machine is put when it has pending events.
+     */
+    State_machine_shard *shard;
+
+    /** State machine with queue attached.
+     */
+    State_machine *state_machine;
+} State_machine_scheduled;
+
+/** Initialize scheduler.
+ *
+ * @param[in] scheduler
+ *   Storage allocated by caller.
+ *
+ * @param[in] shards
+ *   Array of <tt>size</tt> shards allocated by caller. It has to stay valid
+ *   for as long as scheduler is used.
+ *
+ * @param[in] size
+ *   Number of shards, at least one. Usually there is one shard per worker.
+ *
+ * @param[in] quantum
+ *   Maximum number of events handled at once per state machine, at least
+ *   one. Larger values amortize scheduling and smaller ones improve latency
+ *   of other state machines.
+ */
+void state_machine_init_scheduler(State_machine_scheduler *const scheduler,
+    State_machine_shard *const shards,
+    const uint32_t size,
+    const size_t quantum);
+
+/** Add state machine to a shard of scheduler.
+ *
+ * This has to be done before state machine is shared with other threads of
+ * execution. From then on events have to be posted using
+ * <tt>state_machine_scheduler_post()</tt> and queue of state machine must
+ * not be drained by anything else then scheduler.
+ *
+ * @param[in] scheduler
+ *   Initialized scheduler.
+ *
+ * @param[in] scheduled
+ *   Storage allocated by caller. It has to stay valid for as long as state
+ *   machine is used.
+ *
+ * @param[in] state_machine
+ *   State machine with queue attached using
+ *   <tt>state_machine_init_queue()</tt>.
+ *
+ * @param[in] shard
+ *   Index of shard smaller then <tt>size</tt> of scheduler.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If compiler
+ *   doesn't support C11 atomic operations, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_schedule(State_machine_scheduler *const scheduler,
+    State_machine_scheduled *const scheduled,
+    State_machine *const state_machine,
+    const uint32_t shard);
+
+/** Post event to a state machine that is handled by scheduler.
+ *
+ * This operation is lock-free and multiple threads of execution may call it
+ * concurrently, see <tt>state_machine_post()</tt>.
+ *
+ * @param[in] scheduled
+ *   State machine added using <tt>state_machine_schedule()</tt>.
+ *
+ * @param[in] node
+ *   Node with <tt>event</tt> and <tt>event_data</tt> filled in.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If compiler
+ *   doesn't support C11 atomic operations, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_scheduler_post(State_machine_scheduled *const scheduled,
+    State_machine_event_node *const node);
+
+/** Handle pending events of state machines that are ready.
+ *
+ * Called repeatedly by each worker thread of execution. Shard with the same
+ * index as worker, modulo number of shards, is looked at first and other
+ * shards are tried only when it is empty. State machine that still has
+ * pending events after its turn is put back in to its own shard.
+ *
+ * @param[in] scheduler
+ *   Initialized scheduler.
+ *
+ * @param[in] worker
+ *   Index of worker that calls this function.
+ *
+ * @param[in] max_turns
+ *   Upper bound on number of state machines handled by this call.
+ *
+ * @param[out] handled
+ *   Number of events handled by this call is stored here. It may be NULL.
+ *   When it is zero, then there was nothing to do and worker may wait for
+ *   more events in a way that application sees fit.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. Otherwise it
+ *   returns first failure that event handling produced, which doesn't stop
+ *   handling of following events, see <tt>state_machine_drain()</tt>. If
+ *   compiler doesn't support C11 atomic operations, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_scheduler_run(State_machine_scheduler *const scheduler,
+    const uint32_t worker,
+    const size_t max_turns,
+    size_t *const handled);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_SCHEDULER_H_104546487660776875478054212631492406236 */
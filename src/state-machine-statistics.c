@@ -0,0 +1,131 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Monotonic clock is a POSIX interface. */
+#define _POSIX_C_SOURCE 200809L
+
+#include "state-machine-private.h"
+#include "state-machine-statistics.h"
+#include <string.h>     /* memset() */
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+uint32_t state_machine_attach_statistics(State_machine *const sm,
+    State_machine_statistics *const statistics,
+    uint64_t *const cell_hits)
+{
+    ASSERT_NOT_NULL(sm);
+
+#ifdef STATE_MACHINE_STATISTICS
+    if (statistics != NULL)
+    {
+        memset(statistics, 0, sizeof(State_machine_statistics));
+        statistics->cell_hits = cell_hits;
+        if (cell_hits != NULL)
+        {
+            memset(cell_hits, 0, (size_t)SM_MAX_STATE(sm) * SM_MAX_EVENT(sm)
+                * sizeof(uint64_t));
+        }
+    }
+    SM_STATISTICS(sm) = statistics;
+
+    return STATE_MACHINE_SUCCESS;
+#else
+    (void)statistics;
+    (void)cell_hits;
+
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t state_machine_statistics_snapshot(State_machine *const sm,
+    State_machine_statistics *const snapshot)
+{
+    ASSERT_NOT_NULL(sm);
+    ASSERT_NOT_NULL(snapshot);
+
+#ifdef STATE_MACHINE_STATISTICS
+    State_machine_statistics *const statistics = SM_STATISTICS(sm);
+
+    if (statistics == NULL)
+    {
+        return STATE_MACHINE_NOT_SUPPORTED;
+    }
+
+    snapshot->events = STATISTICS_LOAD(statistics->events);
+    snapshot->undefined_transitions =
+        STATISTICS_LOAD(statistics->undefined_transitions);
+    for (size_t i = 0; i < STATE_MACHINE_HISTOGRAM_BUCKETS; i++)
+    {
+        snapshot->lock_wait[i] = STATISTICS_LOAD(statistics->lock_wait[i]);
+        snapshot->callback_duration[i] =
+            STATISTICS_LOAD(statistics->callback_duration[i]);
+    }
+
+    if (snapshot->cell_hits != NULL)
+    {
+        const size_t cells = (size_t)SM_MAX_STATE(sm) * SM_MAX_EVENT(sm);
+
+        for (size_t i = 0; i < cells; i++)
+        {
+            snapshot->cell_hits[i] = statistics->cell_hits == NULL
+                ? 0 : STATISTICS_LOAD(statistics->cell_hits[i]);
+        }
+    }
+
+    return STATE_MACHINE_SUCCESS;
+#else
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
+
+#ifdef STATE_MACHINE_STATISTICS
+uint64_t state_machine_statistics_now(void)
+{
+    struct timespec ts;
+
+    /* Wall clock may step backwards, in which case durations would end up
+     * in the last bucket of a histogram, therefore it is only a fallback.
+     */
+#if defined(_POSIX_MONOTONIC_CLOCK) && _POSIX_MONOTONIC_CLOCK >= 0
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+#endif
+    {
+        (void)timespec_get(&ts, TIME_UTC);
+    }
+
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+}
+#endif
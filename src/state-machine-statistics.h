@@ -0,0 +1,137 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_STATISTICS_H_105829417730962915043277216390834472519
+#define STATE_MACHINE_STATISTICS_H_105829417730962915043277216390834472519
+
+#include "state-machine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Instrumentation of state machines. Counters are updated only when library
+ * was compiled with STATE_MACHINE_STATISTICS macro defined, otherwise all of
+ * the instrumentation code is left out and attaching statistics fails.
+ *
+ * Counters are updated using relaxed atomic operations, therefore they don't
+ * impose any ordering on the rest of the code, and should be read using
+ * state_machine_statistics_snapshot().
+ */
+
+/** Number of buckets of histograms.
+ *
+ * Bucket 0 counts durations shorter then 1 ns, bucket <tt>i</tt> counts
+ * durations from interval [2^(i - 1), 2^i) ns and the last bucket counts
+ * everything that doesn't fit in to others.
+ */
+#define STATE_MACHINE_HISTOGRAM_BUCKETS     32
+
+typedef struct State_machine_statistics_s
+{
+    /** Number of events looked up in each cell of transition table.
+     *
+     * It is an array of <tt>max_state * max_event</tt> counters indexed by
+     * <tt>state * max_event + event</tt>, regardless of implementation that
+     * state machine uses. It may be NULL.
+     */
+    uint64_t *cell_hits;
+
+    /** Number of events that were looked up.
+     */
+    uint64_t events;
+
+    /** Number of events for which transition was undefined.
+     */
+    uint64_t undefined_transitions;
+
+    /** Histogram of time, in nanoseconds, spent waiting in <tt>take()</tt>.
+     */
+    uint64_t lock_wait[STATE_MACHINE_HISTOGRAM_BUCKETS];
+
+    /** Histogram of time, in nanoseconds, spent in callbacks, including
+     * transition cleanup function.
+     */
+    uint64_t callback_duration[STATE_MACHINE_HISTOGRAM_BUCKETS];
+} State_machine_statistics;
+
+/** Initialize statistics and attach them to a state machine.
+ *
+ * This has to be done before state machine is shared with other threads of
+ * execution.
+ *
+ * @param[in] state_machine
+ *   Initialized state machine.
+ *
+ * @param[in] statistics
+ *   Counters allocated by caller. It has to stay valid for as long as state
+ *   machine is used. If it is NULL, then statistics are detached.
+ *
+ * @param[in] cell_hits
+ *   Array of <tt>max_state * max_event</tt> counters or NULL if per-cell
+ *   counters aren't required.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If library
+ *   was compiled without <tt>STATE_MACHINE_STATISTICS</tt>, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_attach_statistics(State_machine *const state_machine,
+    State_machine_statistics *const statistics,
+    uint64_t *const cell_hits);
+
+/** Copy statistics of a state machine while it is running.
+ *
+ * Each counter is read atomically, but counters aren't read all at the same
+ * moment.
+ *
+ * @param[in] state_machine
+ *   State machine with statistics attached.
+ *
+ * @param[out] snapshot
+ *   Copy of counters. If its <tt>cell_hits</tt> isn't NULL, then it has to
+ *   point to an array of <tt>max_state * max_event</tt> elements in to which
+ *   per-cell counters are copied.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If there are
+ *   no statistics attached, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_statistics_snapshot(State_machine *const state_machine,
+    State_machine_statistics *const snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_STATISTICS_H_105829417730962915043277216390834472519 */
@@ -0,0 +1,205 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-private.h"
+#include "state-machine-swap.h"
+
+void state_machine_init_swap(State_machine_swap *const swap,
+    State_machine_retire retire,
+    void *const context)
+{
+    ASSERT_NOT_NULL(swap);
+
+    swap->readers[0] = 0;
+    swap->readers[1] = 0;
+    swap->generation = 0;
+    swap->retire = retire;
+    swap->context = context;
+    swap->state_machine = NULL;
+}
+
+uint32_t state_machine_attach_swap(State_machine *const sm,
+    State_machine_swap *const swap)
+{
+    ASSERT_NOT_NULL(sm);
+
+#ifndef __STDC_NO_ATOMICS__
+    if (!SM_USING_TRANSITION_TABLE(sm) && !SM_USING_COMPACT_TABLE(sm))
+    {
+        return STATE_MACHINE_NOT_SUPPORTED;
+    }
+    if (swap != NULL)
+    {
+        swap->state_machine = sm;
+    }
+    SM_SWAP(sm) = swap;
+
+    return STATE_MACHINE_SUCCESS;
+#else
+    (void)swap;
+
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
+
+#ifndef __STDC_NO_ATOMICS__
+static uint32_t replace(State_machine *const sm,
+    const State_machine_implementation *const impl,
+    const uint32_t *const remap,
+    const uint32_t flags)
+{
+    State_machine_swap *const swap = SM_SWAP(sm);
+    uint32_t ret;
+
+    if (swap == NULL || IMPL_TYPE(impl) != SM_TRANSITION_TYPE(sm)
+        || (SM_IS_LOCK_FREE(sm) && (remap != NULL
+            || (SM_USING_COMPACT_TABLE(sm) && IMPL(impl, compact).callbacks
+                != SM_TRANSITION_IMPL(sm, compact).callbacks))))
+    {
+        return STATE_MACHINE_NOT_SUPPORTED;
+    }
+
+    /* Only one replacement may be in progress, and it is finished when its
+     * old table is retired.
+     */
+    uint32_t word = atomic_load(SWAP_GENERATION(swap));
+
+    if (SWAP_PHASE(word) != SWAP_IDLE
+        || !atomic_compare_exchange_strong(SWAP_GENERATION(swap), &word,
+            word | SWAP_BUSY))
+    {
+        return STATE_MACHINE_WOULD_BLOCK;
+    }
+
+    /* {{{ Critical Section ************************************************ */
+
+    if_sm_failure (ret = lock_take(sm, flags))
+    {
+        atomic_store(SWAP_GENERATION(swap), word);
+
+        return ret;
+    }
+
+    swap->previous = SM_TRANSITION(sm);
+    if (SM_IS_LOCK_FREE(sm) && SM_USING_COMPACT_TABLE(sm))
+    {
+        atomic_store_explicit(
+            (_Atomic(const State_machine_compact_transition *) *)
+                &SM_TRANSITION_IMPL(sm, compact).table,
+            IMPL(impl, compact).table, memory_order_release);
+    }
+    else if (SM_IS_LOCK_FREE(sm))
+    {
+        atomic_store_explicit(
+            (_Atomic(State_machine_transition *) *)
+                &SM_TRANSITION_IMPL(sm, table),
+            IMPL(impl, table), memory_order_release);
+    }
+    else
+    {
+        SM_TRANSITION(sm) = *impl;
+        if (remap != NULL)
+        {
+            assert(remap[SM_CURRENT_STATE(sm)] < SM_MAX_STATE(sm));
+            SM_CURRENT_STATE(sm) = remap[SM_CURRENT_STATE(sm)];
+        }
+    }
+
+    lock_give(sm);
+
+    /* }}} Critical Section ************************************************ */
+
+    /* Calls that start from now on are readers of new generation. Those that
+     * might have seen the old table are counted in readers of this one.
+     */
+    const uint32_t pending =
+        (word + (UINT32_C(1) << SWAP_PHASE_BITS)) | SWAP_PENDING;
+
+    atomic_store(SWAP_GENERATION(swap), pending);
+    if (atomic_load(SWAP_READERS(swap, SWAP_INDEX(word))) == 0)
+    {
+        swap_retire(swap, pending);
+    }
+
+    return STATE_MACHINE_SUCCESS;
+}
+#endif
+
+uint32_t state_machine_replace_table(State_machine *const sm,
+    State_machine_transition *const table,
+    const uint32_t *const remap,
+    const uint32_t flags)
+{
+    ASSERT_NOT_NULL(sm);
+    ASSERT_NOT_NULL(table);
+
+#ifndef __STDC_NO_ATOMICS__
+    const State_machine_implementation impl =
+    {
+        .type = STATE_MACHINE_USING_TABLE,
+        .implementation.table = table
+    };
+
+    return replace(sm, &impl, remap, flags);
+#else
+    (void)remap;
+    (void)flags;
+
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t state_machine_replace_compact_table(State_machine *const sm,
+    const State_machine_compact_transition *const table,
+    const State_machine_compact_callback *const callbacks,
+    const uint32_t *const remap,
+    const uint32_t flags)
+{
+    ASSERT_NOT_NULL(sm);
+    ASSERT_NOT_NULL(table);
+    ASSERT_NOT_NULL(callbacks);
+
+#ifndef __STDC_NO_ATOMICS__
+    const State_machine_implementation impl =
+    {
+        .type = STATE_MACHINE_USING_COMPACT_TABLE,
+        .implementation.compact = {.table = table, .callbacks = callbacks}
+    };
+
+    return replace(sm, &impl, remap, flags);
+#else
+    (void)remap;
+    (void)flags;
+
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
@@ -0,0 +1,185 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_SWAP_H_68313778895995402908708356066977555542
+#define STATE_MACHINE_SWAP_H_68313778895995402908708356066977555542
+
+#include "state-machine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Replacement of transition table of a state machine that is in use, in the
+ * manner of read-copy-update. New table is published at once and events
+ * handled after that use it, while those that are already being handled
+ * finish with the old one. Each call that uses transition table, e.g.
+ * state_machine_event(), counts itself as a reader of current generation.
+ * Replacement starts new generation and old table is retired, by calling
+ * application-provided function, after the last reader of previous
+ * generation has left. Nothing waits for that, it is done either by
+ * state_machine_replace_table() itself or by the thread of execution of the
+ * last reader, on its way out.
+ */
+
+/** Function called when table that was replaced isn't used any more, e.g.
+ * to free it. It gets copy of implementation as it was before replacement.
+ * It must not replace table of the same state machine.
+ */
+typedef void (*State_machine_retire)(State_machine *state_machine,
+    const State_machine_implementation *previous, void *context);
+
+typedef struct State_machine_swap_s
+{
+    /** Number of readers of each of the last two generations. It is accessed
+     * only using atomic operations.
+     */
+    uint32_t readers[2];
+
+    /** Generation and phase of the latest replacement. It is accessed only
+     * using atomic operations.
+     */
+    uint32_t generation;
+
+    /** Implementation that waits to be retired.
+     */
+    State_machine_implementation previous;
+
+    /** Called when previous implementation isn't used any more. It may be
+     * NULL, e.g. when tables are never freed.
+     */
+    State_machine_retire retire;
+
+    /** Passed to <tt>retire</tt>.
+     */
+    void *context;
+
+    /** State machine to which this is attached.
+     */
+    State_machine *state_machine;
+} State_machine_swap;
+
+/** Initialize table swap.
+ *
+ * @param[in] swap
+ *   Storage allocated by caller.
+ *
+ * @param[in] retire
+ *   Function called when replaced table may be freed. It may be NULL.
+ *
+ * @param[in] context
+ *   Passed to <tt>retire</tt>.
+ */
+void state_machine_init_swap(State_machine_swap *const swap,
+    State_machine_retire retire,
+    void *const context);
+
+/** Attach table swap to a state machine.
+ *
+ * This has to be done before state machine is shared with other threads of
+ * execution. Once attached, every call that uses transition table pays two
+ * atomic operations for being counted as a reader. Specialized variants,
+ * such as <tt>state_machine_event_table_lock()</tt>, don't count themselves
+ * and <tt>state_machine_event_handler()</tt> doesn't select them.
+ *
+ * @param[in] state_machine
+ *   State machine that uses transition table or compact transition table.
+ *
+ * @param[in] swap
+ *   Table swap initialized using <tt>state_machine_init_swap()</tt>, or NULL
+ *   to detach the one that is currently attached.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If state
+ *   machine uses other implementation, or compiler doesn't support C11
+ *   atomic operations, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_attach_swap(State_machine *const state_machine,
+    State_machine_swap *const swap);
+
+/** Replace transition table of a state machine that has table swap
+ * attached.
+ *
+ * New table has the same dimensions as the old one. Current state is
+ * translated using <tt>remap</tt> at the same moment when new table is
+ * published, i.e. inside critical section. Timeouts attached using
+ * <tt>state_machine_attach_timer()</tt> aren't translated.
+ *
+ * @param[in] state_machine
+ *   State machine that uses transition table.
+ *
+ * @param[in] table
+ *   New transition table.
+ *
+ * @param[in] remap
+ *   Array of <tt>max_state</tt> entries that maps states of old table in to
+ *   states of new table. It may be NULL if states weren't renumbered, and it
+ *   has to be NULL if state machine is lock-free.
+ *
+ * @param[in] flags
+ *   Same as for <tt>state_machine_event()</tt>.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If the
+ *   previous replacement didn't retire old table yet, or flags have
+ *   <tt>STATE_MACHINE_NONBLOCK</tt> bit set and function was unable to
+ *   acquire lock, then it returns <tt>STATE_MACHINE_WOULD_BLOCK</tt>. If
+ *   state machine doesn't have table swap attached, uses other
+ *   implementation, or is lock-free and <tt>remap</tt> isn't NULL, then it
+ *   returns <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_replace_table(State_machine *const state_machine,
+    State_machine_transition *const table,
+    const uint32_t *const remap,
+    const uint32_t flags);
+
+/** Replace compact transition table of a state machine that has table swap
+ * attached.
+ *
+ * Behaves as <tt>state_machine_replace_table()</tt> does, except that state
+ * machine that is lock-free has to keep its array of callbacks, i.e.
+ * <tt>callbacks</tt> has to be the same as the current one, otherwise
+ * <tt>STATE_MACHINE_NOT_SUPPORTED</tt> is returned.
+ */
+uint32_t state_machine_replace_compact_table(
+    State_machine *const state_machine,
+    const State_machine_compact_transition *const table,
+    const State_machine_compact_callback *const callbacks,
+    const uint32_t *const remap,
+    const uint32_t flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_SWAP_H_68313778895995402908708356066977555542 */
@@ -0,0 +1,154 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-private.h"
+#include "state-machine-timer.h"
+#include <string.h>     /* memset() */
+
+void state_machine_init_wheel(State_machine_wheel *const wheel,
+    const uint64_t now)
+{
+    ASSERT_NOT_NULL(wheel);
+
+    memset(wheel, 0, sizeof(State_machine_wheel));
+    wheel->now = now;
+}
+
+void state_machine_attach_timer(State_machine *const sm,
+    State_machine_wheel *const wheel,
+    State_machine_timer *const timer,
+    const State_machine_timeout *const timeouts)
+{
+    ASSERT_NOT_NULL(sm);
+
+    if (SM_TIMER(sm) != NULL)
+    {
+        wheel_remove(SM_TIMER(sm)->wheel, SM_TIMER(sm));
+        SM_TIMER(sm) = NULL;
+    }
+    if (wheel == NULL)
+    {
+        return;
+    }
+
+    ASSERT_NOT_NULL(timer);
+    ASSERT_NOT_NULL(timeouts);
+
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->state_machine = sm;
+    timer->wheel = wheel;
+    timer->timeouts = timeouts;
+    SM_TIMER(sm) = timer;
+
+    timer_enter(timer, SM_CURRENT_STATE(sm));
+}
+
+/* Move timers from a slot of higher level to lower levels, now that they are
+ * closer to their expiration.
+ */
+static void wheel_cascade(State_machine_wheel *const wheel,
+    State_machine_timer **const slot)
+{
+    State_machine_timer *timer;
+
+    while ((timer = *slot) != NULL)
+    {
+        wheel_remove(wheel, timer);
+        wheel_insert(wheel, timer);
+    }
+}
+
+uint32_t state_machine_wheel_advance(State_machine_wheel *const wheel,
+    const uint64_t now,
+    size_t *const fired)
+{
+    uint32_t ret = STATE_MACHINE_SUCCESS;
+    size_t done = 0;
+
+    ASSERT_NOT_NULL(wheel);
+
+    while (wheel->now < now)
+    {
+        if (wheel->count == 0)
+        {
+            /* Nothing can expire, therefore ticks don't have to be visited
+             * one by one.
+             */
+            wheel->now = now;
+            break;
+        }
+
+        const uint64_t tick = ++wheel->now;
+
+        for (uint32_t level = 1; level < STATE_MACHINE_WHEEL_LEVELS; level++)
+        {
+            const uint32_t shift = STATE_MACHINE_WHEEL_BITS * level;
+
+            if ((tick & ((UINT64_C(1) << shift) - 1)) != 0)
+            {
+                break;
+            }
+            wheel_cascade(wheel, &wheel->slots[level][
+                (tick >> shift) & (STATE_MACHINE_WHEEL_SLOTS - 1)]);
+        }
+
+        State_machine_timer **const slot =
+            &wheel->slots[0][tick & (STATE_MACHINE_WHEEL_SLOTS - 1)];
+        State_machine_timer *timer;
+
+        /* Timers are taken one by one, since handling of timeout event may
+         * cancel or arm other timers, but those are never armed for the
+         * current tick, since durations are greater then zero.
+         */
+        while ((timer = *slot) != NULL)
+        {
+            wheel_remove(wheel, timer);
+
+            const uint32_t r = state_machine_event(timer->state_machine,
+                timer->event, NULL, 0);
+
+            if (is_sm_failure(r) && is_sm_success(ret))
+            {
+                ret = r;
+            }
+            done++;
+        }
+    }
+
+    if (fired != NULL)
+    {
+        *fired = done;
+    }
+
+    return ret;
+}
@@ -0,0 +1,184 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_TIMER_H_178826553483342410801075784331408532849
+#define STATE_MACHINE_TIMER_H_178826553483342410801075784331408532849
+
+#include "state-machine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Per-state timeouts. Each state may declare a timeout event and duration.
+ * When state machine with a timer attached enters such state, its timer is
+ * armed in a hierarchical timing wheel, and when it leaves the state before
+ * the timeout expires, the timer is cancelled in constant time. Time is
+ * measured in ticks of arbitrary length and it is advanced by caller, which
+ * sends timeout events of all expired timers.
+ *
+ * Timing wheel isn't protected by any lock. Wheel and all state machines that
+ * have their timers in it have to be used by one thread of execution at a
+ * time, e.g. one wheel per event loop.
+ */
+
+#define STATE_MACHINE_WHEEL_BITS    8
+#define STATE_MACHINE_WHEEL_SLOTS   (1 << STATE_MACHINE_WHEEL_BITS)
+
+/** Number of levels of timing wheel. Timers may expire up to
+ * <tt>2^(STATE_MACHINE_WHEEL_BITS * STATE_MACHINE_WHEEL_LEVELS)</tt> ticks in
+ * to the future, timers that expire later are cascaded until they fit.
+ */
+#define STATE_MACHINE_WHEEL_LEVELS  4
+
+/** Timeout of a state.
+ */
+typedef struct
+{
+    /** Number of ticks after which <tt>event</tt> is sent, zero means that
+     * state has no timeout.
+     */
+    uint64_t duration;
+
+    uint32_t event;
+} State_machine_timeout;
+
+/** Timer of a state machine, it is allocated by caller.
+ */
+typedef struct State_machine_timer_s
+{
+    /** Next timer in the same slot of timing wheel.
+     */
+    struct State_machine_timer_s *next;
+
+    /** Pointer that points to this timer, or NULL if timer isn't armed.
+     */
+    struct State_machine_timer_s **pprev;
+
+    /** Tick at which timer expires.
+     */
+    uint64_t expires;
+
+    /** Event sent when timer expires.
+     */
+    uint32_t event;
+
+    struct State_machine_s *state_machine;
+    struct State_machine_wheel_s *wheel;
+
+    /** Array of timeouts indexed by state.
+     */
+    const State_machine_timeout *timeouts;
+} State_machine_timer;
+
+typedef struct State_machine_wheel_s
+{
+    /** Last tick that was processed.
+     */
+    uint64_t now;
+
+    /** Number of armed timers.
+     */
+    size_t count;
+
+    State_machine_timer *slots[STATE_MACHINE_WHEEL_LEVELS]
+        [STATE_MACHINE_WHEEL_SLOTS];
+} State_machine_wheel;
+
+/** Initialize timing wheel.
+ *
+ * @param[in] wheel
+ *   Storage allocated by caller.
+ *
+ * @param[in] now
+ *   Current tick.
+ */
+void state_machine_init_wheel(State_machine_wheel *const wheel,
+    const uint64_t now);
+
+/** Attach timer to a state machine and arm it for its current state.
+ *
+ * Whenever state machine makes a transition, including transition in to the
+ * same state, its timer is cancelled and armed again for the state it
+ * entered, relative to the last tick processed by
+ * <tt>state_machine_wheel_advance()</tt>. Specialized variants, such as
+ * <tt>state_machine_event_table_lock()</tt>, don't do that and
+ * <tt>state_machine_event_handler()</tt> doesn't select them.
+ *
+ * @param[in] state_machine
+ *   Initialized state machine.
+ *
+ * @param[in] wheel
+ *   Initialized timing wheel, or NULL to cancel and detach timer that is
+ *   currently attached.
+ *
+ * @param[in] timer
+ *   Storage allocated by caller. It has to stay valid for as long as it is
+ *   attached.
+ *
+ * @param[in] timeouts
+ *   Array of <tt>max_state</tt> timeouts, one for each state.
+ */
+void state_machine_attach_timer(State_machine *const state_machine,
+    State_machine_wheel *const wheel,
+    State_machine_timer *const timer,
+    const State_machine_timeout *const timeouts);
+
+/** Advance timing wheel and send timeout events of expired timers.
+ *
+ * Events are sent using <tt>state_machine_event()</tt> in order of
+ * expiration, timers that expire at the same tick are in no particular
+ * order.
+ *
+ * @param[in] wheel
+ *   Initialized timing wheel.
+ *
+ * @param[in] now
+ *   Current tick. Nothing happens if it isn't greater then the last one.
+ *
+ * @param[out] fired
+ *   Number of timeout events sent is stored here. It may be NULL.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. Otherwise it
+ *   returns first failure of timeout events, which doesn't stop sending of
+ *   the following ones. Locking is always blocking.
+ */
+uint32_t state_machine_wheel_advance(State_machine_wheel *const wheel,
+    const uint64_t now,
+    size_t *const fired);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_TIMER_H_178826553483342410801075784331408532849 */
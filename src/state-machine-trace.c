@@ -0,0 +1,170 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state-machine-private.h"
+#include "state-machine-trace.h"
+#include <time.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+uint64_t state_machine_trace_timestamp(void)
+{
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    (void)timespec_get(&ts, TIME_UTC);
+
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+void state_machine_init_trace(State_machine_trace *const trace,
+    State_machine_trace_record *const records,
+    const size_t size,
+    State_machine_trace_clock clock)
+{
+    ASSERT_NOT_NULL(trace);
+    ASSERT_NOT_NULL(records);
+    assert(size > 0 && (size & (size - 1)) == 0);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        records[i].sequence = 0;
+    }
+
+    trace->records = records;
+    trace->size = size;
+    trace->written = 0;
+    trace->clock = clock;
+}
+
+uint32_t state_machine_attach_trace(State_machine *const sm,
+    State_machine_trace *const trace)
+{
+    ASSERT_NOT_NULL(sm);
+
+#ifndef __STDC_NO_ATOMICS__
+    SM_TRACE(sm) = trace;
+
+    return STATE_MACHINE_SUCCESS;
+#else
+    (void)trace;
+
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t state_machine_fleet_attach_trace(State_machine_fleet *const fleet,
+    State_machine_trace *const trace)
+{
+    ASSERT_NOT_NULL(fleet);
+
+#ifndef __STDC_NO_ATOMICS__
+    FLEET_TRACE(fleet) = trace;
+
+    return STATE_MACHINE_SUCCESS;
+#else
+    (void)trace;
+
+    return STATE_MACHINE_NOT_SUPPORTED;
+#endif
+}
+
+#ifndef __STDC_NO_ATOMICS__
+#define TRACE_LOAD_32(field)    \
+    atomic_load_explicit((_Atomic uint32_t *)&(field), memory_order_relaxed)
+#define TRACE_LOAD_64(field)    \
+    atomic_load_explicit((_Atomic uint64_t *)&(field), memory_order_relaxed)
+#endif
+
+size_t state_machine_trace_snapshot(State_machine_trace *const trace,
+    State_machine_trace_record *const records,
+    const size_t max_records)
+{
+    size_t n = 0;
+
+    ASSERT_NOT_NULL(trace);
+    assert(max_records == 0 || records != NULL);
+
+#ifndef __STDC_NO_ATOMICS__
+    const uint64_t written = atomic_load_explicit(
+        (_Atomic uint64_t *)&trace->written, memory_order_acquire);
+    uint64_t available = written < trace->size ? written : trace->size;
+
+    if (available > max_records)
+    {
+        available = max_records;
+    }
+
+    for (uint64_t sequence = written - available + 1; sequence <= written;
+        sequence++)
+    {
+        State_machine_trace_record *const record =
+            &trace->records[(sequence - 1) & (trace->size - 1)];
+        State_machine_trace_record *const copy = &records[n];
+
+        /* Record is valid only if its sequence number was the same before
+         * and after its content was copied. Writer sets it to zero before it
+         * starts changing the record.
+         */
+        if (atomic_load_explicit((_Atomic uint64_t *)&record->sequence,
+            memory_order_acquire) != sequence)
+        {
+            continue;
+        }
+
+        copy->sequence = sequence;
+        copy->timestamp = TRACE_LOAD_64(record->timestamp);
+        copy->instance = TRACE_LOAD_32(record->instance);
+        copy->cause = TRACE_LOAD_32(record->cause);
+        copy->previous_state = TRACE_LOAD_32(record->previous_state);
+        copy->next_state = TRACE_LOAD_32(record->next_state);
+        copy->is_transition = TRACE_LOAD_32(record->is_transition);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (TRACE_LOAD_64(record->sequence) == sequence)
+        {
+            n++;
+        }
+    }
+#else
+    (void)records;
+    (void)max_records;
+#endif
+
+    return n;
+}
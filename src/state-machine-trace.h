@@ -0,0 +1,199 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_TRACE_H_318302741914839672032138033737295130141
+#define STATE_MACHINE_TRACE_H_318302741914839672032138033737295130141
+
+#include "state-machine.h"
+#include "state-machine-fleet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Ring buffer of most recent steps of a state machine, or a fleet of them,
+ * intended for post-mortem debugging. Records are written without taking any
+ * lock, oldest records are overwritten, and the buffer can be copied by
+ * another thread of execution while state machine is running.
+ */
+
+/** One step of state machine.
+ *
+ * All fields are accessed only using atomic operations while record is part
+ * of a trace.
+ */
+typedef struct
+{
+    /** Position of record in the sequence of all records written in to a
+     * trace, starting with 1. Zero means that record is empty or that it is
+     * being written.
+     */
+    uint64_t sequence;
+
+    /** Value returned by clock function of the trace, or zero if there is
+     * none.
+     */
+    uint64_t timestamp;
+
+    /** Index of fleet instance, zero for <tt>State_machine</tt>.
+     */
+    uint32_t instance;
+
+    /** Event that caused this step.
+     */
+    uint32_t cause;
+
+    /** State in which state machine was when event arrived.
+     */
+    uint32_t previous_state;
+
+    /** State in which state machine ended up, which is the same as
+     * <tt>previous_state</tt> if transition was undefined.
+     */
+    uint32_t next_state;
+
+    /** Non-zero if transition was defined.
+     */
+    uint32_t is_transition;
+} State_machine_trace_record;
+
+/** Function that provides timestamps of trace records.
+ */
+typedef uint64_t (*State_machine_trace_clock)(void);
+
+typedef struct State_machine_trace_s
+{
+    /** Array of <tt>size</tt> records.
+     */
+    State_machine_trace_record *records;
+
+    /** Number of records, it is a power of two.
+     */
+    size_t size;
+
+    /** Number of records written so far, accessed only using atomic
+     * operations.
+     */
+    uint64_t written;
+
+    /** Source of timestamps. It may be NULL.
+     */
+    State_machine_trace_clock clock;
+} State_machine_trace;
+
+/** Fast monotonic timestamp suitable as clock of a trace.
+ *
+ * It is value of time stamp counter on x86 and nanoseconds elsewhere.
+ */
+uint64_t state_machine_trace_timestamp(void);
+
+/** Initialize trace.
+ *
+ * @param[in] trace
+ *   Trace storage allocated by caller.
+ *
+ * @param[in] records
+ *   Array of <tt>size</tt> records allocated by caller. It has to stay valid
+ *   for as long as trace is used.
+ *
+ * @param[in] size
+ *   Number of records, it has to be a power of two. It should be considerably
+ *   greater then number of threads of execution that send events to the
+ *   state machine at the same time, otherwise they may overwrite each
+ *   other's records.
+ *
+ * @param[in] clock
+ *   Source of timestamps, e.g. <tt>state_machine_trace_timestamp()</tt>. It
+ *   may be NULL, in which case timestamps are zero.
+ */
+void state_machine_init_trace(State_machine_trace *const trace,
+    State_machine_trace_record *const records,
+    const size_t size,
+    State_machine_trace_clock clock);
+
+/** Attach trace to a state machine.
+ *
+ * This has to be done before state machine is shared with other threads of
+ * execution. Every step done by <tt>state_machine_event()</tt> or
+ * <tt>state_machine_event_batch()</tt> is then recorded.
+ *
+ * @param[in] state_machine
+ *   Initialized state machine.
+ *
+ * @param[in] trace
+ *   Initialized trace or NULL to detach it.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If compiler
+ *   doesn't support C11 atomic operations, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_attach_trace(State_machine *const state_machine,
+    State_machine_trace *const trace);
+
+/** Attach trace to a fleet of state machines.
+ *
+ * Same as <tt>state_machine_attach_trace()</tt>, but records steps of all
+ * instances done by <tt>state_machine_fleet_event()</tt> and
+ * <tt>state_machine_fleet_step()</tt>. Latter doesn't use vector
+ * instructions while trace is attached.
+ */
+uint32_t state_machine_fleet_attach_trace(State_machine_fleet *const fleet,
+    State_machine_trace *const trace);
+
+/** Copy most recent records of a trace.
+ *
+ * It may be called by any thread of execution at any time, records that are
+ * being overwritten while they are copied are skipped.
+ *
+ * @param[in] trace
+ *   Initialized trace.
+ *
+ * @param[out] records
+ *   Array of at least <tt>max_records</tt> elements. Records are stored in it
+ *   from the oldest to the most recent one.
+ *
+ * @param[in] max_records
+ *   Maximal number of records to copy.
+ *
+ * @return
+ *   Number of records that were copied.
+ */
+size_t state_machine_trace_snapshot(State_machine_trace *const trace,
+    State_machine_trace_record *const records,
+    const size_t max_records);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATE_MACHINE_TRACE_H_318302741914839672032138033737295130141 */
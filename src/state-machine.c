@@ -30,52 +30,15 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include "state-machine.h"
-#include <assert.h>
+#include "state-machine-private.h"
 #include <string.h>     /* memset() */
 
-#if __STDC_VERSION__ >= 199901L
-/* Standards C99 and C11 understand "inline" keyword. */
-#define INLINE inline
-#else
-#define INLINE
-#endif
-
-/* Accessors for State_machine */
-#define SM_MAX_STATE(sm)                (sm->max_state)
-#define SM_MAX_EVENT(sm)                (sm->max_event)
-#define SM_CURRENT_STATE(sm)            (sm->current_state)
-#define SM_LOCK(sm)                     (sm->lock)
-#define SM_DATA(sm)                     (sm->data)
-#define SM_TRANSITION(sm)               (sm->transition)
-#define SM_USING_TRANSITION_TABLE(sm)   (SM_TRANSITION(sm).using_table)
-#define SM_TRANSITION_IMPL(sm, it)      (SM_TRANSITION(sm).implementation.it)
-
-/* Accessors for State_machine_transition */
-#define IS_TRANSITION(t)                (t->is_transition)
-#define RESULT_TRANSITION(t)            (t->result.transition)
-#define RESULT_NO_TRANSITION(t)         (t->result.no_transition)
-
-/* In this macros we assume that caller will check if sm != NULL and if locking
- * is defined consistently.
- */
-#define USE_LOCKING(sm)                 (SM_LOCK(sm).take != NULL)
-
-/* Either our implementation supports locking or not, there is no middle
- * ground.
- */
-#define ASSERT_LOCKING_DEFINITION_CONSISTENCY(lock)                           \
-    assert((lock.take == NULL && lock.try_take == NULL && lock.give == NULL)  \
-        || (lock.take != NULL && lock.try_take != NULL && lock.give != NULL))
-
-#define ASSERT_NOT_NULL(x)              assert(x != NULL)
-
 static INLINE void state_machine_init_common(State_machine *const sm,
     const uint32_t max_state,
     const uint32_t max_event,
     const uint32_t init_state,
     State_machine_locking lock,
-    bool using_transition_table,
+    const uint32_t transition_type,
     void *const data)
 {
     /* Pointer "data" may be NULL, since it is completely out of control of
@@ -85,14 +48,14 @@ static INLINE void state_machine_init_common(State_machine *const sm,
     assert(max_state > 0);
     assert(max_event > 0);
     assert(init_state < max_state);
-    ASSERT_LOCKING_DEFINITION_CONSISTENCY(SM_LOCK(sm));
+    ASSERT_LOCKING_DEFINITION_CONSISTENCY(lock);
 
     memset(sm, 0, sizeof(State_machine));
     SM_MAX_STATE(sm) = max_state;
     SM_MAX_EVENT(sm) = max_event;
     SM_CURRENT_STATE(sm) = init_state;
     SM_LOCK(sm) = lock;
-    SM_USING_TRANSITION_TABLE(sm) = using_transition_table;
+    SM_TRANSITION_TYPE(sm) = transition_type;
     SM_DATA(sm) = data;
 }
 
@@ -107,245 +70,1553 @@ void state_machine_init_table(State_machine *const sm,
     ASSERT_NOT_NULL(transition_table);
 
     state_machine_init_common(sm, max_state, max_event, init_state, locking,
-        true, data);
+        STATE_MACHINE_USING_TABLE, data);
     SM_TRANSITION_IMPL(sm, table) = transition_table;
 }
 
-void state_machine_init_function(State_machine *const sm,
+void state_machine_init_compact_table(State_machine *const sm,
     const uint32_t max_state,
     const uint32_t max_event,
     const uint32_t init_state,
     State_machine_locking locking,
-    State_machine_transition_function transition,
-    State_machine_transition_cleanup_function cleanup,
+    const State_machine_compact_transition *transition_table,
+    const State_machine_compact_callback *callbacks,
     void *const data)
 {
-    /* Note: Function cleanup may be NULL if no cleanup is necessary and that
-     * is why there is no assert(cleanup != NULL)".
-     */
-    ASSERT_NOT_NULL(transition);
+    ASSERT_NOT_NULL(transition_table);
+    ASSERT_NOT_NULL(callbacks);
+    assert(max_state <= STATE_MACHINE_COMPACT_MAX_STATE);
 
     state_machine_init_common(sm, max_state, max_event, init_state, locking,
-        false, data);
-    SM_TRANSITION_IMPL(sm, function).transition = transition;
-    SM_TRANSITION_IMPL(sm, function).cleanup = cleanup;
+        STATE_MACHINE_USING_COMPACT_TABLE, data);
+    SM_TRANSITION_IMPL(sm, compact).table = transition_table;
+    SM_TRANSITION_IMPL(sm, compact).callbacks = callbacks;
 }
 
-/* Internal wrapper for take() and try_take() locking operations. Please bear
- * in mind that return value indicates if code is in ciritical section or not.
+/* Find callback in the first "count" entries of "callbacks" or append it if
+ * it is not there. Returns index of the callback or "max_callbacks" if there
+ * is no space left.
  */
-static INLINE uint32_t lock_take(State_machine *const sm, const uint32_t flags)
+static uint32_t compact_callback_index(
+    State_machine_compact_callback *const callbacks,
+    uint32_t *const count,
+    const uint32_t max_callbacks,
+    const State_machine_compact_callback callback)
 {
-    /* Function that calls this has to check that value of sm is not NULL.
-     */
-    ASSERT_LOCKING_DEFINITION_CONSISTENCY(SM_LOCK(sm));
+    if (callback.on_enter == NULL && callback.on_undefined_transition == NULL)
+    {
+        return 0;
+    }
 
-    if (USE_LOCKING(sm))
+    for (uint32_t i = 1; i < *count; i++)
     {
-        if (flags & STATE_MACHINE_NONBLOCK)
-        {
-            if (!SM_LOCK(sm).try_take(sm))
-            {
-                return STATE_MACHINE_WOULD_BLOCK;
-            }
-        }
-        else
+        if (callbacks[i].on_enter == callback.on_enter
+            && callbacks[i].on_undefined_transition
+                == callback.on_undefined_transition)
         {
-            SM_LOCK(sm).take(sm);
+            return i;
         }
     }
 
-    return STATE_MACHINE_SUCCESS;
+    if (*count >= max_callbacks)
+    {
+        return max_callbacks;
+    }
+
+    callbacks[*count] = callback;
+
+    return (*count)++;
 }
 
-static INLINE void lock_give(State_machine *const sm)
+uint32_t state_machine_compact_table(
+    const State_machine_transition *const transition_table,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    State_machine_compact_transition *const compact_table,
+    State_machine_compact_callback *const callbacks,
+    const uint32_t max_callbacks,
+    uint32_t *const callback_count)
 {
-    /* Function that calls this has to check that value of sm is not NULL.
+    const uint32_t limit = max_callbacks < STATE_MACHINE_COMPACT_MAX_CALLBACKS
+        ? max_callbacks : STATE_MACHINE_COMPACT_MAX_CALLBACKS;
+    uint32_t ret = STATE_MACHINE_SUCCESS;
+    uint32_t count = 1;
+
+    ASSERT_NOT_NULL(transition_table);
+    ASSERT_NOT_NULL(compact_table);
+    ASSERT_NOT_NULL(callbacks);
+    assert(max_state > 0 && max_state <= STATE_MACHINE_COMPACT_MAX_STATE);
+    assert(max_event > 0);
+    assert(max_callbacks > 0);
+
+    /* Index zero is reserved for "no callback" so that tables with a lot of
+     * cells without callbacks don't have to search for it.
      */
-    ASSERT_LOCKING_DEFINITION_CONSISTENCY(SM_LOCK(sm));
+    callbacks[0].on_enter = NULL;
+    callbacks[0].on_undefined_transition = NULL;
 
-    if (USE_LOCKING(sm))
+    for (size_t i = 0; i < (size_t)max_state * max_event; i++)
     {
-        SM_LOCK(sm).give(sm);
-    }
-}
+        const State_machine_transition *const transition =
+            &transition_table[i];
+        State_machine_compact_callback callback = {NULL, NULL};
+        uint32_t index;
 
-uint32_t state_machine_current_state(State_machine *const sm,
-    uint32_t *const state, const uint32_t flags)
-{
-    uint32_t ret;
+        if (IS_TRANSITION(transition))
+        {
+            assert(RESULT_TRANSITION(transition).next_state < max_state);
+            callback.on_enter = RESULT_TRANSITION(transition).on_enter;
+        }
+        else
+        {
+            callback.on_undefined_transition =
+                RESULT_NO_TRANSITION(transition).on_undefined_transition;
+        }
 
-    ASSERT_NOT_NULL(sm);
-    ASSERT_NOT_NULL(state);
+        index = compact_callback_index(callbacks, &count, limit, callback);
+        if (index >= limit)
+        {
+            ret = STATE_MACHINE_NO_SPACE;
+            break;
+        }
 
-    if_sm_failure (ret = lock_take(sm, flags))
+        compact_table[i] = IS_TRANSITION(transition)
+            ? STATE_MACHINE_COMPACT_TRANSITION(
+                RESULT_TRANSITION(transition).next_state, index)
+            : STATE_MACHINE_COMPACT_NO_TRANSITION(index);
+    }
+
+    if (callback_count != NULL)
     {
-        return ret;
+        *callback_count = count;
     }
-    *state = SM_CURRENT_STATE(sm);
-    lock_give(sm);
 
     return ret;
 }
 
-uint32_t state_machine_event(State_machine *const sm, const uint32_t event,
-    void *const event_data, const uint32_t flags)
+void state_machine_init_sparse_table(State_machine *const sm,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    State_machine_locking locking,
+    const uint32_t *rows,
+    const State_machine_transition *transitions,
+    On_undefined_state_transition on_undefined_transition,
+    void *const data)
 {
-    State_machine_transition *transition;
-
-    /* Make sure that STATE_MACHINE_SUCCESS is default value of "ret". See
-     * delayed return value handling of transition function later in the code.
+    /* Note: Function on_undefined_transition may be NULL.
      */
-    uint32_t ret = STATE_MACHINE_SUCCESS;
-
-    ASSERT_NOT_NULL(sm);
-
-    /* {{{ Critical Section ************************************************ */
+    ASSERT_NOT_NULL(rows);
+    assert(transitions != NULL || rows[max_state] == 0);
 
-    /* We have to assume that multiple concurent threads of execution will have
-     * access to the same event machine.
-     */
-    if_sm_failure (ret = lock_take(sm, flags))
+#ifndef NDEBUG
+    for (uint32_t s = 0; s < max_state; s++)
     {
-
-        /* It is safe to return from this function here since no destructive
-         * operation was made. Don't ever do this inside critical section. It
-         * is best to keep ratio of take() and give() calls as 1:1 to prevent
-         * nasty bugs.
-         */
-        return ret;
+        assert(rows[s] <= rows[s + 1]);
+        for (uint32_t i = rows[s]; i < rows[s + 1]; i++)
+        {
+            assert(transitions[i].cause < max_event);
+            assert(i == rows[s]
+                || transitions[i - 1].cause < transitions[i].cause);
+        }
     }
+#endif
 
-    /* We can make copies of values from state machine only inside critical
-     * section. All bets are off if we aren't in it.
-     */
-    const uint32_t max_event = SM_MAX_EVENT(sm);
-    const uint32_t max_state = SM_MAX_STATE(sm);
-    uint32_t current_state = SM_CURRENT_STATE(sm);
-    void *data = SM_DATA(sm);
+    state_machine_init_common(sm, max_state, max_event, init_state, locking,
+        STATE_MACHINE_USING_SPARSE_TABLE, data);
+    SM_TRANSITION_IMPL(sm, sparse).rows = rows;
+    SM_TRANSITION_IMPL(sm, sparse).transitions = transitions;
+    SM_TRANSITION_IMPL(sm, sparse).on_undefined_transition =
+        on_undefined_transition;
+}
 
-    /* Setting previous_state to invalid value for easier error detection.
-     */
-    uint32_t previous_state = max_state;
+uint32_t state_machine_sparse_table(
+    const State_machine_transition *const transition_table,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    On_undefined_state_transition on_undefined_transition,
+    uint32_t *const rows,
+    State_machine_transition *const transitions,
+    const size_t max_transitions,
+    size_t *const count)
+{
+    size_t n = 0;
 
-    assert(event < max_event);
-    assert(current_state < max_state);
+    ASSERT_NOT_NULL(transition_table);
+    ASSERT_NOT_NULL(count);
+    assert(rows != NULL || transitions == NULL);
+    assert(max_state > 0);
+    assert(max_event > 0);
 
-    if (SM_USING_TRANSITION_TABLE(sm))
+    for (uint32_t s = 0; s < max_state; s++)
     {
-        State_machine_transition (*table)[max_event] =
-            (State_machine_transition (*)[max_event])SM_TRANSITION_IMPL(sm, table);
+        if (rows != NULL)
+        {
+            rows[s] = (uint32_t)n;
+        }
 
-        transition = &(table[current_state][event]);
-    }
-    else
-    {
-        State_machine_transition_function transition_function =
-            SM_TRANSITION_IMPL(sm, function).transition;
-
-        /* If implementation of transition_function() uses its own private data
-         * (meaning sm->data) or calls outside functions, then one has to be
-         * aware of the fact that it is being done inside of critical section.
-         *
-         * It would be best if transition_function() was defined as a pure
-         * total function. In other words function that would behave as array
-         * lookup to the outside and for the same input would always provide
-         * same output. Unfortunately that is out of our control.
-         */
-        ret = transition_function(current_state, event, data, &transition);
-        /* We now have to delay failure handling so that we can have only one
-         * lock_give() call.
-         */
+        for (uint32_t e = 0; e < max_event; e++)
+        {
+            const State_machine_transition *const transition =
+                &transition_table[(size_t)s * max_event + e];
+
+            if (!IS_TRANSITION(transition)
+                && RESULT_NO_TRANSITION(transition).on_undefined_transition
+                    == on_undefined_transition)
+            {
+                continue;
+            }
+
+            if (transitions != NULL && n < max_transitions)
+            {
+                transitions[n] = *transition;
+
+                /* Lookup relies on cause, therefore it can't be left to the
+                 * caller to fill it properly.
+                 */
+                transitions[n].cause = e;
+                transitions[n].current_state = s;
+            }
+            n++;
+        }
     }
 
-    /* Note that since transition_function() error handling of is delayed we
-     * have to check "is_sm_success(ret)" for this to work correctly only
-     * return value of transition_function() may be stored in ret or ret's
-     * default value which is STATE_MACHINE_SUCCESS. Make sure that this
-     * invariant hodls.
-     */
-    if (is_sm_success(ret) && IS_TRANSITION(transition))
+    assert(n <= UINT32_MAX);
+    if (rows != NULL)
     {
-        previous_state = current_state;
-        current_state = RESULT_TRANSITION(transition).next_state;
-        SM_CURRENT_STATE(sm) = current_state;
+        rows[max_state] = (uint32_t)n;
     }
+    *count = n;
 
-    assert(current_state < max_state);
-    assert(SM_CURRENT_STATE(sm) == current_state);
+    return transitions == NULL || n > max_transitions
+        ? STATE_MACHINE_NO_SPACE : STATE_MACHINE_SUCCESS;
+}
 
-    lock_give(sm);
+void state_machine_init_compiled_table(State_machine *const sm,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    State_machine_locking locking,
+    const uint32_t *event_class,
+    const uint32_t *row,
+    const State_machine_transition *rows,
+    const uint32_t class_count,
+    void *const data)
+{
+    ASSERT_NOT_NULL(event_class);
+    ASSERT_NOT_NULL(row);
+    ASSERT_NOT_NULL(rows);
+    assert(class_count > 0 && class_count <= max_event);
 
-    /* }}} Critical Section ************************************************ */
+    state_machine_init_common(sm, max_state, max_event, init_state, locking,
+        STATE_MACHINE_USING_COMPILED_TABLE, data);
+    SM_TRANSITION_IMPL(sm, compiled).event_class = event_class;
+    SM_TRANSITION_IMPL(sm, compiled).row = row;
+    SM_TRANSITION_IMPL(sm, compiled).rows = rows;
+    SM_TRANSITION_IMPL(sm, compiled).class_count = class_count;
+}
 
-    /* Now we handle transition_function() return value properly and we do so
-     * outside of critical section.
-     */
-    if_sm_failure (ret)
+/* Transitions are considered equal if they would have the same effect on
+ * state machine, values of cause and current_state are irrelevant.
+ */
+static INLINE bool transition_equal(const State_machine_transition *const a,
+    const State_machine_transition *const b)
+{
+    if (IS_TRANSITION(a) != IS_TRANSITION(b))
     {
-        /* No need for cleanup since there neither were any modifications
-         * made nor there were any allocations. The later is implied by the
-         * fact that function that could allocate something returned error
-         * which is currently being propagated.
-         */
-        return ret;
+        return false;
     }
 
-    /* On-enter or on-undefined-state callback function is invoked outside of
-     * critical section. For this to work consistently this invariants have to
-     * hold:
-     *
-     * - Value of transition variable is either constant or it is visible only
-     *   in current context and not by other thread of execution (regardles if
-     *   we are single-threaded event-driven system or multi-threaded system).
-     *
-     *   Most commonly it will be constant when state machine was initialized
-     *   using transition table and possibly variable value when using
-     *   transition function. Therefore transition function should return
-     *   either constant or newly allocated value visible only in current
-     *   context. Later requires that cleanup function works properly.
-     *
-     * - Private data stored in state machine "sm->data" pointer are either
-     *   thread safe or properly handled inside on-enter or on-undefined-state
-     *   callbacks.
+    return IS_TRANSITION(a)
+        ? RESULT_TRANSITION(a).next_state == RESULT_TRANSITION(b).next_state
+            && RESULT_TRANSITION(a).on_enter == RESULT_TRANSITION(b).on_enter
+        : RESULT_NO_TRANSITION(a).on_undefined_transition
+            == RESULT_NO_TRANSITION(b).on_undefined_transition;
+}
+
+uint32_t state_machine_compile_table(
+    const State_machine_transition *const transition_table,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    uint32_t *const event_class,
+    uint32_t *const row,
+    State_machine_transition *const rows,
+    const size_t max_rows,
+    State_machine_compile_statistics *const statistics)
+{
+    const State_machine_transition (*table)[max_event] =
+        (const State_machine_transition (*)[max_event])transition_table;
+    uint32_t class_count = 0;
+    uint32_t row_count = 0;
+
+    ASSERT_NOT_NULL(transition_table);
+    ASSERT_NOT_NULL(event_class);
+    ASSERT_NOT_NULL(row);
+    ASSERT_NOT_NULL(statistics);
+    assert(max_state > 0);
+    assert(max_event > 0);
+
+    /* Event equivalence classes are numbered in order of their first
+     * occurrence, therefore first event of each class is its representative
+     * and it is the only one that needs to be compared with.
      */
-    if (IS_TRANSITION(transition))
+    for (uint32_t e = 0; e < max_event; e++)
     {
-        On_state_enter on_enter = RESULT_TRANSITION(transition).on_enter;
+        uint32_t c = 0;
 
-        if (on_enter != NULL)
+        event_class[e] = class_count;
+        for (uint32_t r = 0; r < e && c < class_count; r++)
         {
-            on_enter(event, current_state, previous_state, event_data, data);
+            uint32_t s;
+
+            if (event_class[r] != c)
+            {
+                continue;
+            }
+
+            for (s = 0; s < max_state; s++)
+            {
+                if (!transition_equal(&table[s][e], &table[s][r]))
+                {
+                    break;
+                }
+            }
+            if (s == max_state)
+            {
+                event_class[e] = c;
+                break;
+            }
+            c++;
+        }
+        if (event_class[e] == class_count)
+        {
+            class_count++;
         }
     }
-    else
+
+    /* Same approach is used for rows. Events of the same class are
+     * identical in all states, therefore comparing whole rows gives the same
+     * result as comparing only representatives of classes.
+     */
+    for (uint32_t s = 0; s < max_state; s++)
     {
-        On_undefined_state_transition on_undefined_transition =
-            RESULT_NO_TRANSITION(transition).on_undefined_transition;
+        uint32_t c = 0;
 
-        if (on_undefined_transition != NULL)
+        row[s] = row_count;
+        for (uint32_t r = 0; r < s && c < row_count; r++)
         {
-            on_undefined_transition(event, current_state, event_data, data);
+            uint32_t e;
+
+            if (row[r] != c)
+            {
+                continue;
+            }
+
+            for (e = 0; e < max_event; e++)
+            {
+                if (!transition_equal(&table[s][e], &table[r][e]))
+                {
+                    break;
+                }
+            }
+            if (e == max_event)
+            {
+                row[s] = c;
+                break;
+            }
+            c++;
+        }
+        if (row[s] == row_count)
+        {
+            if (rows != NULL && ((size_t)row_count + 1) * class_count <= max_rows)
+            {
+                for (uint32_t e = 0; e < max_event; e++)
+                {
+                    rows[(size_t)row_count * class_count + event_class[e]] =
+                        table[s][e];
+                }
+            }
+            row_count++;
         }
     }
 
-    /* When using transition function we need to call cleanup function, if
-     * provided. The reason behind this is that transition function may
-     * allocate memory or other resource and cleanup is then responsible to
-     * deallocate it.
+    statistics->original_size =
+        (size_t)max_state * max_event * sizeof(State_machine_transition);
+    statistics->compiled_size = (size_t)max_event * sizeof(uint32_t)
+        + (size_t)max_state * sizeof(uint32_t)
+        + (size_t)row_count * class_count * sizeof(State_machine_transition);
+    statistics->class_count = class_count;
+    statistics->row_count = row_count;
+
+    return rows == NULL || (size_t)row_count * class_count > max_rows
+        ? STATE_MACHINE_NO_SPACE : STATE_MACHINE_SUCCESS;
+}
+
+void state_machine_init_function(State_machine *const sm,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    State_machine_locking locking,
+    State_machine_transition_function transition,
+    State_machine_transition_cleanup_function cleanup,
+    void *const data)
+{
+    /* Note: Function cleanup may be NULL if no cleanup is necessary and that
+     * is why there is no assert(cleanup != NULL)".
      */
-    if (!SM_USING_TRANSITION_TABLE(sm))
+    ASSERT_NOT_NULL(transition);
+
+    state_machine_init_common(sm, max_state, max_event, init_state, locking,
+        STATE_MACHINE_USING_FUNCTION, data);
+    SM_TRANSITION_IMPL(sm, function).transition = transition;
+    SM_TRANSITION_IMPL(sm, function).cleanup = cleanup;
+}
+
+void state_machine_init_output_function(State_machine *const sm,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    State_machine_locking locking,
+    State_machine_transition_output_function transition,
+    void *const data)
+{
+    ASSERT_NOT_NULL(transition);
+
+    state_machine_init_common(sm, max_state, max_event, init_state, locking,
+        STATE_MACHINE_USING_OUTPUT_FUNCTION, data);
+    SM_TRANSITION_IMPL(sm, output_function).transition = transition;
+}
+
+uint32_t state_machine_set_lock_free(State_machine *const sm)
+{
+    ASSERT_NOT_NULL(sm);
+
+#ifndef __STDC_NO_ATOMICS__
+    if (!SM_USING_ANY_FUNCTION(sm) && SM_DEFERRED(sm) == NULL)
     {
-        State_machine_transition_cleanup_function cleanup =
-            SM_TRANSITION_IMPL(sm, function).cleanup;
+        /* Transition tables are constant, therefore there is nothing else to
+         * protect then current_state.
+         */
+        SM_OPTIONS(sm) |= STATE_MACHINE_OPTION_LOCK_FREE;
+        atomic_init(SM_ATOMIC_CURRENT_STATE(sm), SM_CURRENT_STATE(sm));
 
-        if (cleanup != NULL)
-        {
-            ret = cleanup(data, transition);
-            /* Main function return call handles this return value.
-             */
-        }
+        return STATE_MACHINE_SUCCESS;
     }
+#endif
 
-    return ret;
+    return STATE_MACHINE_NOT_SUPPORTED;
+}
+
+uint32_t state_machine_set_pure_function(State_machine *const sm,
+    State_machine_transition_cache_entry *const cache,
+    const size_t cache_size)
+{
+    ASSERT_NOT_NULL(sm);
+    ASSERT_NOT_NULL(cache);
+
+    const size_t cells = (size_t)SM_MAX_STATE(sm) * SM_MAX_EVENT(sm);
+
+    assert(cache_size >= cells
+        || (cache_size > 0 && (cache_size & (cache_size - 1)) == 0));
+
+    if (!SM_USING_TRANSITION_FUNCTION(sm))
+    {
+        return STATE_MACHINE_NOT_SUPPORTED;
+    }
+
+    for (size_t i = 0; i < cache_size; i++)
+    {
+        cache[i].key = 0;
+    }
+    SM_TRANSITION_IMPL(sm, function).cache = cache;
+    SM_TRANSITION_IMPL(sm, function).cache_size =
+        cache_size < cells ? cache_size : cells;
+    SM_OPTIONS(sm) |= STATE_MACHINE_OPTION_PURE_FUNCTION;
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+uint32_t state_machine_current_state(State_machine *const sm,
+    uint32_t *const state, const uint32_t flags)
+{
+    uint32_t ret;
+
+    ASSERT_NOT_NULL(sm);
+    ASSERT_NOT_NULL(state);
+
+#ifndef __STDC_NO_ATOMICS__
+    if (SM_IS_LOCK_FREE(sm))
+    {
+        *state = atomic_load_explicit(SM_ATOMIC_CURRENT_STATE(sm),
+            memory_order_acquire);
+
+        return STATE_MACHINE_SUCCESS;
+    }
+#endif
+
+    if_sm_failure (ret = lock_take_shared(sm, flags))
+    {
+        return ret;
+    }
+    *state = SM_CURRENT_STATE(sm);
+    lock_give_shared(sm);
+
+    return ret;
+}
+
+static INLINE uint32_t transition_lookup(State_machine *const sm,
+    const uint32_t current_state,
+    const uint32_t event,
+    void *const data,
+    State_machine_transition *const buffer,
+    State_machine_transition **const transition)
+{
+    return implementation_lookup(&SM_TRANSITION(sm), SM_MAX_EVENT(sm),
+        current_state, event, data, buffer, transition);
+}
+
+static INLINE uint32_t transition_callbacks(State_machine *const sm,
+    State_machine_transition *const transition,
+    const uint32_t event,
+    const uint32_t current_state,
+    const uint32_t previous_state,
+    void *const event_data,
+    void *const data)
+{
+#ifdef STATE_MACHINE_STATISTICS
+    /* Only transitions that actually invoke some function are measured.
+     */
+    if (SM_STATISTICS(sm) != NULL && ((IS_TRANSITION(transition)
+        ? RESULT_TRANSITION(transition).on_enter != NULL
+        : RESULT_NO_TRANSITION(transition).on_undefined_transition != NULL)
+        || (SM_USING_TRANSITION_FUNCTION(sm)
+            && SM_TRANSITION_IMPL(sm, function).cleanup != NULL
+            && SM_TRANSITION_IMPL(sm, function).cache == NULL)))
+    {
+        const uint64_t start = state_machine_statistics_now();
+        const uint32_t ret = implementation_callbacks(&SM_TRANSITION(sm),
+            transition, event, current_state, previous_state, event_data,
+            data);
+
+        statistics_duration(SM_STATISTICS(sm)->callback_duration, start);
+
+        return ret;
+    }
+#endif
+
+    return implementation_callbacks(&SM_TRANSITION(sm), transition, event,
+        current_state, previous_state, event_data, data);
+}
+
+/* Instrumentation of a step in which "event" was looked up in "state". When
+ * neither statistics nor traces are available there is nothing left of it.
+ */
+static INLINE void record_step(State_machine *const sm, const uint32_t state,
+    const uint32_t event, const State_machine_transition *const transition)
+{
+    STATISTICS_TRANSITION(sm, state, event, transition);
+    TRACE_TRANSITION(SM_TRACE(sm), 0, state, event, transition);
+}
+
+/* Counterpart of transition_callbacks() when callbacks were recorded in to
+ * buffer of deferred callbacks instead of being invoked.
+ */
+static INLINE uint32_t deferred_finish(State_machine *const sm,
+    State_machine_transition *const transition,
+    void *const data,
+    const bool appended)
+{
+    State_machine_deferred *const deferred = SM_DEFERRED(sm);
+
+    if (appended && deferred->notify != NULL)
+    {
+        deferred->notify(sm, deferred->context);
+    }
+
+    return implementation_cleanup(&SM_TRANSITION(sm), transition, data);
+}
+
+#ifndef __STDC_NO_ATOMICS__
+static INLINE void lock_free_transition(State_machine *const sm,
+    const uint32_t event,
+    void *const data,
+    State_machine_transition *const buffer,
+    State_machine_transition **const transition,
+    uint32_t *const current_state,
+    uint32_t *const previous_state)
+{
+    if (SM_SWAP(sm) != NULL)
+    {
+        State_machine_implementation impl;
+
+        swap_lock_free_implementation(sm, &impl);
+        implementation_lock_free(&impl, SM_MAX_STATE(sm), SM_MAX_EVENT(sm),
+            SM_ATOMIC_CURRENT_STATE(sm), event, data, buffer, transition,
+            current_state, previous_state);
+
+        return;
+    }
+
+    implementation_lock_free(&SM_TRANSITION(sm), SM_MAX_STATE(sm),
+        SM_MAX_EVENT(sm), SM_ATOMIC_CURRENT_STATE(sm), event, data, buffer,
+        transition, current_state, previous_state);
+}
+#endif
+
+/* Handle one event including its callbacks.
+ */
+static uint32_t event_step(State_machine *const sm, const uint32_t event,
+    void *const event_data, const uint32_t flags)
+{
+    State_machine_transition buffer;
+    State_machine_transition *transition;
+
+    /* Make sure that STATE_MACHINE_SUCCESS is default value of "ret". See
+     * delayed return value handling of transition function later in the code.
+     */
+    uint32_t ret = STATE_MACHINE_SUCCESS;
+
+    ASSERT_NOT_NULL(sm);
+
+#ifndef __STDC_NO_ATOMICS__
+    if (SM_IS_LOCK_FREE(sm))
+    {
+        uint32_t current_state;
+        uint32_t previous_state;
+        void *data = SM_DATA(sm);
+
+        assert(event < SM_MAX_EVENT(sm));
+
+        lock_free_transition(sm, event, data, &buffer, &transition,
+            &current_state, &previous_state);
+        record_step(sm, IS_TRANSITION(transition)
+            ? previous_state : current_state, event, transition);
+        if (SM_TIMER(sm) != NULL && IS_TRANSITION(transition))
+        {
+            timer_enter(SM_TIMER(sm), current_state);
+        }
+
+        return transition_callbacks(sm, transition, event, current_state,
+            previous_state, event_data, data);
+    }
+#endif
+
+    /* {{{ Critical Section ************************************************ */
+
+    /* We have to assume that multiple concurent threads of execution will have
+     * access to the same event machine.
+     */
+    if_sm_failure (ret = lock_take(sm, flags))
+    {
+
+        /* It is safe to return from this function here since no destructive
+         * operation was made. Don't ever do this inside critical section. It
+         * is best to keep ratio of take() and give() calls as 1:1 to prevent
+         * nasty bugs.
+         */
+        return ret;
+    }
+
+    /* We can make copies of values from state machine only inside critical
+     * section. All bets are off if we aren't in it.
+     */
+    const uint32_t max_state = SM_MAX_STATE(sm);
+    uint32_t current_state = SM_CURRENT_STATE(sm);
+    void *data = SM_DATA(sm);
+
+    /* Setting previous_state to invalid value for easier error detection.
+     */
+    uint32_t previous_state = max_state;
+    bool appended = false;
+
+    assert(event < SM_MAX_EVENT(sm));
+    assert(current_state < max_state);
+
+    /* Event that wouldn't have space for its callback is refused before
+     * anything happens, therefore there is nothing to clean up.
+     */
+    if (SM_DEFERRED(sm) != NULL && deferred_full(SM_DEFERRED(sm)))
+    {
+        ret = STATE_MACHINE_NO_SPACE;
+    }
+    else
+    {
+        ret = transition_lookup(sm, current_state, event, data, &buffer,
+            &transition);
+    }
+    /* We now have to delay failure handling of transition function so that
+     * we can have only one lock_give() call.
+     */
+
+    /* Note that since transition_function() error handling of is delayed we
+     * have to check "is_sm_success(ret)" for this to work correctly only
+     * return value of transition_function() may be stored in ret or ret's
+     * default value which is STATE_MACHINE_SUCCESS. Make sure that this
+     * invariant hodls.
+     */
+    if (is_sm_success(ret))
+    {
+        record_step(sm, current_state, event, transition);
+    }
+    if (is_sm_success(ret) && SM_DEFERRED(sm) != NULL)
+    {
+        appended = deferred_append(SM_DEFERRED(sm), transition, event,
+            current_state, max_state, event_data, data);
+    }
+    if (is_sm_success(ret) && IS_TRANSITION(transition))
+    {
+        previous_state = current_state;
+        current_state = RESULT_TRANSITION(transition).next_state;
+        SM_CURRENT_STATE(sm) = current_state;
+    }
+
+    assert(current_state < max_state);
+    assert(SM_CURRENT_STATE(sm) == current_state);
+
+    lock_give(sm);
+
+    /* }}} Critical Section ************************************************ */
+
+    /* Now we handle transition_function() return value properly and we do so
+     * outside of critical section.
+     */
+    if_sm_failure (ret)
+    {
+        /* No need for cleanup since there neither were any modifications
+         * made nor there were any allocations. The later is implied by the
+         * fact that function that could allocate something returned error
+         * which is currently being propagated.
+         */
+        return ret;
+    }
+
+    if (SM_TIMER(sm) != NULL && IS_TRANSITION(transition))
+    {
+        timer_enter(SM_TIMER(sm), current_state);
+    }
+
+    if (SM_DEFERRED(sm) != NULL)
+    {
+        return deferred_finish(sm, transition, data, appended);
+    }
+
+    return transition_callbacks(sm, transition, event, current_state,
+        previous_state, event_data, data);
+}
+
+#ifdef HAVE_RTC_QUEUE
+/* Address of this variable identifies thread of execution that owns
+ * run-to-completion queue.
+ */
+static _Thread_local char rtc_thread;
+
+/* Body of state_machine_event_batch() without run-to-completion queue, it is
+ * defined with it.
+ */
+static uint32_t event_batch(State_machine *const sm,
+    const uint32_t *const events,
+    void *const *const event_data,
+    const size_t count,
+    uint32_t *const results,
+    size_t *const consumed,
+    const uint32_t flags);
+
+/* Queue is accessed only by its owner, which is this thread. */
+static INLINE uint32_t rtc_raise(State_machine_rtc_queue *const queue,
+    const uint32_t event, void *const event_data)
+{
+    if (queue->count == queue->size)
+    {
+        return STATE_MACHINE_NO_SPACE;
+    }
+    queue->events[(queue->head + queue->count) & (queue->size - 1)] =
+        (State_machine_raised_event){event, event_data};
+    queue->count++;
+
+    return STATE_MACHINE_SUCCESS;
+}
+
+/* Returns true if this thread became owner of the queue. False means that
+ * the queue is owned by another thread of execution, or already by this one.
+ */
+static INLINE bool rtc_acquire(State_machine_rtc_queue *const queue)
+{
+    void *owner = NULL;
+
+    return atomic_compare_exchange_strong_explicit(
+        (_Atomic(void *) *)&queue->owner, &owner, (void *)&rtc_thread,
+        memory_order_acquire, memory_order_relaxed);
+}
+
+static INLINE bool rtc_is_owner(State_machine_rtc_queue *const queue)
+{
+    return atomic_load_explicit((_Atomic(void *) *)&queue->owner,
+        memory_order_relaxed) == &rtc_thread;
+}
+
+/* Handle events raised while this thread owned the queue and give up the
+ * ownership. Returns first failure of those events, or
+ * STATE_MACHINE_SUCCESS. Event that is refused, e.g. because buffer of
+ * deferred callbacks is full, stops handling and it, along with those raised
+ * after it, stays in the queue for the next owner.
+ */
+static uint32_t rtc_release(State_machine *const sm,
+    State_machine_rtc_queue *const queue)
+{
+    uint32_t ret = STATE_MACHINE_SUCCESS;
+
+    while (queue->count > 0)
+    {
+        uint32_t events[STATE_MACHINE_BATCH_SIZE];
+        void *raised_data[STATE_MACHINE_BATCH_SIZE];
+        uint32_t results[STATE_MACHINE_BATCH_SIZE];
+        size_t n = 0;
+        size_t consumed;
+
+        /* Events are copied out of the queue first, so that callbacks of
+         * this chunk can raise new ones. They are removed from it only once
+         * they were consumed.
+         */
+        for (size_t head = queue->head;
+            n < STATE_MACHINE_BATCH_SIZE && n < queue->count;
+            head = (head + 1) & (queue->size - 1))
+        {
+            events[n] = queue->events[head].event;
+            raised_data[n] = queue->events[head].event_data;
+            n++;
+        }
+
+        /* Same as in state_machine_drain(), raised events can't be refused
+         * by transition function, therefore its failure only stops the
+         * batch.
+         */
+        const uint32_t batch = event_batch(sm, events, raised_data, n,
+            results, &consumed, 0);
+
+        for (size_t i = 0; i < consumed; i++)
+        {
+            if (is_sm_failure(results[i]) && is_sm_success(ret))
+            {
+                ret = results[i];
+            }
+        }
+        queue->head = (queue->head + consumed) & (queue->size - 1);
+        queue->count -= consumed;
+
+        if (consumed == 0)
+        {
+            ret = batch;
+            break;
+        }
+    }
+
+    atomic_store_explicit((_Atomic(void *) *)&queue->owner, NULL,
+        memory_order_release);
+
+    return ret;
+}
+
+static uint32_t rtc_event(State_machine *const sm, const uint32_t event,
+    void *const event_data, const uint32_t flags)
+{
+    State_machine_rtc_queue *const queue = SM_RTC_QUEUE(sm);
+
+    if (rtc_is_owner(queue))
+    {
+        /* Event was raised from inside of a callback. */
+        return rtc_raise(queue, event, event_data);
+    }
+    if (!rtc_acquire(queue))
+    {
+        /* Queue is owned by another thread of execution. */
+        return event_step(sm, event, event_data, flags);
+    }
+
+    uint32_t ret = event_step(sm, event, event_data, flags);
+    const uint32_t raised = rtc_release(sm, queue);
+
+    return is_sm_success(ret) ? raised : ret;
+}
+#endif
+
+static INLINE uint32_t event_dispatch(State_machine *const sm,
+    const uint32_t event, void *const event_data, const uint32_t flags)
+{
+#ifdef HAVE_RTC_QUEUE
+    if (SM_RTC_QUEUE(sm) != NULL)
+    {
+        return rtc_event(sm, event, event_data, flags);
+    }
+#endif
+
+    return event_step(sm, event, event_data, flags);
+}
+
+uint32_t state_machine_event(State_machine *const sm, const uint32_t event,
+    void *const event_data, const uint32_t flags)
+{
+    ASSERT_NOT_NULL(sm);
+
+    if (SM_SWAP(sm) != NULL)
+    {
+        /* Callbacks are invoked with transitions that point in to the table,
+         * therefore it has to stay valid until they return.
+         */
+        const uint32_t index = swap_enter(SM_SWAP(sm));
+        const uint32_t ret = event_dispatch(sm, event, event_data, flags);
+
+        swap_leave(SM_SWAP(sm), index);
+
+        return ret;
+    }
+
+    return event_dispatch(sm, event, event_data, flags);
+}
+
+/* Body of specialized variants of state_machine_event(). Arguments "table"
+ * and "locking" are constants in each of them, therefore compiler removes
+ * branches that depend on them. Otherwise it follows state_machine_event()
+ * step by step.
+ */
+static INLINE uint32_t event_specialized(State_machine *const sm,
+    const uint32_t event,
+    void *const event_data,
+    const uint32_t flags,
+    const bool table,
+    const bool locking)
+{
+    State_machine_transition *transition;
+    uint32_t ret = STATE_MACHINE_SUCCESS;
+
+    ASSERT_NOT_NULL(sm);
+    assert(table
+        ? SM_USING_TRANSITION_TABLE(sm) && !SM_IS_LOCK_FREE(sm)
+        : SM_USING_TRANSITION_FUNCTION(sm)
+            && SM_TRANSITION_IMPL(sm, function).cache == NULL);
+    assert(locking == USE_LOCKING(sm));
+    assert(SM_DEFERRED(sm) == NULL && SM_RTC_QUEUE(sm) == NULL
+        && SM_TIMER(sm) == NULL && SM_SWAP(sm) == NULL);
+
+    /* {{{ Critical Section ************************************************ */
+
+    if (locking)
+    {
+        if (flags & STATE_MACHINE_NONBLOCK)
+        {
+            if (!SM_LOCK(sm).try_take(sm))
+            {
+                return STATE_MACHINE_WOULD_BLOCK;
+            }
+        }
+        else
+        {
+#ifdef STATE_MACHINE_STATISTICS
+            /* Lock waiting is measured the same way as by lock_take(). */
+            if (SM_STATISTICS(sm) != NULL)
+            {
+                const uint64_t start = state_machine_statistics_now();
+
+                SM_LOCK(sm).take(sm);
+                statistics_duration(SM_STATISTICS(sm)->lock_wait, start);
+            }
+            else
+#endif
+            {
+                SM_LOCK(sm).take(sm);
+            }
+        }
+    }
+
+    const uint32_t max_event = SM_MAX_EVENT(sm);
+    uint32_t current_state = SM_CURRENT_STATE(sm);
+    uint32_t previous_state = SM_MAX_STATE(sm);
+    void *data = SM_DATA(sm);
+
+    assert(event < max_event);
+    assert(current_state < SM_MAX_STATE(sm));
+
+    if (table)
+    {
+        transition = &SM_TRANSITION_IMPL(sm, table)[
+            (size_t)current_state * max_event + event];
+    }
+    else
+    {
+        ret = SM_TRANSITION_IMPL(sm, function).transition(current_state,
+            event, data, &transition);
+    }
+
+    if (is_sm_success(ret))
+    {
+        record_step(sm, current_state, event, transition);
+        if (IS_TRANSITION(transition))
+        {
+            previous_state = current_state;
+            current_state = RESULT_TRANSITION(transition).next_state;
+            SM_CURRENT_STATE(sm) = current_state;
+        }
+    }
+
+    assert(current_state < SM_MAX_STATE(sm));
+
+    if (locking)
+    {
+        SM_LOCK(sm).give(sm);
+    }
+
+    /* }}} Critical Section ************************************************ */
+
+    if_sm_failure (ret)
+    {
+        return ret;
+    }
+
+#ifdef STATE_MACHINE_STATISTICS
+    /* Instrumented build measures callbacks the same way as
+     * state_machine_event() does.
+     */
+    return transition_callbacks(sm, transition, event, current_state,
+        previous_state, event_data, data);
+#else
+    if (IS_TRANSITION(transition))
+    {
+        On_state_enter on_enter = RESULT_TRANSITION(transition).on_enter;
+
+        if (on_enter != NULL)
+        {
+            on_enter(event, current_state, previous_state, event_data, data);
+        }
+    }
+    else
+    {
+        On_undefined_state_transition on_undefined_transition =
+            RESULT_NO_TRANSITION(transition).on_undefined_transition;
+
+        if (on_undefined_transition != NULL)
+        {
+            on_undefined_transition(event, current_state, event_data, data);
+        }
+    }
+
+    if (!table && SM_TRANSITION_IMPL(sm, function).cleanup != NULL)
+    {
+        ret = SM_TRANSITION_IMPL(sm, function).cleanup(data, transition);
+    }
+
+    return ret;
+#endif
+}
+
+uint32_t state_machine_event_table_nolock(State_machine *const sm,
+    const uint32_t event, void *const event_data, const uint32_t flags)
+{
+    return event_specialized(sm, event, event_data, flags, true, false);
+}
+
+uint32_t state_machine_event_table_lock(State_machine *const sm,
+    const uint32_t event, void *const event_data, const uint32_t flags)
+{
+    return event_specialized(sm, event, event_data, flags, true, true);
+}
+
+uint32_t state_machine_event_function_nolock(State_machine *const sm,
+    const uint32_t event, void *const event_data, const uint32_t flags)
+{
+    return event_specialized(sm, event, event_data, flags, false, false);
+}
+
+uint32_t state_machine_event_function_lock(State_machine *const sm,
+    const uint32_t event, void *const event_data, const uint32_t flags)
+{
+    return event_specialized(sm, event, event_data, flags, false, true);
+}
+
+State_machine_event_handler state_machine_event_handler(State_machine *const sm)
+{
+    ASSERT_NOT_NULL(sm);
+
+    if (SM_DEFERRED(sm) != NULL || SM_RTC_QUEUE(sm) != NULL
+        || SM_TIMER(sm) != NULL || SM_SWAP(sm) != NULL)
+    {
+        return state_machine_event;
+    }
+
+    if (SM_USING_TRANSITION_TABLE(sm) && !SM_IS_LOCK_FREE(sm))
+    {
+        return USE_LOCKING(sm)
+            ? state_machine_event_table_lock : state_machine_event_table_nolock;
+    }
+    else if (SM_USING_TRANSITION_FUNCTION(sm)
+        && SM_TRANSITION_IMPL(sm, function).cache == NULL)
+    {
+        return USE_LOCKING(sm)
+            ? state_machine_event_function_lock
+            : state_machine_event_function_nolock;
+    }
+
+    return state_machine_event;
+}
+
+/* Critical section of state_machine_event_batch() for one chunk of events.
+ * Number of events that were successfully processed is stored in "processed"
+ * and "appended" tells if any of them recorded deferred callback. Return
+ * value is either return value of lock_take(), of failed transition function,
+ * or STATE_MACHINE_NO_SPACE if buffer of deferred callbacks got full. Only in
+ * the second case "failed" is set, the other two refuse event without looking
+ * it up.
+ */
+static INLINE uint32_t batch_chunk(State_machine *const sm,
+    const uint32_t *const events,
+    void *const *const event_data,
+    const size_t chunk,
+    State_machine_transition *const buffers,
+    State_machine_transition **const transitions,
+    uint32_t *const current_states,
+    uint32_t *const previous_states,
+    size_t *const processed,
+    bool *const appended,
+    bool *const failed,
+    const uint32_t flags)
+{
+    uint32_t ret;
+    size_t n;
+
+    *processed = 0;
+    *appended = false;
+    *failed = false;
+
+#ifndef __STDC_NO_ATOMICS__
+    if (SM_IS_LOCK_FREE(sm))
+    {
+        void *data = SM_DATA(sm);
+
+        for (n = 0; n < chunk; n++)
+        {
+            assert(events[n] < SM_MAX_EVENT(sm));
+
+            lock_free_transition(sm, events[n], data, &buffers[n],
+                &transitions[n], &current_states[n], &previous_states[n]);
+            record_step(sm, IS_TRANSITION(transitions[n])
+                ? previous_states[n] : current_states[n], events[n],
+                transitions[n]);
+        }
+        *processed = n;
+
+        return STATE_MACHINE_SUCCESS;
+    }
+#endif
+
+    /* {{{ Critical Section ************************************************ */
+
+    if_sm_failure (ret = lock_take(sm, flags))
+    {
+        return ret;
+    }
+
+    const uint32_t max_state = SM_MAX_STATE(sm);
+    uint32_t current_state = SM_CURRENT_STATE(sm);
+    void *data = SM_DATA(sm);
+
+    assert(current_state < max_state);
+
+    State_machine_deferred *const deferred = SM_DEFERRED(sm);
+
+    for (n = 0; n < chunk; n++)
+    {
+        assert(events[n] < SM_MAX_EVENT(sm));
+
+        if (deferred != NULL && deferred_full(deferred))
+        {
+            ret = STATE_MACHINE_NO_SPACE;
+            break;
+        }
+        ret = transition_lookup(sm, current_state, events[n], data,
+            &buffers[n], &transitions[n]);
+        if_sm_failure (ret)
+        {
+            /* Just like in state_machine_event() failure of transition
+             * function means that event haven't changed anything, but
+             * callbacks of events that preceded it still have to be invoked.
+             */
+            *failed = true;
+            break;
+        }
+        record_step(sm, current_state, events[n], transitions[n]);
+        if (deferred != NULL)
+        {
+            *appended |= deferred_append(deferred, transitions[n], events[n],
+                current_state, max_state,
+                event_data == NULL ? NULL : event_data[n], data);
+        }
+
+        previous_states[n] = max_state;
+        if (IS_TRANSITION(transitions[n]))
+        {
+            previous_states[n] = current_state;
+            current_state = RESULT_TRANSITION(transitions[n]).next_state;
+        }
+        current_states[n] = current_state;
+
+        assert(current_state < max_state);
+    }
+
+    SM_CURRENT_STATE(sm) = current_state;
+
+    lock_give(sm);
+
+    /* }}} Critical Section ************************************************ */
+
+    *processed = n;
+
+    return ret;
+}
+
+static uint32_t event_batch(State_machine *const sm,
+    const uint32_t *const events,
+    void *const *const event_data,
+    const size_t count,
+    uint32_t *const results,
+    size_t *const consumed,
+    const uint32_t flags)
+{
+    /* Transitions, and states in which they were made, are remembered for
+     * whole chunk so that callbacks can be invoked after leaving critical
+     * section.
+     */
+    State_machine_transition buffers[STATE_MACHINE_BATCH_SIZE];
+    State_machine_transition *transitions[STATE_MACHINE_BATCH_SIZE];
+    uint32_t current_states[STATE_MACHINE_BATCH_SIZE];
+    uint32_t previous_states[STATE_MACHINE_BATCH_SIZE];
+
+    uint32_t ret = STATE_MACHINE_SUCCESS;
+    size_t done = 0;
+
+    ASSERT_NOT_NULL(sm);
+    assert(count == 0 || events != NULL);
+
+    while (done < count && is_sm_success(ret))
+    {
+        const size_t chunk = count - done < STATE_MACHINE_BATCH_SIZE
+            ? count - done : STATE_MACHINE_BATCH_SIZE;
+        size_t n;
+        bool appended;
+        bool failed;
+        const uint32_t index =
+            SM_SWAP(sm) == NULL ? 0 : swap_enter(SM_SWAP(sm));
+
+        ret = batch_chunk(sm, &events[done],
+            event_data == NULL ? NULL : &event_data[done], chunk, buffers,
+            transitions, current_states, previous_states, &n, &appended,
+            &failed, flags);
+        if (ret == STATE_MACHINE_WOULD_BLOCK)
+        {
+            /* Nothing from this chunk was processed, everything before it
+             * was already finished including callbacks.
+             */
+            if (SM_SWAP(sm) != NULL)
+            {
+                swap_leave(SM_SWAP(sm), index);
+            }
+            break;
+        }
+
+        void *data = SM_DATA(sm);
+
+        /* Timer is armed only for the state in which the last transition of
+         * the chunk ended.
+         */
+        for (size_t i = n; SM_TIMER(sm) != NULL && i > 0; i--)
+        {
+            if (IS_TRANSITION(transitions[i - 1]))
+            {
+                timer_enter(SM_TIMER(sm), current_states[i - 1]);
+                break;
+            }
+        }
+
+        /* Callbacks are invoked in the same order in which events were
+         * processed, but all of them after whole chunk was processed.
+         */
+        for (size_t i = 0; i < n; i++)
+        {
+            const uint32_t r = SM_DEFERRED(sm) != NULL
+                ? deferred_finish(sm, transitions[i], data,
+                    appended && i + 1 == n)
+                : transition_callbacks(sm, transitions[i], events[done + i],
+                    current_states[i], previous_states[i],
+                    event_data == NULL ? NULL : event_data[done + i], data);
+
+            if (results != NULL)
+            {
+                results[done + i] = r;
+            }
+        }
+        if (SM_SWAP(sm) != NULL)
+        {
+            swap_leave(SM_SWAP(sm), index);
+        }
+
+        if (failed)
+        {
+            /* Event which transition function failed is considered consumed
+             * and its result is the failure that stopped processing. Event
+             * that was refused, because lock couldn't be taken or buffer of
+             * deferred callbacks is full, had no effect and isn't.
+             */
+            if (results != NULL)
+            {
+                results[done + n] = ret;
+            }
+            n++;
+        }
+
+        done += n;
+    }
+
+    if (consumed != NULL)
+    {
+        *consumed = done;
+    }
+
+    return ret;
+}
+
+uint32_t state_machine_event_batch(State_machine *const sm,
+    const uint32_t *const events,
+    void *const *const event_data,
+    const size_t count,
+    uint32_t *const results,
+    size_t *const consumed,
+    const uint32_t flags)
+{
+    ASSERT_NOT_NULL(sm);
+
+#ifdef HAVE_RTC_QUEUE
+    State_machine_rtc_queue *const queue = SM_RTC_QUEUE(sm);
+
+    if (queue != NULL && rtc_is_owner(queue))
+    {
+        /* Batch was sent from inside of a callback, its events are raised
+         * one by one until queue is full.
+         */
+        uint32_t ret = STATE_MACHINE_SUCCESS;
+        size_t done = 0;
+
+        while (done < count && is_sm_success(ret = rtc_raise(queue,
+            events[done], event_data == NULL ? NULL : event_data[done])))
+        {
+            if (results != NULL)
+            {
+                results[done] = STATE_MACHINE_SUCCESS;
+            }
+            done++;
+        }
+        if (consumed != NULL)
+        {
+            *consumed = done;
+        }
+
+        return ret;
+    }
+    if (queue != NULL && rtc_acquire(queue))
+    {
+        /* Callbacks of the whole batch run before events they raised. */
+        const uint32_t ret = event_batch(sm, events, event_data, count,
+            results, consumed, flags);
+        const uint32_t raised = rtc_release(sm, queue);
+
+        return is_sm_success(ret) ? raised : ret;
+    }
+#endif
+
+    return event_batch(sm, events, event_data, count, results, consumed,
+        flags);
+}
+
+/* Processes "input" starting in "*state" until the end, stop state or
+ * undefined transition. Argument "compact" is constant in each caller, see
+ * event_specialized(). Returns number of bytes processed, "*stopped" tells if
+ * the last of them entered stop state from "*previous_state".
+ */
+static INLINE size_t match_loop(State_machine *const sm,
+    const uint8_t *const input,
+    const size_t length,
+    const uint8_t *const stop,
+    uint32_t *const state,
+    uint32_t *const previous_state,
+    bool *const stopped,
+    const bool compact)
+{
+    const size_t max_event = SM_MAX_EVENT(sm);
+    const State_machine_transition *const table =
+        compact ? NULL : SM_TRANSITION_IMPL(sm, table);
+    const State_machine_compact_transition *const compact_table =
+        compact ? SM_TRANSITION_IMPL(sm, compact).table : NULL;
+    uint32_t current = *state;
+    size_t i = 0;
+
+    *stopped = false;
+
+    /* One step; leaves the loop before undefined transition and after
+     * entering stop state.
+     */
+#define MATCH_STEP(k)                                                       \
+    do                                                                      \
+    {                                                                       \
+        const size_t cell = current * max_event + input[i + (k)];           \
+        uint32_t next;                                                      \
+                                                                            \
+        if (compact)                                                        \
+        {                                                                   \
+            const State_machine_compact_transition c = compact_table[cell]; \
+                                                                            \
+            if (!COMPACT_IS_TRANSITION(c))                                  \
+            {                                                               \
+                i += (k);                                                   \
+                goto done;                                                  \
+            }                                                               \
+            next = COMPACT_NEXT_STATE(c);                                   \
+        }                                                                   \
+        else                                                                \
+        {                                                                   \
+            if (!table[cell].is_transition)                                 \
+            {                                                               \
+                i += (k);                                                   \
+                goto done;                                                  \
+            }                                                               \
+            next = table[cell].result.transition.next_state;                \
+        }                                                                   \
+        if (stop != NULL && stop[next])                                     \
+        {                                                                   \
+            *previous_state = current;                                      \
+            current = next;                                                 \
+            i += (k) + 1;                                                   \
+            *stopped = true;                                                \
+            goto done;                                                      \
+        }                                                                   \
+        current = next;                                                     \
+    }                                                                       \
+    while (0)
+
+    for (; i + 4 <= length; i += 4)
+    {
+        MATCH_STEP(0);
+        MATCH_STEP(1);
+        MATCH_STEP(2);
+        MATCH_STEP(3);
+    }
+    for (; i < length; i++)
+    {
+        MATCH_STEP(0);
+    }
+
+#undef MATCH_STEP
+
+done:
+    *state = current;
+
+    return i;
+}
+
+static uint32_t match(State_machine *const sm,
+    const uint8_t *const input,
+    const size_t length,
+    const uint8_t *const stop,
+    size_t *const consumed,
+    const uint32_t flags)
+{
+    uint32_t ret;
+
+    ASSERT_NOT_NULL(sm);
+    assert(length == 0 || input != NULL);
+    ASSERT_NOT_NULL(consumed);
+
+    *consumed = 0;
+
+    if ((!SM_USING_TRANSITION_TABLE(sm) && !SM_USING_COMPACT_TABLE(sm))
+        || SM_IS_LOCK_FREE(sm) || SM_DEFERRED(sm) != NULL)
+    {
+        return STATE_MACHINE_NOT_SUPPORTED;
+    }
+    assert(SM_MAX_EVENT(sm) >= 256);
+
+    /* {{{ Critical Section ************************************************ */
+
+    if_sm_failure (ret = lock_take(sm, flags))
+    {
+        return ret;
+    }
+
+    uint32_t current_state = SM_CURRENT_STATE(sm);
+    uint32_t previous_state = SM_MAX_STATE(sm);
+    void *data = SM_DATA(sm);
+    bool stopped;
+    size_t n;
+
+    if (SM_USING_COMPACT_TABLE(sm))
+    {
+        n = match_loop(sm, input, length, stop, &current_state,
+            &previous_state, &stopped, true);
+    }
+    else
+    {
+        n = match_loop(sm, input, length, stop, &current_state,
+            &previous_state, &stopped, false);
+    }
+
+    assert(current_state < SM_MAX_STATE(sm));
+    SM_CURRENT_STATE(sm) = current_state;
+
+    State_machine_transition buffer;
+    State_machine_transition *transition = NULL;
+
+    /* Transition in to stop state is looked up while table can't be
+     * replaced. Lookup in transition table can't fail.
+     */
+    if (stopped)
+    {
+        (void)transition_lookup(sm, previous_state, input[n - 1], data,
+            &buffer, &transition);
+    }
+
+    lock_give(sm);
+
+    /* }}} Critical Section ************************************************ */
+
+    *consumed = n;
+
+    if (SM_TIMER(sm) != NULL && n > 0)
+    {
+        timer_enter(SM_TIMER(sm), current_state);
+    }
+
+    if (stopped)
+    {
+        return transition_callbacks(sm, transition, input[n - 1],
+            current_state, previous_state, NULL, data);
+    }
+
+    return n < length ? STATE_MACHINE_INVALID : ret;
+}
+
+uint32_t state_machine_match(State_machine *const sm,
+    const uint8_t *const input,
+    const size_t length,
+    const uint8_t *const stop,
+    size_t *const consumed,
+    const uint32_t flags)
+{
+    ASSERT_NOT_NULL(sm);
+
+    if (SM_SWAP(sm) != NULL)
+    {
+        const uint32_t index = swap_enter(SM_SWAP(sm));
+        const uint32_t ret = match(sm, input, length, stop, consumed, flags);
+
+        swap_leave(SM_SWAP(sm), index);
+
+        return ret;
+    }
+
+    return match(sm, input, length, stop, consumed, flags);
 }
@@ -124,17 +124,29 @@ typedef struct State_machine_transition_s
     }
 
 struct State_machine_s;     /* Forward declaration. */
+struct State_machine_queue_s;   /* Forward declaration. */
+struct State_machine_statistics_s;  /* Forward declaration. */
+struct State_machine_trace_s;       /* Forward declaration. */
 
 /** Interface for locking primitives.
  *
  * Usage of locking is not mandatory, but event-driven and multi-threaded
  * application should use it.
+ *
+ * Shared operations are optional, either all of them are provided or none.
+ * If they are, then read-only queries, e.g.
+ * <tt>state_machine_current_state()</tt>, take lock in shared mode, so they
+ * run concurrently with each other, e.g. on top of reader/writer lock. If
+ * they aren't, then queries use exclusive operations as well.
  */
 typedef struct
 {
     bool (*try_take)(struct State_machine_s *);
     void (*take)(struct State_machine_s *);
     void (*give)(struct State_machine_s *);
+    bool (*try_take_shared)(struct State_machine_s *);
+    void (*take_shared)(struct State_machine_s *);
+    void (*give_shared)(struct State_machine_s *);
 } State_machine_locking;
 
 /** Use this macro to statically initialize
@@ -142,7 +154,65 @@ typedef struct
  * necessary.
  */
 #define STATE_MACHINE_NO_LOCKING    \
-    {.take = NULL, .try_take = NULL, .give = NULL}
+    {.take = NULL, .try_take = NULL, .give = NULL, .take_shared = NULL, \
+        .try_take_shared = NULL, .give_shared = NULL}
+
+/** Compact encoding of state transition used by compact transition table.
+ *
+ * Most significant bit is set if it is a valid (i.e. defined) state
+ * transition. Next <tt>STATE_MACHINE_COMPACT_CALLBACK_BITS</tt> bits are an
+ * index in to array of callbacks shared by whole table and lowest
+ * <tt>STATE_MACHINE_COMPACT_STATE_BITS</tt> bits are the next state. There is no
+ * need to store event and current state, since those are implied by position
+ * in a table.
+ */
+typedef uint32_t State_machine_compact_transition;
+
+#define STATE_MACHINE_COMPACT_STATE_BITS        20
+#define STATE_MACHINE_COMPACT_CALLBACK_BITS     11
+
+/** Upper bound on <tt>max_state</tt> of state machine that uses compact
+ * transition table.
+ */
+#define STATE_MACHINE_COMPACT_MAX_STATE \
+    (UINT32_C(1) << STATE_MACHINE_COMPACT_STATE_BITS)
+
+/** Upper bound on number of entries in array of callbacks used by compact
+ * transition table.
+ */
+#define STATE_MACHINE_COMPACT_MAX_CALLBACKS \
+    (UINT32_C(1) << STATE_MACHINE_COMPACT_CALLBACK_BITS)
+
+#define STATE_MACHINE_COMPACT_IS_TRANSITION     (UINT32_C(1) << 31)
+
+/** Macro for static initialization of
+ * <tt>State_machine_compact_transition</tt> in case of valid (i.e. defined)
+ * state transition. Argument <tt>cb</tt> is an index in to array of
+ * callbacks.
+ */
+#define STATE_MACHINE_COMPACT_TRANSITION(ns, cb)                    \
+    (STATE_MACHINE_COMPACT_IS_TRANSITION                            \
+        | ((uint32_t)(cb) << STATE_MACHINE_COMPACT_STATE_BITS)      \
+        | (uint32_t)(ns))
+
+/** Macro for static initialization of
+ * <tt>State_machine_compact_transition</tt> in case of invalid (i.e.
+ * undefined) state transition. Argument <tt>cb</tt> is an index in to array
+ * of callbacks.
+ */
+#define STATE_MACHINE_COMPACT_NO_TRANSITION(cb)                     \
+    ((uint32_t)(cb) << STATE_MACHINE_COMPACT_STATE_BITS)
+
+/** Entry of array of callbacks shared by whole compact transition table.
+ *
+ * Valid state transition uses <tt>on_enter</tt> and invalid one uses
+ * <tt>on_undefined_transition</tt> of the entry it refers to.
+ */
+typedef struct
+{
+    On_state_enter on_enter;
+    On_undefined_state_transition on_undefined_transition;
+} State_machine_compact_callback;
 
 typedef uint32_t (*State_machine_transition_function)(uint32_t current_state,
     uint32_t event, void *data, State_machine_transition **);
@@ -150,6 +220,183 @@ typedef uint32_t (*State_machine_transition_function)(uint32_t current_state,
 typedef uint32_t (*State_machine_transition_cleanup_function)(void *data,
     State_machine_transition *);
 
+/* Transition function that stores transition in to a buffer provided by the
+ * library, therefore there is nothing to clean up afterwards.
+ */
+typedef uint32_t (*State_machine_transition_output_function)(
+    uint32_t current_state, uint32_t event, void *data,
+    State_machine_transition *);
+
+/** Entry of cache of pure transition function.
+ */
+typedef struct
+{
+    /** Index of cached cell, i.e. <tt>state * max_event + event</tt>, plus
+     * one. Zero means that entry is empty.
+     */
+    uint64_t key;
+
+    /** Copy of transition returned by transition function.
+     */
+    State_machine_transition transition;
+} State_machine_transition_cache_entry;
+
+/* Values of <tt>State_machine_implementation.type</tt>.
+ */
+#define STATE_MACHINE_USING_TABLE           0
+#define STATE_MACHINE_USING_FUNCTION        1
+#define STATE_MACHINE_USING_COMPACT_TABLE   2
+#define STATE_MACHINE_USING_SPARSE_TABLE    3
+#define STATE_MACHINE_USING_COMPILED_TABLE  4
+#define STATE_MACHINE_USING_OUTPUT_FUNCTION 5
+
+/** Replacement of <tt>using_table</tt> member that
+ * <tt>State_machine_implementation</tt> had before <tt>type</tt>. Code that
+ * read <tt>state_machine->transition.using_table</tt> can use
+ * <tt>STATE_MACHINE_IS_USING_TABLE(state_machine->transition)</tt> instead.
+ */
+#define STATE_MACHINE_IS_USING_TABLE(implementation)  \
+    ((implementation).type == STATE_MACHINE_USING_TABLE)
+
+/** State machine can either uses transition table, compact transition table,
+ * sparse transition table, compiled transition table or transition function.
+ *
+ * Transition tables are fast, but may require a lot of memory if either
+ * <tt>max_state</tt> or <tt>max_event</tt> or both are big. Compact transition
+ * table requires only four bytes per transition. Sparse transition table
+ * stores only defined transitions, therefore its size doesn't depend on
+ * <tt>max_event</tt>, but lookup has to search through transitions of
+ * current state. Compiled transition table stores only one copy of identical
+ * rows and columns of transition table.
+ */
+typedef struct
+{
+    /** One of <tt>STATE_MACHINE_USING_TABLE</tt>,
+     * <tt>STATE_MACHINE_USING_COMPACT_TABLE</tt>,
+     * <tt>STATE_MACHINE_USING_SPARSE_TABLE</tt>,
+     * <tt>STATE_MACHINE_USING_COMPILED_TABLE</tt>,
+     * <tt>STATE_MACHINE_USING_FUNCTION</tt> or
+     * <tt>STATE_MACHINE_USING_OUTPUT_FUNCTION</tt>.
+     */
+    uint32_t type;
+
+    /** Implementation either uses transition table, compact transition table,
+     * sparse transition table, compiled transition table or function,
+     * depending on <tt>type</tt>.
+     */
+    union
+    {
+        /** Table of state transitions parametrised by event.
+         *
+         * Transition table is two dimensional table of minimal size
+         * <tt>max_state * max_event</tt>, i.e.
+         * <tt>State_machine_transition table[max_state][max_event]</tt>.
+         */
+        State_machine_transition *table;
+
+        struct
+        {
+            /** Compact transition table is two dimensional table of minimal
+             * size <tt>max_state * max_event</tt>, i.e.
+             * <tt>State_machine_compact_transition
+             * table[max_state][max_event]</tt>.
+             */
+            const State_machine_compact_transition *table;
+
+            /** Callbacks referenced by entries of compact transition table.
+             */
+            const State_machine_compact_callback *callbacks;
+        } compact;
+
+        struct
+        {
+            /** Array of <tt>max_state + 1</tt> indexes in to
+             * <tt>transitions</tt>. Transitions from state <tt>s</tt> are
+             * those with index between <tt>rows[s]</tt> (including) and
+             * <tt>rows[s + 1]</tt> (excluding).
+             */
+            const uint32_t *rows;
+
+            /** Transitions from each state sorted by their <tt>cause</tt>.
+             */
+            const State_machine_transition *transitions;
+
+            /** Callback invoked for events that have no entry in
+             * <tt>transitions</tt>. It may be NULL.
+             */
+            On_undefined_state_transition on_undefined_transition;
+        } sparse;
+
+        struct
+        {
+            /** Array of <tt>max_event</tt> entries that maps events in to
+             * their equivalence classes. Events are equivalent if they cause
+             * the same transitions in every state.
+             */
+            const uint32_t *event_class;
+
+            /** Array of <tt>max_state</tt> entries that maps states in to
+             * rows of <tt>rows</tt> table.
+             */
+            const uint32_t *row;
+
+            /** Two dimensional table of unique rows, i.e.
+             * <tt>State_machine_transition rows[][class_count]</tt>. Values
+             * of <tt>cause</tt> and <tt>current_state</tt> of its entries have
+             * no meaning, since each entry is shared by multiple states and
+             * events.
+             */
+            const State_machine_transition *rows;
+
+            /** Number of event equivalence classes.
+             */
+            uint32_t class_count;
+        } compiled;
+
+        struct
+        {
+            /** Transition function that takes state machine as it is and
+             * returns state machine transition that has to be applied yet applied.
+             *
+             * This field may not be NULL.
+             */
+            State_machine_transition_function transition;
+
+            /** If <tt>transition</tt> had to e.g. allocate data, or any other
+             * resource, then this function is called to release it.
+             *
+             * This field may be NULL when there is no cleanup necessary.
+             */
+            State_machine_transition_cleanup_function cleanup;
+
+            /** Cache of results of pure transition function, see
+             * <tt>state_machine_set_pure_function()</tt>. It is NULL if
+             * function isn't declared pure.
+             */
+            State_machine_transition_cache_entry *cache;
+
+            /** Number of entries of <tt>cache</tt>.
+             */
+            size_t cache_size;
+        } function;
+
+        struct
+        {
+            /** Transition function that stores transition that has to be
+             * applied in to a buffer provided by caller.
+             *
+             * This field may not be NULL.
+             */
+            State_machine_transition_output_function transition;
+        } output_function;
+    } implementation;
+} State_machine_implementation;
+
+/* Bits of <tt>State_machine.options</tt>.
+ */
+#define STATE_MACHINE_OPTION_LOCK_FREE      1
+#define STATE_MACHINE_OPTION_PURE_FUNCTION  2
+
 typedef struct State_machine_s
 {
     /** Upper bound on number of states.
@@ -167,57 +414,62 @@ typedef struct State_machine_s
     uint32_t max_event;
 
     /** Current state in which state machine is in.
+     *
+     * When <tt>STATE_MACHINE_OPTION_LOCK_FREE</tt> is set, then it is
+     * accessed only using atomic operations.
      */
     uint32_t current_state;
 
+    /** Bit field of <tt>STATE_MACHINE_OPTION_*</tt> values.
+     */
+    uint32_t options;
+
     /** Locking primitives.
      */
     State_machine_locking lock;
 
-    /** State machine can either uses transition table or transition function.
-     *
-     * Transition tables are fast, but may require a lot of memory if either
-     * <tt>max_state</tt> or <tt>max_event</tt> or both are big.
+    /** How state transitions are looked up.
      */
-    struct
-    {
-        bool using_table;
-
-        /** Either implementation uses transition table or function, depending
-         * on <tt>using_table</tt> flag.
-         */
-        union 
-        {
-            /** Table of state transitions parametrised by event.
-             *
-             * Transition table is two dimensional table of minimal size
-             * <tt>max_state * max_event</tt>, i.e.
-             * <tt>State_machine_transition table[max_state][max_event]</tt>.
-             */
-            State_machine_transition *table;
-
-            struct
-            {
-                /** Transition function that takes state machine as it is and
-                 * returns state machine transition that has to be applied yet applied.
-                 *
-                 * This field may not be NULL.
-                 */
-                State_machine_transition_function transition;
-
-                /** If <tt>transition</tt> had to e.g. allocate data, or any other
-                 * resource, then this function is called to release it.
-                 *
-                 * This field may be NULL when there is no cleanup necessary.
-                 */
-                State_machine_transition_cleanup_function cleanup;
-            } function;
-        } implementation;
-    } transition;
+    State_machine_implementation transition;
 
     /** Private implementation data.
      */
     void *data;
+
+    /** Queue of events posted to this state machine, see
+     * <tt>state-machine-queue.h</tt>. It may be NULL.
+     */
+    struct State_machine_queue_s *queue;
+
+    /** Instrumentation counters, see <tt>state-machine-statistics.h</tt>. It
+     * may be NULL.
+     */
+    struct State_machine_statistics_s *statistics;
+
+    /** Ring buffer of recent steps, see <tt>state-machine-trace.h</tt>. It
+     * may be NULL.
+     */
+    struct State_machine_trace_s *trace;
+
+    /** Buffer of deferred callbacks, see <tt>state-machine-deferred.h</tt>.
+     * It may be NULL.
+     */
+    struct State_machine_deferred_s *deferred;
+
+    /** Queue of events raised by callbacks, see <tt>state-machine-rtc.h</tt>.
+     * It may be NULL.
+     */
+    struct State_machine_rtc_queue_s *rtc_queue;
+
+    /** Timer of per-state timeouts, see <tt>state-machine-timer.h</tt>. It
+     * may be NULL.
+     */
+    struct State_machine_timer_s *timer;
+
+    /** Table swap used to replace transition table while state machine is
+     * in use, see <tt>state-machine-swap.h</tt>. It may be NULL.
+     */
+    struct State_machine_swap_s *swap;
 } State_machine;
 
 /** Initialize state machine using transition table.
@@ -245,6 +497,276 @@ void state_machine_init_table(State_machine *const state_machine,
     State_machine_transition *transition_table,
     void *const data);
 
+/** Initialize state machine using compact transition table.
+ *
+ * @param[in] max_state
+ *   Upper bound on number of states. It has to be greater then zero and at
+ *   most <tt>STATE_MACHINE_COMPACT_MAX_STATE</tt>.
+ *
+ * @param[in] max_event
+ *   Upper bound on number of events. It has to be greater then zero.
+ *
+ * @param[in] init_state
+ *   Initial state of state machine. It may be between zero (including) and
+ *   max_state (excluding).
+ *
+ * @param[in] transition_table
+ *   Two dimensional array of at least <tt>max_state * max_event</tt> size.
+ *   It can be created from ordinary transition table using
+ *   <tt>state_machine_compact_table()</tt>.
+ *
+ * @param[in] callbacks
+ *   Array of callbacks that entries of <tt>transition_table</tt> refer to.
+ */
+void state_machine_init_compact_table(State_machine *const state_machine,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    State_machine_locking locking,
+    const State_machine_compact_transition *transition_table,
+    const State_machine_compact_callback *callbacks,
+    void *const data);
+
+/** Convert transition table in to compact transition table.
+ *
+ * Entry with index zero of <tt>callbacks</tt> is always
+ * <tt>{NULL, NULL}</tt>, other entries are unique callbacks found in
+ * <tt>transition_table</tt>.
+ *
+ * @param[in] transition_table
+ *   Two dimensional array of at least <tt>max_state * max_event</tt> size.
+ *
+ * @param[in] max_state
+ *   Upper bound on number of states. It has to be greater then zero and at
+ *   most <tt>STATE_MACHINE_COMPACT_MAX_STATE</tt>.
+ *
+ * @param[in] max_event
+ *   Upper bound on number of events. It has to be greater then zero.
+ *
+ * @param[out] compact_table
+ *   Two dimensional array of at least <tt>max_state * max_event</tt> size.
+ *
+ * @param[out] callbacks
+ *   Array of at least <tt>max_callbacks</tt> entries.
+ *
+ * @param[in] max_callbacks
+ *   Size of <tt>callbacks</tt> array.
+ *
+ * @param[out] callback_count
+ *   Number of used entries of <tt>callbacks</tt> array is stored here. It
+ *   may be NULL.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If there are
+ *   more unique callbacks then <tt>max_callbacks</tt> or
+ *   <tt>STATE_MACHINE_COMPACT_MAX_CALLBACKS</tt>, then it returns
+ *   <tt>STATE_MACHINE_NO_SPACE</tt>.
+ */
+uint32_t state_machine_compact_table(
+    const State_machine_transition *const transition_table,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    State_machine_compact_transition *const compact_table,
+    State_machine_compact_callback *const callbacks,
+    const uint32_t max_callbacks,
+    uint32_t *const callback_count);
+
+/** Initialize state machine using sparse transition table.
+ *
+ * @param[in] max_state
+ *   Upper bound on number of states. It has to be greater then zero.
+ *
+ * @param[in] max_event
+ *   Upper bound on number of events. It has to be greater then zero.
+ *
+ * @param[in] init_state
+ *   Initial state of state machine. It may be between zero (including) and
+ *   max_state (excluding).
+ *
+ * @param[in] rows
+ *   Array of <tt>max_state + 1</tt> indexes in to <tt>transitions</tt>, it
+ *   has to be non-decreasing. Transitions from state <tt>s</tt> are those with
+ *   index between <tt>rows[s]</tt> (including) and <tt>rows[s + 1]</tt>
+ *   (excluding).
+ *
+ * @param[in] transitions
+ *   Transitions from every state, including those that are undefined but
+ *   have callback other then <tt>on_undefined_transition</tt>. Transitions of
+ *   each state have to be sorted by <tt>cause</tt> and there may be only one
+ *   for each event.
+ *
+ * @param[in] on_undefined_transition
+ *   Callback invoked for events that have no entry in <tt>transitions</tt>.
+ *   It may be NULL.
+ */
+void state_machine_init_sparse_table(State_machine *const state_machine,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    State_machine_locking locking,
+    const uint32_t *rows,
+    const State_machine_transition *transitions,
+    On_undefined_state_transition on_undefined_transition,
+    void *const data);
+
+/** Convert transition table in to sparse transition table.
+ *
+ * Only valid transitions and undefined transitions with callback other then
+ * <tt>on_undefined_transition</tt> are stored. Function may be called with
+ * <tt>transitions</tt> set to NULL to find out how big it has to be.
+ *
+ * @param[in] transition_table
+ *   Two dimensional array of at least <tt>max_state * max_event</tt> size.
+ *
+ * @param[in] max_state
+ *   Upper bound on number of states. It has to be greater then zero.
+ *
+ * @param[in] max_event
+ *   Upper bound on number of events. It has to be greater then zero.
+ *
+ * @param[in] on_undefined_transition
+ *   Callback that will be passed to
+ *   <tt>state_machine_init_sparse_table()</tt>.
+ *
+ * @param[out] rows
+ *   Array of at least <tt>max_state + 1</tt> entries. It may be NULL only if
+ *   <tt>transitions</tt> is NULL.
+ *
+ * @param[out] transitions
+ *   Array of at least <tt>max_transitions</tt> entries.
+ *
+ * @param[in] max_transitions
+ *   Size of <tt>transitions</tt> array.
+ *
+ * @param[out] count
+ *   Number of transitions that sparse transition table consists of is
+ *   stored here.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If
+ *   <tt>transitions</tt> is NULL or it has less then <tt>*count</tt>
+ *   entries, then <tt>STATE_MACHINE_NO_SPACE</tt> is returned.
+ */
+uint32_t state_machine_sparse_table(
+    const State_machine_transition *const transition_table,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    On_undefined_state_transition on_undefined_transition,
+    uint32_t *const rows,
+    State_machine_transition *const transitions,
+    const size_t max_transitions,
+    size_t *const count);
+
+/** Initialize state machine using compiled transition table.
+ *
+ * @param[in] max_state
+ *   Upper bound on number of states. It has to be greater then zero.
+ *
+ * @param[in] max_event
+ *   Upper bound on number of events. It has to be greater then zero.
+ *
+ * @param[in] init_state
+ *   Initial state of state machine. It may be between zero (including) and
+ *   max_state (excluding).
+ *
+ * @param[in] event_class
+ *   Array of <tt>max_event</tt> entries that maps events in to their
+ *   equivalence classes.
+ *
+ * @param[in] row
+ *   Array of <tt>max_state</tt> entries that maps states in to rows of
+ *   <tt>rows</tt> table.
+ *
+ * @param[in] rows
+ *   Two dimensional table of unique rows, each row consists of
+ *   <tt>class_count</tt> transitions.
+ *
+ * @param[in] class_count
+ *   Number of event equivalence classes.
+ */
+void state_machine_init_compiled_table(State_machine *const state_machine,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    State_machine_locking locking,
+    const uint32_t *event_class,
+    const uint32_t *row,
+    const State_machine_transition *rows,
+    const uint32_t class_count,
+    void *const data);
+
+/** Sizes reported by <tt>state_machine_compile_table()</tt>.
+ */
+typedef struct
+{
+    /** Size of original transition table in bytes.
+     */
+    size_t original_size;
+
+    /** Size of compiled transition table, including maps of events and
+     * states, in bytes.
+     */
+    size_t compiled_size;
+
+    /** Number of event equivalence classes.
+     */
+    uint32_t class_count;
+
+    /** Number of unique rows.
+     */
+    uint32_t row_count;
+} State_machine_compile_statistics;
+
+/** Convert transition table in to compiled transition table.
+ *
+ * Events that cause the same transitions, i.e. same next state and
+ * callback, in every state are merged in to one equivalence class. Then
+ * states whose rows are identical share one row of compiled transition
+ * table. Numbering of states and events stays the same.
+ *
+ * Function may be called with <tt>rows</tt> set to NULL to find out how big
+ * it has to be, which is <tt>row_count * class_count</tt> entries.
+ *
+ * @param[in] transition_table
+ *   Two dimensional array of at least <tt>max_state * max_event</tt> size.
+ *
+ * @param[in] max_state
+ *   Upper bound on number of states. It has to be greater then zero.
+ *
+ * @param[in] max_event
+ *   Upper bound on number of events. It has to be greater then zero.
+ *
+ * @param[out] event_class
+ *   Array of at least <tt>max_event</tt> entries.
+ *
+ * @param[out] row
+ *   Array of at least <tt>max_state</tt> entries.
+ *
+ * @param[out] rows
+ *   Array of at least <tt>max_rows</tt> entries.
+ *
+ * @param[in] max_rows
+ *   Size of <tt>rows</tt> array.
+ *
+ * @param[out] statistics
+ *   Number of classes and rows together with sizes of original and compiled
+ *   transition table are stored here.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If
+ *   <tt>rows</tt> is NULL or it is too small, then
+ *   <tt>STATE_MACHINE_NO_SPACE</tt> is returned.
+ */
+uint32_t state_machine_compile_table(
+    const State_machine_transition *const transition_table,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    uint32_t *const event_class,
+    uint32_t *const row,
+    State_machine_transition *const rows,
+    const size_t max_rows,
+    State_machine_compile_statistics *const statistics);
+
 /** Initialize state machine using transition function.
  *
  * @param[in] max_state
@@ -274,6 +796,95 @@ void state_machine_init_function(State_machine *const state_machine,
     State_machine_transition_cleanup_function cleanup,
     void *const data);
 
+/** Initialize state machine using transition function that stores its result
+ * in to a buffer.
+ *
+ * Buffer is provided by <tt>state_machine_event()</tt>, it is valid until
+ * callbacks of the event are finished, therefore transition function doesn't
+ * have to allocate anything and no cleanup function is necessary.
+ *
+ * @param[in] max_state
+ *   Upper bound on number of states. It has to be greater then zero.
+ *
+ * @param[in] max_event
+ *   Upper bound on number of events. It has to be greater then zero.
+ *
+ * @param[in] init_state
+ *   Initial state of state machine. It may be between zero (including) and
+ *   max_state (excluding).
+ *
+ * @param[in] transition
+ *   Transition function that takes state machine as it is and stores state
+ *   machine transition that has to be applied in to a buffer.
+ */
+void state_machine_init_output_function(State_machine *const state_machine,
+    const uint32_t max_state,
+    const uint32_t max_event,
+    const uint32_t init_state,
+    State_machine_locking locking,
+    State_machine_transition_output_function transition,
+    void *const data);
+
+/** Switch state machine that uses transition table or compact transition
+ * table to lock-free operation.
+ *
+ * Current state is then advanced using atomic compare-and-exchange loop
+ * against the transition table, which has to be constant from now on, and it
+ * is read using atomic load. Locking primitives aren't used at all,
+ * therefore <tt>STATE_MACHINE_NONBLOCK</tt> never causes
+ * <tt>STATE_MACHINE_WOULD_BLOCK</tt> to be returned.
+ *
+ * This function has to be called after state machine was initialized, but
+ * before it is shared with other threads of execution.
+ *
+ * @param[in] state_machine
+ *   State machine initialized using <tt>state_machine_init_table()</tt> or
+ *   <tt>state_machine_init_compact_table()</tt>.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If state
+ *   machine uses transition function, has buffer of deferred callbacks
+ *   attached, or compiler doesn't support C11 atomic operations, then it
+ *   returns <tt>STATE_MACHINE_NOT_SUPPORTED</tt> and
+ *   state machine keeps using locking primitives it was initialized with.
+ */
+uint32_t state_machine_set_lock_free(State_machine *const state_machine);
+
+/** Declare transition function of state machine to be pure.
+ *
+ * Pure transition function returns the same transition for the same state
+ * and event, regardless of anything else. Results are then remembered in
+ * cache when they are first needed, and neither transition nor cleanup
+ * function is called for cells that are in the cache. Cleanup function is
+ * called only once for each transition that is put in to cache, right after
+ * it was copied, still inside critical section.
+ *
+ * This function has to be called after state machine was initialized, but
+ * before it is shared with other threads of execution.
+ *
+ * @param[in] state_machine
+ *   State machine initialized using <tt>state_machine_init_function()</tt>.
+ *
+ * @param[in] cache
+ *   Array of <tt>cache_size</tt> entries allocated by caller. It has to stay
+ *   valid for as long as state machine is used.
+ *
+ * @param[in] cache_size
+ *   Number of cache entries. If it is at least <tt>max_state *
+ *   max_event</tt>, then every cell has its own entry and transition
+ *   function is called at most once for each of them. Smaller cache has to
+ *   have power of two entries and cells that map to the same entry replace
+ *   each other.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If state
+ *   machine doesn't use transition function, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_set_pure_function(State_machine *const state_machine,
+    State_machine_transition_cache_entry *const cache,
+    const size_t cache_size);
+
 /** Flag indicates that state machine should operate in nonblocking manner.
  *
  * Using same value as O_NONBLOCK on Linux, but there is no deep reason behind
@@ -282,6 +893,9 @@ void state_machine_init_function(State_machine *const state_machine,
 #define STATE_MACHINE_NONBLOCK  2048
 
 /** Get current state of a state machine.
+ *
+ * Lock is taken in shared mode if state machine has shared locking
+ * operations, therefore concurrent queries don't serialize with each other.
  *
  * @param[in] state_machine
  *   State machine of which current state this function retrieves.
@@ -330,13 +944,191 @@ uint32_t state_machine_current_state(State_machine *const state_machine,
  *   lock, then it returns <tt>STATE_MACHINE_WOULD_BLOCK</tt>. If on-enter
  *   callback function is specified and it fails (returns value not equal to
  *   <tt>STATE_MACHINE_SUCCESS</tt>), then that value is returned by this
- *   function as well.
+ *   function as well. If buffer of deferred callbacks is attached and full,
+ *   then event is refused with <tt>STATE_MACHINE_NO_SPACE</tt>, see
+ *   <tt>state_machine_attach_deferred()</tt>.
  */
 uint32_t state_machine_event(State_machine *const, const uint32_t event,
     void *const event_data, const uint32_t flags);
 
+/** Function with the same arguments and semantics as
+ * <tt>state_machine_event()</tt>.
+ */
+typedef uint32_t (*State_machine_event_handler)(State_machine *const,
+    const uint32_t event, void *const event_data, const uint32_t flags);
+
+/** Specialized variants of <tt>state_machine_event()</tt>.
+ *
+ * They behave the same way as <tt>state_machine_event()</tt>, but they don't
+ * decide how transition is looked up and if locking primitives are used,
+ * therefore they may be called only for state machine that matches their
+ * name:
+ *
+ * - <tt>table</tt> variants for state machine initialized using
+ *   <tt>state_machine_init_table()</tt> that wasn't switched to lock-free
+ *   operation,
+ *
+ * - <tt>function</tt> variants for state machine initialized using
+ *   <tt>state_machine_init_function()</tt> that wasn't declared pure,
+ *
+ * - <tt>nolock</tt> variants for state machines initialized with
+ *   <tt>STATE_MACHINE_NO_LOCKING</tt> and <tt>lock</tt> variants for the
+ *   rest.
+ *
+ * Use <tt>state_machine_event_handler()</tt> to get the right one.
+ */
+uint32_t state_machine_event_table_nolock(State_machine *const,
+    const uint32_t event, void *const event_data, const uint32_t flags);
+uint32_t state_machine_event_table_lock(State_machine *const,
+    const uint32_t event, void *const event_data, const uint32_t flags);
+uint32_t state_machine_event_function_nolock(State_machine *const,
+    const uint32_t event, void *const event_data, const uint32_t flags);
+uint32_t state_machine_event_function_lock(State_machine *const,
+    const uint32_t event, void *const event_data, const uint32_t flags);
+
+/** Choose variant of <tt>state_machine_event()</tt> for a state machine.
+ *
+ * It should be called once state machine is fully configured, result is
+ * valid for as long as its configuration doesn't change.
+ *
+ * @param[in] state_machine
+ *   Initialized state machine.
+ *
+ * @return
+ *   One of specialized variants of <tt>state_machine_event()</tt> if there
+ *   is one for this state machine, otherwise
+ *   <tt>state_machine_event()</tt> itself.
+ */
+State_machine_event_handler state_machine_event_handler(
+    State_machine *const state_machine);
+
+/** Maximum number of events from a batch that are processed inside one
+ * critical section.
+ *
+ * Transitions of one chunk are remembered on the stack of
+ * <tt>state_machine_event_batch()</tt> so that callbacks can be invoked
+ * outside of critical section, which is why this is bounded.
+ */
+#ifndef STATE_MACHINE_BATCH_SIZE
+#define STATE_MACHINE_BATCH_SIZE    256
+#endif
+
+/** Send multiple events to state machine for it to handle.
+ *
+ * Events are processed in order, as if <tt>state_machine_event()</tt> was
+ * called for each of them, but lock is taken only once for every
+ * <tt>STATE_MACHINE_BATCH_SIZE</tt> events. State transitions of such chunk
+ * are made inside one critical section and then on-enter and
+ * on-undefined-transition callbacks are invoked, in order, outside of it.
+ * Callbacks therefore get the same arguments as they would from
+ * <tt>state_machine_event()</tt>, but by the time they are called state
+ * machine may already be in a state reached by later event of the chunk.
+ *
+ * @param[in] state_machine
+ *   State machine to which <tt>events</tt> are sent to.
+ *
+ * @param[in] events
+ *   Array of <tt>count</tt> events.
+ *
+ * @param[in] event_data
+ *   Array of <tt>count</tt> pointers, <tt>event_data[i]</tt> is passed to
+ *   callback invoked for <tt>events[i]</tt>. It may be NULL in which case
+ *   callbacks get NULL as event data.
+ *
+ * @param[in] count
+ *   Number of events in <tt>events</tt> array.
+ *
+ * @param[out] results
+ *   Array of <tt>count</tt> values, for each consumed event it is set to
+ *   value that <tt>state_machine_event()</tt> would return for it. It may be
+ *   NULL if caller is not interested in per-event results.
+ *
+ * @param[out] consumed
+ *   Number of events that were processed is stored here. It may be NULL.
+ *
+ * @param[in] flags
+ *   Same as for <tt>state_machine_event()</tt>. It is applied every time lock
+ *   is taken.
+ *
+ * @return
+ *   On success function returns <tt>STATE_MACHINE_SUCCESS</tt>. If flags have
+ *   <tt>STATE_MACHINE_NONBLOCK</tt> bit set and function was unable to acquire
+ *   lock, then it returns <tt>STATE_MACHINE_WOULD_BLOCK</tt> and events from
+ *   <tt>*consumed</tt> onwards weren't processed. If transition function fails,
+ *   then processing stops, failed event is counted as consumed and its return
+ *   value is returned. Event refused because buffer of deferred callbacks is
+ *   full stops processing too, but it had no effect and therefore it isn't
+ *   counted, <tt>STATE_MACHINE_NO_SPACE</tt> is returned and events can be
+ *   sent again from <tt>*consumed</tt> onwards.
+ *   Failures of cleanup function are reported only through
+ *   <tt>results</tt>.
+ */
+uint32_t state_machine_event_batch(State_machine *const state_machine,
+    const uint32_t *const events,
+    void *const *const event_data,
+    const size_t count,
+    uint32_t *const results,
+    size_t *const consumed,
+    const uint32_t flags);
+
+/** Run state machine over a buffer of bytes, each byte being an event.
+ *
+ * This is intended for state machines that are deterministic automatons
+ * over bytes, e.g. tokenizers. Whole buffer is processed inside one critical
+ * section without calling any callbacks, until state machine enters one of
+ * stop states or until it encounters undefined transition. Only callback of
+ * transition in to stop state is invoked, after leaving critical section and
+ * with NULL event data. Steps aren't recorded in statistics nor in trace.
+ *
+ * @param[in] state_machine
+ *   State machine that uses transition table or compact transition table,
+ *   and that has at least 256 events.
+ *
+ * @param[in] input
+ *   Array of <tt>length</tt> bytes.
+ *
+ * @param[in] length
+ *   Number of bytes in <tt>input</tt>.
+ *
+ * @param[in] stop
+ *   Array of <tt>max_state</tt> entries, state machine stops after entering
+ *   state which entry is non-zero. It may be NULL if there are no stop
+ *   states.
+ *
+ * @param[out] consumed
+ *   Number of bytes that were processed is stored here.
+ *
+ * @param[in] flags
+ *   Same as for <tt>state_machine_event()</tt>.
+ *
+ * @return
+ *   On success, i.e. when whole input was processed or when stop state was
+ *   entered, function returns <tt>STATE_MACHINE_SUCCESS</tt>. If byte at
+ *   offset <tt>*consumed</tt> has undefined transition, then it returns
+ *   <tt>STATE_MACHINE_INVALID</tt> and that byte isn't processed. If flags
+ *   have <tt>STATE_MACHINE_NONBLOCK</tt> bit set and function was unable to
+ *   acquire lock, then it returns <tt>STATE_MACHINE_WOULD_BLOCK</tt>. If
+ *   state machine uses other implementation, is lock-free, or has buffer of
+ *   deferred callbacks attached, then it returns
+ *   <tt>STATE_MACHINE_NOT_SUPPORTED</tt>.
+ */
+uint32_t state_machine_match(State_machine *const state_machine,
+    const uint8_t *const input,
+    const size_t length,
+    const uint8_t *const stop,
+    size_t *const consumed,
+    const uint32_t flags);
+
 #define STATE_MACHINE_SUCCESS       0
 #define STATE_MACHINE_WOULD_BLOCK   1
+#define STATE_MACHINE_NO_SPACE      2
+#define STATE_MACHINE_NOT_SUPPORTED 3
+
+/* Data, e.g. content of a file, don't have expected format. */
+#define STATE_MACHINE_INVALID       4
+
+/* Operating system call failed, details are in errno. */
+#define STATE_MACHINE_SYSTEM_ERROR  5
 
 #define is_sm_success(r)        ((r) == STATE_MACHINE_SUCCESS)
 #define is_sm_failure(r)        ((r) != STATE_MACHINE_SUCCESS)
@@ -0,0 +1,490 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATE_MACHINE_HPP_294253647662741803455963675285961270097
+#define STATE_MACHINE_HPP_294253647662741803455963675285961270097
+
+/* C++17 front end of state machines that use transition table known at
+ * compile time. Callbacks are function objects, e.g. lambdas, stored in the
+ * state machine, and entries of the table refer to them by index. Handling
+ * of an event is then a lookup in constant table followed by a direct call
+ * that compiler can inline, instead of a call through On_state_enter
+ * pointer with void * data.
+ *
+ * Each table_machine wraps ordinary State_machine that uses equivalent
+ * transition table, therefore it can be passed to any function of C
+ * interface using c_handle(), e.g. to attach statistics or a timer, or to
+ * code that is still written in C. Such functions handle events the same
+ * way, only through function pointers. Similarly to specialized variants
+ * of state_machine_event(), table_machine::event() doesn't use anything that
+ * was attached this way.
+ */
+
+#include "state-machine.h"
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace state_machine
+{
+
+/** Value of <tt>cell::callback</tt> that means there is no callback.
+ */
+constexpr std::uint32_t no_callback = UINT32_MAX;
+
+/** Entry of transition table of <tt>table_machine</tt>.
+ */
+struct cell
+{
+    /** Flag that indicates if there is transition.
+     */
+    bool is_transition;
+
+    /** State in to which state machine transitions, if
+     * <tt>is_transition</tt> is set.
+     */
+    std::uint32_t next_state;
+
+    /** Index of callback of state machine that is invoked, as on-enter
+     * callback if <tt>is_transition</tt> is set and as on-undefined-transition
+     * callback otherwise, or <tt>no_callback</tt>.
+     */
+    std::uint32_t callback;
+};
+
+constexpr cell transition(const std::uint32_t next_state,
+    const std::uint32_t callback = no_callback)
+{
+    return cell{true, next_state, callback};
+}
+
+constexpr cell no_transition(const std::uint32_t callback = no_callback)
+{
+    return cell{false, 0, callback};
+}
+
+/** Locking policy that doesn't do any locking.
+ *
+ * Any type with <tt>lock()</tt>, <tt>try_lock()</tt> and
+ * <tt>unlock()</tt>, e.g. <tt>std::mutex</tt>, may be used as a locking
+ * policy.
+ */
+struct no_lock
+{
+    void lock() noexcept {}
+    bool try_lock() noexcept { return true; }
+    void unlock() noexcept {}
+};
+
+namespace detail
+{
+
+/* On-enter callback may take (cause, current_state, previous_state,
+ * event_data), the same without event_data, or nothing.
+ */
+template <class F>
+inline void on_enter(F &f, const std::uint32_t cause,
+    const std::uint32_t current_state, const std::uint32_t previous_state,
+    void *const event_data)
+{
+    if constexpr (std::is_invocable_v<F &, std::uint32_t, std::uint32_t,
+        std::uint32_t, void *>)
+    {
+        f(cause, current_state, previous_state, event_data);
+    }
+    else if constexpr (std::is_invocable_v<F &, std::uint32_t, std::uint32_t,
+        std::uint32_t>)
+    {
+        f(cause, current_state, previous_state);
+    }
+    else
+    {
+        static_assert(std::is_invocable_v<F &>,
+            "callback used for transition can't be called as on-enter");
+        f();
+    }
+}
+
+/* On-undefined-transition callback may take (cause, current_state,
+ * event_data), the same without event_data, or nothing.
+ */
+template <class F>
+inline void on_undefined(F &f, const std::uint32_t cause,
+    const std::uint32_t current_state, void *const event_data)
+{
+    if constexpr (std::is_invocable_v<F &, std::uint32_t, std::uint32_t,
+        void *>)
+    {
+        f(cause, current_state, event_data);
+    }
+    else if constexpr (std::is_invocable_v<F &, std::uint32_t,
+        std::uint32_t>)
+    {
+        f(cause, current_state);
+    }
+    else
+    {
+        static_assert(std::is_invocable_v<F &>, "callback used for undefined"
+            " transition can't be called as on-undefined-transition");
+        f();
+    }
+}
+
+}   // namespace detail
+
+/** State machine with transition table <tt>Table</tt> of
+ * <tt>States * Events</tt> entries, locking policy <tt>Lock</tt> and
+ * callbacks of types <tt>Callbacks</tt>.
+ *
+ * Table is checked at compile time, every next state and callback index it
+ * refers to has to exist.
+ */
+template <std::uint32_t States, std::uint32_t Events,
+    const cell (&Table)[States][Events], class Lock = no_lock,
+    class... Callbacks>
+class table_machine
+{
+    static_assert(States > 0 && Events > 0,
+        "state machine needs at least one state and one event");
+
+    static constexpr bool valid_table()
+    {
+        for (std::uint32_t s = 0; s < States; s++)
+        {
+            for (std::uint32_t e = 0; e < Events; e++)
+            {
+                const cell &c = Table[s][e];
+
+                if ((c.is_transition && c.next_state >= States)
+                    || (c.callback != no_callback
+                        && c.callback >= sizeof...(Callbacks)))
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    static_assert(valid_table(),
+        "transition table refers to state or callback that doesn't exist");
+
+    /* Callbacks are instantiated only for the way they are used in the
+     * table.
+     */
+    static constexpr bool used(const std::size_t callback,
+        const bool is_transition)
+    {
+        for (std::uint32_t s = 0; s < States; s++)
+        {
+            for (std::uint32_t e = 0; e < Events; e++)
+            {
+                if (Table[s][e].callback == callback
+                    && Table[s][e].is_transition == is_transition)
+                {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+public:
+    explicit table_machine(const std::uint32_t init_state,
+        Callbacks... callbacks)
+        : callbacks_(std::move(callbacks)...)
+    {
+        assert(init_state < States);
+
+        state_machine_init_table(&state_machine_, States, Events, init_state,
+            locking(), c_table(), this);
+    }
+
+    /* Wrapped State_machine points back to this object.
+     */
+    table_machine(const table_machine &) = delete;
+    table_machine &operator=(const table_machine &) = delete;
+
+    /** Same as <tt>state_machine_event()</tt>.
+     */
+    std::uint32_t event(const std::uint32_t event,
+        void *const event_data = nullptr, const std::uint32_t flags = 0)
+    {
+        assert(event < Events);
+
+        if (flags & STATE_MACHINE_NONBLOCK)
+        {
+            if (!lock_.try_lock())
+            {
+                return STATE_MACHINE_WOULD_BLOCK;
+            }
+        }
+        else
+        {
+            lock_.lock();
+        }
+
+        const std::uint32_t current_state = state_machine_.current_state;
+        const cell &c = Table[current_state][event];
+
+        if (c.is_transition)
+        {
+            state_machine_.current_state = c.next_state;
+        }
+
+        lock_.unlock();
+
+        if (c.callback != no_callback)
+        {
+            if (c.is_transition)
+            {
+                invoke(c.callback, true, event, c.next_state, current_state,
+                    event_data, std::index_sequence_for<Callbacks...>{});
+            }
+            else
+            {
+                invoke(c.callback, false, event, current_state, States,
+                    event_data, std::index_sequence_for<Callbacks...>{});
+            }
+        }
+
+        return STATE_MACHINE_SUCCESS;
+    }
+
+    /** Same as <tt>state_machine_current_state()</tt> without flags.
+     */
+    std::uint32_t current_state() const
+    {
+        lock_.lock();
+        const std::uint32_t state = state_machine_.current_state;
+        lock_.unlock();
+
+        return state;
+    }
+
+    /** Wrapped state machine for use with C interface. Its data point to
+     * this object.
+     */
+    State_machine *c_handle() noexcept
+    {
+        return &state_machine_;
+    }
+
+    /** Callback with index <tt>I</tt>.
+     */
+    template <std::size_t I>
+    auto &callback() noexcept
+    {
+        return std::get<I>(callbacks_);
+    }
+
+private:
+    static table_machine *self(State_machine *const sm)
+    {
+        return static_cast<table_machine *>(sm->data);
+    }
+
+    template <std::size_t I>
+    void invoke_one(const bool is_transition, const std::uint32_t cause,
+        const std::uint32_t current_state,
+        const std::uint32_t previous_state, void *const event_data)
+    {
+        if constexpr (used(I, true))
+        {
+            if (is_transition)
+            {
+                detail::on_enter(std::get<I>(callbacks_), cause,
+                    current_state, previous_state, event_data);
+            }
+        }
+        if constexpr (used(I, false))
+        {
+            if (!is_transition)
+            {
+                detail::on_undefined(std::get<I>(callbacks_), cause,
+                    current_state, event_data);
+            }
+        }
+    }
+
+    template <std::size_t... I>
+    void invoke([[maybe_unused]] const std::uint32_t callback,
+        [[maybe_unused]] const bool is_transition,
+        [[maybe_unused]] const std::uint32_t cause,
+        [[maybe_unused]] const std::uint32_t current_state,
+        [[maybe_unused]] const std::uint32_t previous_state,
+        [[maybe_unused]] void *const event_data, std::index_sequence<I...>)
+    {
+        ((callback == I
+            ? invoke_one<I>(is_transition, cause, current_state,
+                previous_state, event_data)
+            : void()), ...);
+    }
+
+    /* {{{ C interface ***************************************************** */
+
+    template <std::size_t I>
+    static void enter_trampoline(const std::uint32_t cause,
+        const std::uint32_t current_state, const std::uint32_t previous_state,
+        void *const event_data, void *const data)
+    {
+        detail::on_enter(
+            std::get<I>(static_cast<table_machine *>(data)->callbacks_),
+            cause, current_state, previous_state, event_data);
+    }
+
+    template <std::size_t I>
+    static void undefined_trampoline(const std::uint32_t cause,
+        const std::uint32_t current_state, void *const event_data,
+        void *const data)
+    {
+        detail::on_undefined(
+            std::get<I>(static_cast<table_machine *>(data)->callbacks_),
+            cause, current_state, event_data);
+    }
+
+    template <std::size_t I>
+    static void c_callback(On_state_enter *const on_enter,
+        On_undefined_state_transition *const on_undefined)
+    {
+        if constexpr (used(I, true))
+        {
+            on_enter[I] = &enter_trampoline<I>;
+        }
+        if constexpr (used(I, false))
+        {
+            on_undefined[I] = &undefined_trampoline<I>;
+        }
+    }
+
+    template <std::size_t... I>
+    static void c_callbacks(std::index_sequence<I...>,
+        [[maybe_unused]] On_state_enter *const on_enter,
+        [[maybe_unused]] On_undefined_state_transition *const on_undefined)
+    {
+        (c_callback<I>(on_enter, on_undefined), ...);
+    }
+
+    /* Transition table of wrapped State_machine, it is built only once for
+     * all instances.
+     */
+    static State_machine_transition *c_table()
+    {
+        static std::array<State_machine_transition, States * Events> table =
+            []
+            {
+                std::array<State_machine_transition, States * Events> t{};
+                On_state_enter on_enter[sizeof...(Callbacks) + 1] = {};
+                On_undefined_state_transition
+                    on_undefined[sizeof...(Callbacks) + 1] = {};
+
+                c_callbacks(std::index_sequence_for<Callbacks...>{},
+                    on_enter, on_undefined);
+
+                for (std::uint32_t s = 0; s < States; s++)
+                {
+                    for (std::uint32_t e = 0; e < Events; e++)
+                    {
+                        const cell &c = Table[s][e];
+                        State_machine_transition &o = t[s * Events + e];
+
+                        o.cause = e;
+                        o.current_state = s;
+                        o.is_transition = c.is_transition;
+                        if (c.is_transition)
+                        {
+                            o.result.transition.next_state = c.next_state;
+                            o.result.transition.on_enter =
+                                c.callback == no_callback
+                                    ? nullptr : on_enter[c.callback];
+                        }
+                        else
+                        {
+                            o.result.no_transition.on_undefined_transition =
+                                c.callback == no_callback
+                                    ? nullptr : on_undefined[c.callback];
+                        }
+                    }
+                }
+
+                return t;
+            }();
+
+        return table.data();
+    }
+
+    static bool c_try_take(State_machine *const sm)
+    {
+        return self(sm)->lock_.try_lock();
+    }
+
+    static void c_take(State_machine *const sm)
+    {
+        self(sm)->lock_.lock();
+    }
+
+    static void c_give(State_machine *const sm)
+    {
+        self(sm)->lock_.unlock();
+    }
+
+    static State_machine_locking locking()
+    {
+        if constexpr (std::is_same_v<Lock, no_lock>)
+        {
+            return State_machine_locking{nullptr, nullptr, nullptr, nullptr,
+                nullptr, nullptr};
+        }
+        else
+        {
+            return State_machine_locking{&c_try_take, &c_take, &c_give,
+                nullptr, nullptr, nullptr};
+        }
+    }
+
+    /* }}} C interface ***************************************************** */
+
+    State_machine state_machine_;
+    mutable Lock lock_;
+    std::tuple<Callbacks...> callbacks_;
+};
+
+}   // namespace state_machine
+
+#endif /* STATE_MACHINE_HPP_294253647662741803455963675285961270097 */
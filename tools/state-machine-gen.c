@@ -0,0 +1,619 @@
+/* Copyright (c) 2014, Peter Trško <peter.trsko@gmail.com>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Peter Trško nor the names of other
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Generator of state machine dispatch code.
+ *
+ * Usage: state-machine-gen [-o OUTPUT] INPUT
+ *
+ * Reads description of a state machine from INPUT and writes C header to
+ * OUTPUT, or standard output, that defines enumerations of states and
+ * events, transition table, and functions NAME_init() and NAME_event(). The
+ * latter has the same semantics as state_machine_event(), but it uses switch
+ * statement instead of transition table and calls callbacks directly, which
+ * allows compiler to inline them. Callbacks have to be declared before
+ * generated header is included.
+ *
+ * Description consists of lines, "#" starts a comment:
+ *
+ *   machine NAME
+ *   states STATE...
+ *   events EVENT...
+ *   transition STATE EVENT NEXT_STATE [ON_ENTER]
+ *   undefined STATE EVENT [ON_UNDEFINED_TRANSITION]
+ *   default ON_UNDEFINED_TRANSITION
+ *
+ * Transitions that aren't listed are undefined and call callback specified
+ * by "default", if there is any.
+ */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE        4096
+#define MAX_TOKENS      64
+
+typedef struct
+{
+    char **items;
+    size_t count;
+} Names;
+
+enum
+{
+    CELL_DEFAULT = 0,
+    CELL_TRANSITION,
+    CELL_UNDEFINED
+};
+
+typedef struct
+{
+    int kind;
+    size_t next_state;
+
+    /* Index in to callbacks or -1 if there is none. */
+    long callback;
+} Cell;
+
+typedef struct
+{
+    char *state;
+    char *event;
+    char *next_state;
+    char *callback;
+    size_t line;
+} Entry;
+
+static const char *input_name;
+static size_t line_number;
+
+static char *machine;
+static char *default_callback;
+static Names states;
+static Names events;
+static Names callbacks;
+static Entry *entries;
+static size_t entry_count;
+
+static void die(const char *message, const char *argument)
+{
+    fprintf(stderr, "%s:%zu: %s%s%s\n", input_name, line_number, message,
+        argument == NULL ? "" : ": ", argument == NULL ? "" : argument);
+    exit(EXIT_FAILURE);
+}
+
+static void *xrealloc(void *p, const size_t size)
+{
+    p = realloc(p, size);
+    if (p == NULL)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return p;
+}
+
+static char *xstrdup(const char *s)
+{
+    char *d = xrealloc(NULL, strlen(s) + 1);
+
+    return strcpy(d, s);
+}
+
+static bool is_identifier(const char *s)
+{
+    if (!(isalpha((unsigned char)*s) || *s == '_'))
+    {
+        return false;
+    }
+    for (s++; *s != '\0'; s++)
+    {
+        if (!(isalnum((unsigned char)*s) || *s == '_'))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static long names_find(const Names *const names, const char *const name)
+{
+    for (size_t i = 0; i < names->count; i++)
+    {
+        if (strcmp(names->items[i], name) == 0)
+        {
+            return (long)i;
+        }
+    }
+
+    return -1;
+}
+
+static size_t names_add(Names *const names, const char *const name)
+{
+    const long i = names_find(names, name);
+
+    if (i >= 0)
+    {
+        return (size_t)i;
+    }
+    names->items =
+        xrealloc(names->items, (names->count + 1) * sizeof(char *));
+    names->items[names->count] = xstrdup(name);
+
+    return names->count++;
+}
+
+static char *identifier(const char *const token)
+{
+    if (!is_identifier(token))
+    {
+        die("Invalid identifier", token);
+    }
+
+    return xstrdup(token);
+}
+
+static void parse(FILE *const input)
+{
+    char line[MAX_LINE];
+
+    while (fgets(line, sizeof(line), input) != NULL)
+    {
+        char *tokens[MAX_TOKENS];
+        size_t n = 0;
+        char *comment = strchr(line, '#');
+
+        line_number++;
+        if (comment != NULL)
+        {
+            *comment = '\0';
+        }
+        else if (strchr(line, '\n') == NULL && !feof(input))
+        {
+            die("Line is too long", NULL);
+        }
+
+        for (char *t = strtok(line, " \t\r\n"); t != NULL;
+            t = strtok(NULL, " \t\r\n"))
+        {
+            if (n == MAX_TOKENS)
+            {
+                die("Too many words on one line", NULL);
+            }
+            tokens[n++] = t;
+        }
+        if (n == 0)
+        {
+            continue;
+        }
+
+        if (strcmp(tokens[0], "machine") == 0 && n == 2)
+        {
+            free(machine);
+            machine = identifier(tokens[1]);
+        }
+        else if (strcmp(tokens[0], "states") == 0 && n > 1)
+        {
+            for (size_t i = 1; i < n; i++)
+            {
+                free(identifier(tokens[i]));
+                if (names_find(&states, tokens[i]) >= 0)
+                {
+                    die("Duplicate state", tokens[i]);
+                }
+                (void)names_add(&states, tokens[i]);
+            }
+        }
+        else if (strcmp(tokens[0], "events") == 0 && n > 1)
+        {
+            for (size_t i = 1; i < n; i++)
+            {
+                free(identifier(tokens[i]));
+                if (names_find(&events, tokens[i]) >= 0)
+                {
+                    die("Duplicate event", tokens[i]);
+                }
+                (void)names_add(&events, tokens[i]);
+            }
+        }
+        else if (strcmp(tokens[0], "default") == 0 && n == 2)
+        {
+            free(default_callback);
+            default_callback = identifier(tokens[1]);
+        }
+        else if ((strcmp(tokens[0], "transition") == 0 && (n == 4 || n == 5))
+            || (strcmp(tokens[0], "undefined") == 0 && (n == 3 || n == 4)))
+        {
+            const bool is_transition = tokens[0][0] == 't';
+            Entry *e;
+
+            entries = xrealloc(entries, (entry_count + 1) * sizeof(Entry));
+            e = &entries[entry_count++];
+            e->state = identifier(tokens[1]);
+            e->event = identifier(tokens[2]);
+            e->next_state = is_transition ? identifier(tokens[3]) : NULL;
+            e->callback = n == (is_transition ? 5u : 4u)
+                ? identifier(tokens[n - 1]) : NULL;
+            e->line = line_number;
+        }
+        else
+        {
+            die("Invalid line", tokens[0]);
+        }
+    }
+
+    if (ferror(input))
+    {
+        die("Unable to read input", NULL);
+    }
+    if (machine == NULL)
+    {
+        die("Missing machine name", NULL);
+    }
+    if (states.count == 0 || events.count == 0)
+    {
+        die("At least one state and one event have to be defined", NULL);
+    }
+}
+
+/* Resolve entries in to cells of transition table.
+ */
+static Cell *resolve(void)
+{
+    Cell *const cells =
+        xrealloc(NULL, states.count * events.count * sizeof(Cell));
+    const long undefined = default_callback == NULL
+        ? -1 : (long)names_add(&callbacks, default_callback);
+
+    for (size_t i = 0; i < states.count * events.count; i++)
+    {
+        cells[i].kind = CELL_DEFAULT;
+        cells[i].next_state = 0;
+        cells[i].callback = undefined;
+    }
+
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        const Entry *const e = &entries[i];
+        const long s = names_find(&states, e->state);
+        const long ev = names_find(&events, e->event);
+        Cell *c;
+
+        line_number = e->line;
+        if (s < 0)
+        {
+            die("Unknown state", e->state);
+        }
+        if (ev < 0)
+        {
+            die("Unknown event", e->event);
+        }
+
+        c = &cells[(size_t)s * events.count + (size_t)ev];
+        if (c->kind != CELL_DEFAULT)
+        {
+            die("Transition is defined more then once", e->event);
+        }
+
+        c->kind = e->next_state != NULL ? CELL_TRANSITION : CELL_UNDEFINED;
+        c->callback = e->callback == NULL
+            ? -1 : (long)names_add(&callbacks, e->callback);
+        if (e->next_state != NULL)
+        {
+            const long next = names_find(&states, e->next_state);
+
+            if (next < 0)
+            {
+                die("Unknown state", e->next_state);
+            }
+            c->next_state = (size_t)next;
+        }
+    }
+
+    return cells;
+}
+
+/* Each pair of callback and kind of transition is one action.
+ */
+static size_t action_index(const Cell *const c)
+{
+    if (c->callback < 0)
+    {
+        return 0;
+    }
+
+    return 1 + (size_t)c->callback * 2 + (c->kind == CELL_TRANSITION ? 0 : 1);
+}
+
+static void generate(FILE *const out, Cell *const cells)
+{
+    const size_t cell_count = states.count * events.count;
+    char *upper = xstrdup(machine);
+    bool *emitted = xrealloc(NULL, cell_count * sizeof(bool));
+
+    for (char *p = upper; *p != '\0'; p++)
+    {
+        *p = (char)toupper((unsigned char)*p);
+    }
+
+    fprintf(out,
+        "/* Generated by state-machine-gen from %s, do not edit.\n"
+        " */\n\n"
+        "#ifndef %s_STATE_MACHINE_GENERATED_H\n"
+        "#define %s_STATE_MACHINE_GENERATED_H\n\n"
+        "#include \"state-machine.h\"\n"
+        "#include <assert.h>\n\n",
+        input_name, upper, upper);
+
+    fprintf(out, "enum\n{\n");
+    for (size_t i = 0; i < states.count; i++)
+    {
+        fprintf(out, "    %s%s,\n", states.items[i], i == 0 ? " = 0" : "");
+    }
+    fprintf(out, "    %s_MAX_STATE\n};\n\n", upper);
+
+    fprintf(out, "enum\n{\n");
+    for (size_t i = 0; i < events.count; i++)
+    {
+        fprintf(out, "    %s%s,\n", events.items[i], i == 0 ? " = 0" : "");
+    }
+    fprintf(out, "    %s_MAX_EVENT\n};\n\n", upper);
+
+    /* Transition table makes the rest of the library usable with generated
+     * state machine.
+     */
+    fprintf(out, "static const State_machine_transition\n"
+        "    %s_transition_table[%s_MAX_STATE][%s_MAX_EVENT] =\n{\n",
+        machine, upper, upper);
+    for (size_t s = 0; s < states.count; s++)
+    {
+        fprintf(out, "    {\n");
+        for (size_t e = 0; e < events.count; e++)
+        {
+            const Cell *const c = &cells[s * events.count + e];
+            const char *const cb =
+                c->callback < 0 ? "NULL" : callbacks.items[c->callback];
+            const char *const separator = e + 1 < events.count ? "," : "";
+
+            if (c->kind == CELL_TRANSITION)
+            {
+                fprintf(out, "        STATE_MACHINE_TRANSITION(%s, %s, %s, "
+                    "%s)%s\n", states.items[s], events.items[e],
+                    states.items[c->next_state], cb, separator);
+            }
+            else
+            {
+                fprintf(out, "        STATE_MACHINE_NO_TRANSITION(%s, %s, "
+                    "%s)%s\n", states.items[s], events.items[e], cb,
+                    separator);
+            }
+        }
+        fprintf(out, "    }%s\n", s + 1 < states.count ? "," : "");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out,
+        "/* Initialize state machine so that both %s_event() and generic\n"
+        " * functions of the library can be used with it.\n"
+        " */\n"
+        "static inline void %s_init(State_machine *const sm,\n"
+        "    const uint32_t init_state,\n"
+        "    State_machine_locking locking,\n"
+        "    void *const data)\n"
+        "{\n"
+        "    state_machine_init_table(sm, %s_MAX_STATE, %s_MAX_EVENT, "
+        "init_state,\n"
+        "        locking, (State_machine_transition *)%s_transition_table, "
+        "data);\n"
+        "}\n\n",
+        machine, machine, upper, upper, machine);
+
+    fprintf(out,
+        "/* Same as state_machine_event(), but for state machine initialized\n"
+        " * using %s_init() that wasn't switched to lock-free operation.\n"
+        " */\n"
+        "static inline uint32_t %s_event(State_machine *const sm,\n"
+        "    const uint32_t event,\n"
+        "    void *const event_data,\n"
+        "    const uint32_t flags)\n"
+        "{\n"
+        "    uint32_t current_state;\n"
+        "    uint32_t previous_state = %s_MAX_STATE;\n"
+        "    unsigned action = 0;\n"
+        "    void *data;\n\n"
+        "    assert(event < %s_MAX_EVENT);\n\n"
+        "    if (sm->lock.take != NULL)\n"
+        "    {\n"
+        "        if (flags & STATE_MACHINE_NONBLOCK)\n"
+        "        {\n"
+        "            if (!sm->lock.try_take(sm))\n"
+        "            {\n"
+        "                return STATE_MACHINE_WOULD_BLOCK;\n"
+        "            }\n"
+        "        }\n"
+        "        else\n"
+        "        {\n"
+        "            sm->lock.take(sm);\n"
+        "        }\n"
+        "    }\n\n"
+        "    current_state = sm->current_state;\n"
+        "    data = sm->data;\n\n"
+        "    switch (current_state * %s_MAX_EVENT + event)\n"
+        "    {\n",
+        machine, machine, upper, upper, upper);
+
+    /* Cells with the same outcome share one branch.
+     */
+    memset(emitted, 0, cell_count * sizeof(bool));
+    for (size_t i = 0; i < cell_count; i++)
+    {
+        const Cell *const c = &cells[i];
+
+        if (emitted[i] || (c->kind != CELL_TRANSITION && c->callback < 0))
+        {
+            continue;
+        }
+
+        for (size_t j = i; j < cell_count; j++)
+        {
+            const Cell *const d = &cells[j];
+
+            if (!emitted[j]
+                && (d->kind == CELL_TRANSITION) == (c->kind == CELL_TRANSITION)
+                && d->next_state == c->next_state
+                && d->callback == c->callback)
+            {
+                emitted[j] = true;
+                fprintf(out, "        case %s * %s_MAX_EVENT + %s:\n",
+                    states.items[j / events.count], upper,
+                    events.items[j % events.count]);
+            }
+        }
+        if (c->kind == CELL_TRANSITION)
+        {
+            fprintf(out, "            previous_state = current_state;\n"
+                "            current_state = %s;\n",
+                states.items[c->next_state]);
+        }
+        fprintf(out, "            action = %zu;\n"
+            "            break;\n\n", action_index(c));
+    }
+    fprintf(out,
+        "        default:\n"
+        "            break;\n"
+        "    }\n"
+        "    sm->current_state = current_state;\n\n"
+        "    if (sm->lock.take != NULL)\n"
+        "    {\n"
+        "        sm->lock.give(sm);\n"
+        "    }\n\n"
+        "    /* Not every state machine has actions that use all of these. */\n"
+        "    (void)previous_state;\n"
+        "    (void)event_data;\n"
+        "    (void)data;\n\n"
+        "    switch (action)\n"
+        "    {\n");
+
+    for (size_t i = 0; i < callbacks.count; i++)
+    {
+        bool as_enter = false;
+        bool as_undefined = false;
+
+        for (size_t j = 0; j < cell_count; j++)
+        {
+            if (cells[j].callback == (long)i)
+            {
+                as_enter |= cells[j].kind == CELL_TRANSITION;
+                as_undefined |= cells[j].kind != CELL_TRANSITION;
+            }
+        }
+        if (as_enter)
+        {
+            fprintf(out, "        case %zu:\n"
+                "            %s(event, current_state, previous_state, "
+                "event_data, data);\n"
+                "            break;\n\n", 1 + i * 2, callbacks.items[i]);
+        }
+        if (as_undefined)
+        {
+            fprintf(out, "        case %zu:\n"
+                "            %s(event, current_state, event_data, data);\n"
+                "            break;\n\n", 2 + i * 2, callbacks.items[i]);
+        }
+    }
+
+    fprintf(out,
+        "        default:\n"
+        "            break;\n"
+        "    }\n\n"
+        "    return STATE_MACHINE_SUCCESS;\n"
+        "}\n\n"
+        "#endif /* %s_STATE_MACHINE_GENERATED_H */\n", upper);
+
+    free(emitted);
+    free(upper);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output_name = NULL;
+    FILE *input;
+    FILE *output = stdout;
+    Cell *cells;
+    int i = 1;
+
+    if (argc > 2 && strcmp(argv[1], "-o") == 0)
+    {
+        output_name = argv[2];
+        i = 3;
+    }
+    if (argc != i + 1)
+    {
+        fprintf(stderr, "Usage: %s [-o OUTPUT] INPUT\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    input_name = argv[i];
+    if ((input = fopen(input_name, "r")) == NULL)
+    {
+        perror(input_name);
+        exit(EXIT_FAILURE);
+    }
+    parse(input);
+    fclose(input);
+    cells = resolve();
+
+    if (output_name != NULL && (output = fopen(output_name, "w")) == NULL)
+    {
+        perror(output_name);
+        exit(EXIT_FAILURE);
+    }
+    generate(output, cells);
+    if (fclose(output) != 0)
+    {
+        perror(output_name == NULL ? "stdout" : output_name);
+        if (output_name != NULL)
+        {
+            remove(output_name);
+        }
+        exit(EXIT_FAILURE);
+    }
+
+    free(cells);
+
+    exit(EXIT_SUCCESS);
+}